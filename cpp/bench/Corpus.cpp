@@ -0,0 +1,386 @@
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Corpus.h"
+
+namespace brouwer
+{
+    namespace bench
+    {
+        /*!
+         * A fixed-seed xorshift, so that the corpus varies from line to line
+         * but never from run to run.
+         */
+        class Noise
+        {
+            public:
+                uint32_t next(uint32_t bound) noexcept
+                {
+                    this->state ^= this->state << 13;
+                    this->state ^= this->state >> 7;
+                    this->state ^= this->state << 17;
+
+                    return static_cast<uint32_t>(this->state % bound);
+                }
+
+            private:
+                uint64_t state = 0x9e3779b97f4a7c15;
+        };
+
+        static std::string number(Noise& noise)
+        {
+            switch (noise.next(6))
+            {
+                case 0:
+                    return std::to_string(noise.next(10));
+
+                case 1:
+                    return std::to_string(noise.next(1000000000));
+
+                case 2:
+                    return "-" + std::to_string(noise.next(1000));
+
+                case 3:
+                    return std::to_string(noise.next(1000)) + "." +
+                           std::to_string(noise.next(100000));
+
+                case 4:
+                    return noise.next(2) ? "NaN" : "-Infinity";
+
+                default:
+                    return "0." + std::to_string(noise.next(1000));
+            }
+        }
+
+        static void mixed_line(std::string& out, size_t i, Noise& noise)
+        {
+            const std::string n = std::to_string(i);
+
+            switch (i % 12)
+            {
+                case 0:
+                    out += "var x" + n + ": Int = " + number(noise) + "\n";
+                    break;
+
+                case 1:
+                    out += "y" + n + " = [1, 2, " + n + "]\n";
+                    break;
+
+                case 2:
+                    out += "z" + n + " = [a * 2 | a <- y" + n + ", a > 1]\n";
+                    break;
+
+                case 3:
+                    out += "d" + n + " = {\"a\" = 1, \"b\" = " + n + "}\n";
+                    break;
+
+                case 4:
+                    out += "t" + n + " = (1, 2.5, 'c', '\\n', \"s" + n +
+                           "\")\n";
+                    break;
+
+                case 5:
+                    out += "f" + n + " = \\a, b -> a + b * " + n + "\n";
+                    break;
+
+                case 6:
+                    out += "for k in y" + n + "\n    print k\n";
+                    break;
+
+                case 7:
+                    out += "while x" + n + " > 0\n    x" + n + " = x" + n +
+                           " - 1\n";
+                    break;
+
+                case 8:
+                    out += "q" + n + " = L.map f (g " + n +
+                           ") -- a comment\n";
+                    break;
+
+                case 9:
+                    out += "if x" + n + " == 0\n    print \"zero\"\n"
+                           "else if x" + n + " == 1\n    print \"one\"\n"
+                           "else\n    print \"many\"\n";
+                    break;
+
+                case 10:
+                    out += "fn fn" + n + " (a: [Int]) (b: {String, Int}) "
+                           "-> Int\n    return (a, b)\n";
+                    break;
+
+                default:
+                    out += "s" + n + " = {k = v | (k, v) <- d" + n + "}\n";
+                    break;
+            }
+        }
+
+        static void numbers_line(std::string& out, size_t i, Noise& noise)
+        {
+            out += "n" + std::to_string(i) + " = [";
+
+            for (size_t k = 0; k < 16; ++k)
+            {
+                if (k > 0)
+                {
+                    out += ", ";
+                }
+
+                out += number(noise);
+            }
+
+            out += "]\n";
+        }
+
+        static void strings_line(std::string& out, size_t i, Noise& noise)
+        {
+            static constexpr std::string_view words[] =
+            {
+                  "lorem"
+                , "ipsum"
+                , "dolor"
+                , "\\\"sit\\\""
+                , "amet,"
+                , "\\t"
+                , "consectetur"
+                , "\\n"
+            };
+
+            out += "s" + std::to_string(i) + " = \"";
+
+            for (size_t k = 0; k < 32; ++k)
+            {
+                out += words[noise.next(std::size(words))];
+                out += ' ';
+            }
+
+            out += "\"\n";
+        }
+
+        static void comprehensions_line(std::string& out, size_t i)
+        {
+            const std::string n = std::to_string(i);
+
+            switch (i % 3)
+            {
+                case 0:
+                    out += "c" + n + " = [a * " + n + " | a <- xs, a > " +
+                           std::to_string(i % 7) + "]\n";
+                    break;
+
+                case 1:
+                    out += "c" + n + " = {k = v + " + n +
+                           " | (k, v) <- d, v > 0}\n";
+                    break;
+
+                default:
+                    out += "c" + n + " = {a | a <- [b * 2 | b <- ys], a > " +
+                           n + "}\n";
+                    break;
+            }
+        }
+
+        /*!
+         * A statement nested `depth` blocks deep, each level alternately an
+         * `if` and a `while`, so that nearly all of the work is `get_block`.
+         */
+        static void blocks_item(std::string& out, size_t i)
+        {
+            const std::string n = std::to_string(i);
+            const size_t depth = 2 + i % 7;
+            std::string indent;
+
+            for (size_t level = 0; level < depth; ++level)
+            {
+                out += indent;
+                out += level % 2 ? "while b" : "if a";
+                out += std::to_string(level) + " > " + n + "\n";
+                indent += "    ";
+            }
+
+            for (size_t k = 0; k < 3; ++k)
+            {
+                out += indent + "print x" + std::to_string(k) + "\n";
+            }
+        }
+
+        static void nesting_line(std::string& out, size_t i)
+        {
+            const size_t depth = 32 + i % 32;
+            const char* const open = i % 2 ? "(" : "[";
+            const char* const close = i % 2 ? ")" : "]";
+
+            out += "p" + std::to_string(i) + " = ";
+
+            for (size_t k = 0; k < depth; ++k)
+            {
+                out += open;
+            }
+
+            out += std::to_string(i);
+
+            for (size_t k = 0; k < depth; ++k)
+            {
+                out += close;
+            }
+
+            out += '\n';
+        }
+
+        static void wide_line(std::string& out, size_t i)
+        {
+            out += "w" + std::to_string(i) + (i % 2 ? " = (" : " = [");
+
+            for (size_t k = 0; k < 1000; ++k)
+            {
+                if (k > 0)
+                {
+                    out += ", ";
+                }
+
+                out += "e" + std::to_string(k);
+            }
+
+            out += i % 2 ? ")\n" : "]\n";
+        }
+
+        std::string generate_nested(size_t depth, size_t bytes)
+        {
+            static constexpr std::string_view levels[][2] =
+            {
+                  { "(", ")" }
+                , { "[", "]" }
+                , { "{", "}" }
+                , { "(a, ", ")" }
+                , { "[a, ", "]" }
+                , { "{\"k\" = ", "}" }
+                , { "[x | x <- ", "]" }
+                , { "{x | x <- ", "}" }
+            };
+
+            std::string out;
+            std::string close;
+
+            out.reserve(bytes + 4096);
+
+            for (size_t i = 0; out.size() < bytes; ++i)
+            {
+                const auto& level = levels[i % std::size(levels)];
+
+                out += "n" + std::to_string(i) + " = ";
+                close.clear();
+
+                for (size_t k = 0; k < depth; ++k)
+                {
+                    out += level[0];
+                    close += level[1];
+                }
+
+                out += std::to_string(i);
+                out.append(close.rbegin(), close.rend());
+                out += '\n';
+            }
+
+            return out;
+        }
+
+        std::string_view shape_name(Shape shape) noexcept
+        {
+            switch (shape)
+            {
+                case Shape::mixed:          return "mixed";
+                case Shape::numbers:        return "numbers";
+                case Shape::strings:        return "strings";
+                case Shape::comprehensions: return "comprehensions";
+                case Shape::blocks:         return "blocks";
+                case Shape::nesting:        return "nesting";
+                case Shape::wide:           return "wide";
+                case Shape::imports:        return "imports";
+            }
+
+            return "";
+        }
+
+        std::optional<Shape> shape_named(std::string_view name) noexcept
+        {
+            for (const Shape shape : shapes)
+            {
+                if (shape_name(shape) == name)
+                {
+                    return shape;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        std::string generate(Shape shape, size_t bytes)
+        {
+            std::string out;
+            Noise noise;
+
+            out.reserve(bytes + 4096);
+
+            if (shape == Shape::imports)
+            {
+                // Imports can only come first, so they are the whole file
+                // but for one line.
+                out += "module Bench exposing main\n";
+            }
+
+            for (size_t i = 0; out.size() < bytes; ++i)
+            {
+                switch (shape)
+                {
+                    case Shape::mixed:
+                        mixed_line(out, i, noise);
+                        break;
+
+                    case Shape::numbers:
+                        numbers_line(out, i, noise);
+                        break;
+
+                    case Shape::strings:
+                        strings_line(out, i, noise);
+                        break;
+
+                    case Shape::comprehensions:
+                        comprehensions_line(out, i);
+                        break;
+
+                    case Shape::blocks:
+                        blocks_item(out, i);
+                        break;
+
+                    case Shape::nesting:
+                        nesting_line(out, i);
+                        break;
+
+                    case Shape::wide:
+                        wide_line(out, i);
+                        break;
+
+                    case Shape::imports:
+                    {
+                        const std::string n = std::to_string(i);
+
+                        out += i % 2 ? "import M" + n + " as M" + n + "\n"
+                                     : "import M" + n + " (f" + n + ", g)\n";
+
+                        break;
+                    }
+                }
+            }
+
+            if (shape == Shape::imports)
+            {
+                out += "main = M0.f0 1\n";
+            }
+
+            return out;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace brouwer
+{
+    namespace bench
+    {
+        /*!
+         * The kinds of synthetic script that `generate` writes, each
+         * dominated by one part of the grammar.
+         */
+        enum class Shape : uint8_t
+        {
+              mixed
+            , numbers
+            , strings
+            , comprehensions
+            , blocks
+            , nesting
+            , wide
+            , imports
+        };
+
+        constexpr Shape shapes[] =
+        {
+              Shape::mixed
+            , Shape::numbers
+            , Shape::strings
+            , Shape::comprehensions
+            , Shape::blocks
+            , Shape::nesting
+            , Shape::wide
+            , Shape::imports
+        };
+
+        std::string_view shape_name(Shape shape) noexcept;
+
+        std::optional<Shape> shape_named(std::string_view name) noexcept;
+
+        /*!
+         * A well-formed script of shape `shape`, of at least `bytes` bytes
+         * (give or take a line). The same arguments always give the same
+         * text, so timings stay comparable between runs and builds.
+         */
+        std::string generate(Shape shape, size_t bytes);
+
+        /*!
+         * Lines that each nest one kind of literal or comprehension `depth`
+         * deep, going through every kind in turn, to at least `bytes` bytes
+         * in all. Only how deeply the text nests changes with `depth`, so
+         * comparing how long two depths take to parse shows how the
+         * parser's time grows with nesting.
+         */
+        std::string generate_nested(size_t depth, size_t bytes);
+    }
+}
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Corpus.h"
+#include "FlatAst.h"
+#include "Parser.h"
+#include "Source.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace
+{
+    using namespace brouwer;
+    using namespace brouwer::bench;
+    using AST = Tree<Token>;
+    using Clock = std::chrono::steady_clock;
+
+    struct BenchOptions
+    {
+        /*!
+         * How long to keep repeating each benchmark, in seconds.
+         */
+        double min_time = 0.5;
+
+        size_t bytes = 1 << 20;
+
+        /*!
+         * Only run benchmarks whose name contains this.
+         */
+        std::string filter;
+    };
+
+    enum class Mode : uint8_t
+    {
+          tree
+        , flat
+        , packrat
+    };
+
+    struct Benchmark
+    {
+        const char* name;
+
+        Shape shape;
+
+        Mode mode;
+    };
+
+    /*!
+     * Grammar rules are private to the parser, so each `rule/` benchmark
+     * parses a corpus that spends nearly all of its time in that one rule.
+     */
+    constexpr Benchmark benchmarks[] =
+    {
+          { "rule/numLit",      Shape::numbers,        Mode::tree }
+        , { "rule/strLit",      Shape::strings,        Mode::tree }
+        , { "rule/listComp",    Shape::comprehensions, Mode::tree }
+        , { "rule/get_block",   Shape::blocks,         Mode::tree }
+        , { "parse/mixed",      Shape::mixed,          Mode::tree }
+        , { "parse/nesting",    Shape::nesting,        Mode::tree }
+        , { "parse/wide",       Shape::wide,           Mode::tree }
+        , { "parse/imports",    Shape::imports,        Mode::tree }
+        , { "parse_flat/mixed", Shape::mixed,          Mode::flat }
+        , { "packrat/mixed",    Shape::mixed,          Mode::packrat }
+    };
+
+    /*!
+     * Parses `text` once as `mode` says, returning the number of nodes if
+     * asked to `count` them. The tree is freed before this returns, which is
+     * part of what gets timed.
+     */
+    size_t parse_once(Source text, Mode mode, bool count)
+    {
+        ParserOptions opts;
+        opts.packrat = mode == Mode::packrat;
+
+        Parser parser(std::move(text), opts);
+
+        if (mode == Mode::flat)
+        {
+            const std::optional<FlatAst> flat = parser.parse_flat();
+
+            return flat ? flat->node_count() : 0;
+        }
+
+        const std::optional<AST> ast = parser.parse();
+        size_t nodes = 0;
+
+        if (ast && count)
+        {
+            ast->preorder([&nodes](const AST&, size_t) { ++nodes; });
+        }
+
+        return nodes;
+    }
+
+    /*!
+     * Parses `text` as `mode` says for at least `min_time` seconds (and at
+     * least three times), then returns how long the median run took, in
+     * seconds: the least disturbed by whatever else the machine was doing.
+     * Also says how many runs there were in `runs`, if given.
+     */
+    double median_time(const std::string& text,
+                       Mode mode,
+                       double min_time,
+                       size_t* runs = nullptr)
+    {
+        std::vector<double> times;
+        double total = 0;
+
+        while (total < min_time || times.size() < 3)
+        {
+            Source source = Source::from_buffer(text);
+
+            const Clock::time_point start = Clock::now();
+            parse_once(std::move(source), mode, false);
+            const std::chrono::duration<double> took = Clock::now() - start;
+
+            times.push_back(took.count());
+            total += took.count();
+        }
+
+        std::nth_element(
+            times.begin(),
+            times.begin() + times.size() / 2,
+            times.end()
+        );
+
+        if (runs)
+        {
+            *runs = times.size();
+        }
+
+        return times[times.size() / 2];
+    }
+
+    void run(const Benchmark& bench, const BenchOptions& opts)
+    {
+        const std::string text = generate(bench.shape, opts.bytes);
+        const size_t nodes = parse_once(
+            Source::from_buffer(text),
+            bench.mode,
+            true
+        );
+        size_t runs = 0;
+        const double median =
+            median_time(text, bench.mode, opts.min_time, &runs);
+
+        std::cout << std::left << std::setw(20) << bench.name << std::right
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(12) << median * 1e3 << " ms"
+                  << std::setw(12) << runs
+                  << std::setprecision(1)
+                  << std::setw(12) << text.size() / median / 1e6
+                  << std::setw(12) << nodes / median / 1e6
+                  << std::endl;
+    }
+
+    /*!
+     * Parsing should take time in proportion to the text however deeply it
+     * nests, so this times as much text nested ever more deeply, and fails
+     * as soon as some depth takes more than twice as long as the shallowest.
+     * A rule that parses what it nests again when it backtracks (as
+     * `dictLit` failing before `setLit`, or an assignment's pattern not
+     * being followed by `=`, once did) soon trips it, going up the depths
+     * before it gets too slow to wait for.
+     */
+    bool check_nesting(const BenchOptions& opts)
+    {
+        constexpr size_t shallow = 2;
+        constexpr size_t deepest = 64;
+        constexpr double most = 2;
+
+        const double base = median_time(
+            generate_nested(shallow, opts.bytes),
+            Mode::tree,
+            opts.min_time
+        );
+
+        for (size_t depth = 8; depth <= deepest; depth *= 2)
+        {
+            const double ratio = median_time(
+                generate_nested(depth, opts.bytes),
+                Mode::tree,
+                opts.min_time
+            ) / base;
+            const std::string name = "check/nesting/" + std::to_string(depth);
+
+            std::cout << std::left << std::setw(20) << name << std::right
+                      << std::fixed << std::setprecision(3)
+                      << std::setw(12) << ratio << " x as long as "
+                      << shallow << " deep" << std::endl;
+
+            if (ratio > most)
+            {
+                std::cout << "Nesting " << depth << " deep took over "
+                          << std::setprecision(0) << most
+                          << " x as long." << std::endl;
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*!
+     * Writes every corpus shape to `dir`, as `<shape>.bwr`.
+     */
+    int emit(const std::string& dir, const BenchOptions& opts)
+    {
+        std::filesystem::create_directories(dir);
+
+        for (const Shape shape : shapes)
+        {
+            const std::filesystem::path path =
+                std::filesystem::path(dir) /
+                (std::string(shape_name(shape)) + ".bwr");
+            std::ofstream file(path, std::ios::binary);
+
+            file << generate(shape, opts.bytes);
+
+            if (!file)
+            {
+                std::cout << "Could not write " << path << '.' << std::endl;
+
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opts;
+    std::optional<std::string> emit_dir;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        const char* const value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (arg == "--filter" && value)
+        {
+            opts.filter = value;
+            ++i;
+        }
+        else if (arg == "--min-time" && value)
+        {
+            opts.min_time = std::stod(value);
+            ++i;
+        }
+        else if (arg == "--size" && value)
+        {
+            opts.bytes = std::stoul(value) << 10;
+            ++i;
+        }
+        else if (arg == "--emit" && value)
+        {
+            emit_dir = value;
+            ++i;
+        }
+        else
+        {
+            std::cout << "Usage: brouwer_bench [--filter TEXT] "
+                         "[--min-time SECONDS] [--size KiB] [--emit DIR]"
+                      << std::endl;
+
+            return 1;
+        }
+    }
+
+    if (emit_dir)
+    {
+        return emit(*emit_dir, opts);
+    }
+
+    std::cout << std::left << std::setw(20) << "Benchmark" << std::right
+              << std::setw(15) << "Time"
+              << std::setw(12) << "Iterations"
+              << std::setw(12) << "MB/s"
+              << std::setw(12) << "Mnodes/s"
+              << '\n' << std::string(71, '-') << std::endl;
+
+    for (const Benchmark& bench : benchmarks)
+    {
+        if (std::string(bench.name).find(opts.filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        try
+        {
+            run(bench, opts);
+        }
+        catch (const std::runtime_error& re)
+        {
+            std::cout << bench.name << ": " << re.what() << std::endl;
+
+            return 1;
+        }
+    }
+
+    if (std::string("check/nesting").find(opts.filter) != std::string::npos)
+    {
+        try
+        {
+            return check_nesting(opts) ? 0 : 1;
+        }
+        catch (const std::runtime_error& re)
+        {
+            std::cout << "check/nesting: " << re.what() << std::endl;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""Runs the C++ and Rust parsers over the same scripts and compares them.
+
+For every script, both parsers' tree dumps are compared: once as raw bytes
+(the `log_depthfirst` format), and once with the Rust token names (`Root`,
+`Return`, ...) mapped onto the C++ ones (`root`, `return_`, ...), which is
+whether the trees themselves match. Scripts that both reject are compared by
+error message instead. Each parser's best wall time over `--repeat` runs,
+and its peak resident memory, are reported alongside. A child's peak counts
+the memory of the process that started it, so nothing reads as using less
+than this script does (about 13 MiB).
+
+    $ cpp/bench/parity.py cpp/_gate_build/brouwer scripts/ more.bwr
+
+Without `--rs`, the Rust parser is compiled from rs/src with plain `rustc`.
+The exit status is 1 if any trees differ. With `--require-parity`, it is also
+1 if the C++ parser is slower overall (by geometric mean) than the Rust one;
+timings are noisy, so that is left out of the default.
+"""
+
+import argparse
+import itertools
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+REPO = Path(__file__).resolve().parents[2]
+
+# Rust's `{:?}` names that aren't just the C++ name capitalized.
+RENAMED = {
+    "Return": "return_",
+    "Case": "case_",
+    "Try": "try_",
+    "While": "while_",
+    "For": "for_",
+}
+
+NODE = re.compile(rb"^( *) \xe2\x94\x94\xe2\x94\x80 (\w+)")
+
+
+def cpp_names(line):
+    """One line of a Rust tree dump, with its token named as C++ names it."""
+    m = NODE.match(line)
+
+    if not m:
+        return line
+
+    name = m.group(2).decode()
+    name = RENAMED.get(name, name[:1].lower() + name[1:])
+
+    return line[:m.start(2)] + name.encode() + line[m.end(2):]
+
+
+class Measured(subprocess.Popen):
+    """A `Popen` that keeps the peak memory of the process it reaps, which
+    `os.wait4` reports for that one child rather than for all of them."""
+
+    peak_kib = 0
+
+    def _try_wait(self, wait_flags):
+        try:
+            pid, status, usage = os.wait4(self.pid, wait_flags)
+        except ChildProcessError:
+            return self.pid, 0
+
+        if pid == self.pid:
+            self.peak_kib = usage.ru_maxrss
+
+        return pid, status
+
+
+def run(binary, script, timeout, out, err):
+    """(exit status, seconds, peak KiB) of one run, which writes to the files
+    `out` and `err`; the status is None if it ran out of time."""
+    out.seek(0)
+    out.truncate()
+    err.seek(0)
+    err.truncate()
+
+    start = time.perf_counter()
+    proc = Measured([str(binary), str(script)], stdout=out, stderr=err)
+
+    try:
+        proc.wait(timeout=timeout)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+
+        return None, timeout, proc.peak_kib
+
+    return proc.returncode, time.perf_counter() - start, proc.peak_kib
+
+
+def best_of(binary, script, args, tmp, name):
+    """Runs `binary` on `script` `--repeat` times, keeping the last run's
+    output in `tmp` as `name`.out and `name`.err."""
+    out = open(Path(tmp) / (name + ".out"), "w+b")
+    err = open(Path(tmp) / (name + ".err"), "w+b")
+    runs = [run(binary, script, args.timeout, out, err)
+            for _ in range(args.repeat)]
+
+    out.seek(0)
+    err.seek(0)
+
+    return {
+        "status": runs[-1][0],
+        "out": out,
+        "err": err,
+        "seconds": min(r[1] for r in runs),
+        "peak": max(r[2] for r in runs),
+    }
+
+
+def same_lines(a, b, rename=lambda line: line):
+    """Whether files `a` and `b` hold the same lines, once each line of `b`
+    has been passed through `rename`, without reading either in whole."""
+    a.seek(0)
+    b.seek(0)
+
+    for x, y in itertools.zip_longest(a, b):
+        if x is None or y is None or x != rename(y):
+            return False
+
+    return True
+
+
+def error_message(output):
+    """The message of an "Uh-oh:" (C++) or "Parser error:" (Rust) report:
+    the last line printed."""
+    output.seek(0)
+    last = b""
+
+    for line in output:
+        if line.strip():
+            last = line
+
+    return last.strip().decode(errors="replace")
+
+
+def compare(cpp, rs):
+    if cpp["status"] is None or rs["status"] is None:
+        return "timeout " + ("cpp" if cpp["status"] is None else "rs")
+
+    if cpp["status"] == 0 and rs["status"] == 0:
+        if same_lines(cpp["out"], rs["out"]):
+            return "same"
+
+        if same_lines(cpp["out"], rs["out"], cpp_names):
+            return "same tree"
+
+        return "TREES DIFFER"
+
+    if cpp["status"] != 0 and rs["status"] != 0:
+        if error_message(cpp["out"]) == error_message(rs["err"]):
+            return "same error"
+
+        return "errors differ"
+
+    return "only cpp parses" if cpp["status"] == 0 else "only rs parses"
+
+
+def scripts(inputs):
+    for path in map(Path, inputs):
+        if path.is_dir():
+            yield from sorted(path.rglob("*.bwr"))
+        else:
+            yield path
+
+
+def build_rs(into):
+    binary = Path(into) / "brouwer_rs"
+
+    subprocess.run(
+        ["rustc", "-O", "--cap-lints", "allow",
+         str(REPO / "rs" / "src" / "main.rs"), "-o", str(binary)],
+        check=True,
+    )
+
+    return binary
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("cpp", help="the C++ brouwer binary")
+    parser.add_argument("inputs", nargs="+", help="scripts, or directories")
+    parser.add_argument("--rs", help="the Rust binary (built if not given)")
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--timeout", type=float, default=30)
+    parser.add_argument("--require-parity", action="store_true",
+                        help="also fail if the Rust parser is faster")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        rs_binary = Path(args.rs) if args.rs else build_rs(tmp)
+
+        print("%-32s %-16s %10s %10s %7s %10s %10s" % (
+            "script", "result", "cpp ms", "rs ms", "rs/cpp", "cpp KiB",
+            "rs KiB"))
+
+        ratios = []
+        differing = 0
+
+        for script in scripts(args.inputs):
+            cpp = best_of(args.cpp, script, args, tmp, "cpp")
+            rs = best_of(rs_binary, script, args, tmp, "rs")
+            result = compare(cpp, rs)
+
+            for f in (cpp["out"], cpp["err"], rs["out"], rs["err"]):
+                f.close()
+
+            ratio = "-"
+
+            # Only scripts that both parse to the same tree are a fair race.
+            if result in ("same", "same tree"):
+                ratios.append(rs["seconds"] / max(cpp["seconds"], 1e-9))
+                ratio = "%.2f" % ratios[-1]
+
+            differing += result == "TREES DIFFER"
+
+            print("%-32s %-16s %10.2f %10.2f %7s %10d %10d" % (
+                str(script)[-32:],
+                result,
+                cpp["seconds"] * 1e3,
+                rs["seconds"] * 1e3,
+                ratio,
+                cpp["peak"],
+                rs["peak"],
+            ))
+
+    if ratios:
+        mean = math.exp(sum(map(math.log, ratios)) / len(ratios))
+        print("\nrs/cpp time over %d matching scripts: %.2fx (geometric mean)"
+              % (len(ratios), mean))
+    else:
+        mean = math.inf
+        print("\nno script parsed to the same tree in both")
+
+    if differing:
+        return 1
+
+    return 1 if args.require_parity and mean < 1 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
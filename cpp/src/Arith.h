@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace brouwer
+{
+    /*!
+     * What the arithmetic instructions compute, shared by the interpreter
+     * and the constant folder so that folding never changes a result.
+     */
+    namespace arith
+    {
+        inline int64_t add(int64_t a, int64_t b) noexcept
+        {
+            return static_cast<int64_t>(
+                static_cast<uint64_t>(a) + static_cast<uint64_t>(b)
+            );
+        }
+
+        inline int64_t sub(int64_t a, int64_t b) noexcept
+        {
+            return static_cast<int64_t>(
+                static_cast<uint64_t>(a) - static_cast<uint64_t>(b)
+            );
+        }
+
+        inline int64_t mul(int64_t a, int64_t b) noexcept
+        {
+            return static_cast<int64_t>(
+                static_cast<uint64_t>(a) * static_cast<uint64_t>(b)
+            );
+        }
+
+        /*!
+         * `b` must not be zero. The one quotient that overflows,
+         * `INT64_MIN / -1`, wraps around.
+         */
+        inline int64_t div(int64_t a, int64_t b) noexcept
+        {
+            return b == -1 ? sub(0, a) : a / b;
+        }
+
+        /*!
+         * `b` must not be zero.
+         */
+        inline int64_t mod(int64_t a, int64_t b) noexcept
+        {
+            return b == -1 ? 0 : a % b;
+        }
+
+        inline int64_t cmp(int64_t a, int64_t b) noexcept
+        {
+            return a == b ? 0 : a > b ? 1 : -1;
+        }
+
+        /*!
+         * Like the integer `cmp`, but `unordered` when either side is NaN.
+         */
+        inline int64_t cmp(double a, double b, int64_t unordered) noexcept
+        {
+            if (a < b)
+            {
+                return -1;
+            }
+
+            if (a > b)
+            {
+                return 1;
+            }
+
+            return std::isnan(a) || std::isnan(b) ? unordered : 0;
+        }
+
+        /*!
+         * Truncates like a C cast would, except that out-of-range values
+         * saturate and NaN becomes 0 instead of being undefined.
+         */
+        inline int64_t to_int(double f) noexcept
+        {
+            if (std::isnan(f))
+            {
+                return 0;
+            }
+
+            if (f >= 9223372036854775808.0)
+            {
+                return std::numeric_limits<int64_t>::max();
+            }
+
+            if (f < -9223372036854775808.0)
+            {
+                return std::numeric_limits<int64_t>::min();
+            }
+
+            return static_cast<int64_t>(f);
+        }
+    }
+}
@@ -0,0 +1,299 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+#include "Bytecode.h"
+
+namespace brouwer
+{
+    static constexpr std::string_view opcode_names[] =
+    {
+          "nop"
+        , "iconst_n1"
+        , "iconst_0"
+        , "iconst_1"
+        , "iconst_2"
+        , "iconst_3"
+        , "fconst_n1"
+        , "fconst_0"
+        , "fconst_1"
+        , "fconst_2"
+        , "fconst_3"
+        , "load_0"
+        , "load_1"
+        , "load_2"
+        , "load_3"
+        , "load"
+        , "store_0"
+        , "store_1"
+        , "store_2"
+        , "store_3"
+        , "store"
+        , "pop"
+        , "dup"
+        , "swap"
+        , "iadd"
+        , "fadd"
+        , "isub"
+        , "fsub"
+        , "imul"
+        , "fmul"
+        , "idiv"
+        , "fdiv"
+        , "imod"
+        , "fmod"
+        , "ineg"
+        , "fneg"
+        , "i2f"
+        , "f2i"
+        , "icmp"
+        , "fcmpl"
+        , "fcmpg"
+        , "ldc"
+        , "goto"
+        , "ifeq"
+        , "ifne"
+        , "iflt"
+        , "ifge"
+        , "ifgt"
+        , "ifle"
+        , "call"
+        , "ret"
+        , "iprint"
+        , "fprint"
+    };
+
+    static_assert(
+        std::size(opcode_names) == opcode_count,
+        "every opcode needs a name"
+    );
+
+    std::string_view opcode_name(Opcode op) noexcept
+    {
+        return opcode_names[static_cast<size_t>(op)];
+    }
+
+    size_t operand_size(Opcode op) noexcept
+    {
+        switch (op)
+        {
+            case Opcode::load:
+            case Opcode::store:
+                return 1;
+            case Opcode::ldc:
+            case Opcode::goto_:
+            case Opcode::ifeq:
+            case Opcode::ifne:
+            case Opcode::iflt:
+            case Opcode::ifge:
+            case Opcode::ifgt:
+            case Opcode::ifle:
+            case Opcode::call:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    std::string_view value_type_name(ValueType type) noexcept
+    {
+        switch (type)
+        {
+            case ValueType::int_:   return "Int";
+            case ValueType::float_: return "Float";
+            default:                return "Unit";
+        }
+    }
+
+    /*!
+     * Appends `op`, returning its offset.
+     */
+    size_t Chunk::emit(Opcode op)
+    {
+        this->code.push_back(static_cast<uint8_t>(op));
+
+        return this->code.size() - 1;
+    }
+
+    void Chunk::emit_u8(uint8_t byte)
+    {
+        this->code.push_back(byte);
+    }
+
+    void Chunk::emit_u16(uint16_t word)
+    {
+        this->code.push_back(static_cast<uint8_t>(word));
+        this->code.push_back(static_cast<uint8_t>(word >> 8));
+    }
+
+    void Chunk::patch_u16(size_t at, uint16_t word) noexcept
+    {
+        this->code[at] = static_cast<uint8_t>(word);
+        this->code[at + 1] = static_cast<uint8_t>(word >> 8);
+    }
+
+    uint16_t Chunk::read_u16(size_t at) const noexcept
+    {
+        return static_cast<uint16_t>(
+            this->code[at] | (this->code[at + 1] << 8)
+        );
+    }
+
+    /*!
+     * Interns `constant` into the pool, returning its index.
+     */
+    uint16_t Chunk::add_constant(Constant constant)
+    {
+        for (size_t i = 0; i < this->constants.size(); ++i)
+        {
+            const Constant& c = this->constants[i];
+
+            // Bitwise, so that -0.0 and NaNs are kept apart and matched.
+            if (
+                c.type == constant.type &&
+                std::memcmp(&c.value, &constant.value, sizeof(Value)) == 0
+            ) {
+                return static_cast<uint16_t>(i);
+            }
+        }
+
+        if (this->constants.size() > UINT16_MAX)
+        {
+            throw std::runtime_error(
+                "too many constants in function " + this->name
+            );
+        }
+
+        this->constants.push_back(constant);
+
+        return static_cast<uint16_t>(this->constants.size() - 1);
+    }
+
+    /*!
+     * Pushes `constant`, using one of the `iconst`/`fconst` short forms if
+     * there is one for it.
+     */
+    void Chunk::emit_constant(Constant constant)
+    {
+        for (int k = -1; k <= 3; ++k)
+        {
+            const uint8_t n = static_cast<uint8_t>(k + 1);
+
+            if (constant.type == ValueType::int_ && constant.value.i == k)
+            {
+                emit(static_cast<Opcode>(
+                    static_cast<uint8_t>(Opcode::iconst_n1) + n
+                ));
+
+                return;
+            }
+
+            // Bitwise, since -0.0 has no short form.
+            const double short_form = k;
+
+            if (
+                constant.type == ValueType::float_ &&
+                std::memcmp(&short_form, &constant.value.f, sizeof(double)) == 0
+            ) {
+                emit(static_cast<Opcode>(
+                    static_cast<uint8_t>(Opcode::fconst_n1) + n
+                ));
+
+                return;
+            }
+        }
+
+        emit(Opcode::ldc);
+        emit_u16(add_constant(constant));
+    }
+
+    void disassemble(const Chunk& chunk, std::ostream& out)
+    {
+        out << "fn " << chunk.name
+            << " (arity " << static_cast<unsigned>(chunk.arity)
+            << ", locals " << chunk.local_count
+            << ", stack " << chunk.max_stack
+            << ") -> " << value_type_name(chunk.return_type) << '\n';
+
+        size_t at = 0;
+
+        while (at < chunk.code.size())
+        {
+            const Opcode op = static_cast<Opcode>(chunk.code[at]);
+            const size_t next = at + 1 + operand_size(op);
+
+            out << "  " << std::setw(4) << std::setfill('0') << at
+                << std::setfill(' ') << "  " << opcode_name(op);
+
+            switch (op)
+            {
+                case Opcode::load:
+                case Opcode::store:
+                    out << ' ' << static_cast<unsigned>(chunk.code[at + 1]);
+                    break;
+                case Opcode::ldc:
+                case Opcode::call:
+                    out << " #" << chunk.read_u16(at + 1);
+                    break;
+                case Opcode::goto_:
+                case Opcode::ifeq:
+                case Opcode::ifne:
+                case Opcode::iflt:
+                case Opcode::ifge:
+                case Opcode::ifgt:
+                case Opcode::ifle:
+                {
+                    const int16_t offset =
+                        static_cast<int16_t>(chunk.read_u16(at + 1));
+
+                    out << ' ' << (offset >= 0 ? "+" : "") << offset
+                        << " (-> " << static_cast<long>(next) + offset << ')';
+
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            out << '\n';
+            at = next;
+        }
+
+        for (size_t i = 0; i < chunk.constants.size(); ++i)
+        {
+            const Constant& c = chunk.constants[i];
+
+            out << "  #" << i << " = " << value_type_name(c.type) << ' ';
+
+            if (c.type == ValueType::float_)
+            {
+                out << c.value.f;
+            }
+            else
+            {
+                out << c.value.i;
+            }
+
+            out << '\n';
+        }
+    }
+
+    void disassemble(const Program& program, std::ostream& out)
+    {
+        for (size_t i = 0; i < program.chunks.size(); ++i)
+        {
+            if (i > 0)
+            {
+                out << '\n';
+            }
+
+            out << '#' << i << ' ';
+            disassemble(program.chunks[i], out);
+        }
+    }
+}
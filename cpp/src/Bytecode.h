@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace brouwer
+{
+    /*!
+     * The instruction set of ops.md. Operands follow their opcode inline:
+     * `load`/`store` take a one-byte local index, `ldc` and `call` a
+     * two-byte pool index, and jumps a two-byte signed offset counted from
+     * the end of the instruction. Multi-byte operands are little-endian.
+     */
+    enum class Opcode : uint8_t
+    {
+          nop
+        , iconst_n1
+        , iconst_0
+        , iconst_1
+        , iconst_2
+        , iconst_3
+        , fconst_n1
+        , fconst_0
+        , fconst_1
+        , fconst_2
+        , fconst_3
+        , load_0
+        , load_1
+        , load_2
+        , load_3
+        , load
+        , store_0
+        , store_1
+        , store_2
+        , store_3
+        , store
+        , pop
+        , dup
+        , swap
+        , iadd
+        , fadd
+        , isub
+        , fsub
+        , imul
+        , fmul
+        , idiv
+        , fdiv
+        , imod
+        , fmod
+        , ineg
+        , fneg
+        , i2f
+        , f2i
+        , icmp
+        , fcmpl
+        , fcmpg
+        , ldc
+        , goto_
+        , ifeq
+        , ifne
+        , iflt
+        , ifge
+        , ifgt
+        , ifle
+        , call
+        , ret
+        , iprint
+        , fprint
+    };
+
+    constexpr size_t opcode_count = static_cast<size_t>(Opcode::fprint) + 1;
+
+    std::string_view opcode_name(Opcode op) noexcept;
+
+    /*!
+     * The number of operand bytes that follow `op`.
+     */
+    size_t operand_size(Opcode op) noexcept;
+
+    enum class ValueType : uint8_t
+    {
+          unit
+        , int_
+        , float_
+    };
+
+    std::string_view value_type_name(ValueType type) noexcept;
+
+    /*!
+     * A stack slot. Every instruction knows the type of what it operates on,
+     * so values carry no tag of their own.
+     */
+    union Value
+    {
+        int64_t i;
+
+        double f;
+    };
+
+    struct Constant
+    {
+        ValueType type;
+
+        Value value;
+    };
+
+    /*!
+     * The code of one function, along with its constant pool and what the
+     * interpreter needs to set up a frame for it. Locals `0` through
+     * `arity - 1` hold the arguments.
+     */
+    struct Chunk
+    {
+        std::string name;
+
+        uint8_t arity = 0;
+
+        uint16_t local_count = 0;
+
+        uint16_t max_stack = 0;
+
+        ValueType return_type = ValueType::unit;
+
+        std::vector<uint8_t> code;
+
+        std::vector<Constant> constants;
+
+        size_t emit(Opcode op);
+
+        void emit_u8(uint8_t byte);
+
+        void emit_u16(uint16_t word);
+
+        void patch_u16(size_t at, uint16_t word) noexcept;
+
+        uint16_t read_u16(size_t at) const noexcept;
+
+        uint16_t add_constant(Constant constant);
+
+        void emit_constant(Constant constant);
+    };
+
+    /*!
+     * A whole compiled program: chunk 0 is the top level, and `call`
+     * operands index `chunks`.
+     */
+    struct Program
+    {
+        std::vector<Chunk> chunks;
+    };
+
+    void disassemble(const Chunk& chunk, std::ostream& out);
+
+    void disassemble(const Program& program, std::ostream& out);
+}
@@ -0,0 +1,379 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Bytecode.h"
+#include "Cache.h"
+#include "FlatAst.h"
+#include "Serial.h"
+#include "Source.h"
+
+namespace brouwer
+{
+    namespace
+    {
+        constexpr char magic[4] = { 'B', 'R', 'W', 'C' };
+
+        /*!
+         * Bumped whenever the layout of an entry, or of anything stored in
+         * it (token types, opcodes, ...), changes.
+         */
+        constexpr uint32_t format_version = 2;
+
+        enum Flags : uint32_t
+        {
+              has_text    = 1 << 0
+            , has_program = 1 << 1
+        };
+
+        struct Header
+        {
+            char magic[4];
+
+            uint32_t version;
+
+            uint64_t source_hash;
+
+            uint64_t source_size;
+
+            /*!
+             * Of everything after the header.
+             */
+            uint64_t payload_hash;
+
+            uint32_t flags;
+
+            uint32_t opt_level;
+
+            uint64_t ast_offset;
+
+            uint64_t ast_size;
+
+            uint64_t text_offset;
+
+            uint64_t text_size;
+
+            uint64_t program_offset;
+
+            uint64_t program_size;
+        };
+
+        static_assert(sizeof(Header) == 88, "the header must have no padding");
+
+        void serialize(const Program& program, std::string& out)
+        {
+            serial::put(out, static_cast<uint32_t>(program.chunks.size()));
+
+            for (const Chunk& chunk : program.chunks)
+            {
+                serial::put(out, static_cast<uint32_t>(chunk.name.size()));
+                out += chunk.name;
+                serial::put(out, chunk.arity);
+                serial::put(out, static_cast<uint8_t>(chunk.return_type));
+                serial::put(out, chunk.local_count);
+                serial::put(out, chunk.max_stack);
+                serial::put(out, static_cast<uint32_t>(chunk.code.size()));
+                serial::put_column(out, chunk.code);
+                serial::put(out, static_cast<uint32_t>(chunk.constants.size()));
+
+                for (const Constant& c : chunk.constants)
+                {
+                    serial::put(out, static_cast<uint8_t>(c.type));
+                    serial::put(out, c.value.i);
+                }
+            }
+        }
+
+        bool valid_type(uint8_t type) noexcept
+        {
+            return type <= static_cast<uint8_t>(ValueType::float_);
+        }
+
+        std::optional<Program> deserialize(std::string_view bytes)
+        {
+            serial::Reader in(bytes);
+            Program program;
+            uint32_t chunk_count = 0;
+
+            if (!in.get(chunk_count))
+            {
+                return std::nullopt;
+            }
+
+            for (uint32_t i = 0; i < chunk_count; ++i)
+            {
+                Chunk& chunk = program.chunks.emplace_back();
+                uint32_t name_size = 0;
+                std::string_view name;
+                uint8_t return_type = 0;
+                uint32_t code_size = 0;
+                uint32_t constant_count = 0;
+
+                if (
+                    !in.get(name_size)                    ||
+                    !in.get_view(name, name_size)         ||
+                    !in.get(chunk.arity)                  ||
+                    !in.get(return_type)                  ||
+                    !valid_type(return_type)              ||
+                    !in.get(chunk.local_count)            ||
+                    !in.get(chunk.max_stack)              ||
+                    !in.get(code_size)                    ||
+                    !in.get_column(chunk.code, code_size) ||
+                    !in.get(constant_count)
+                ) {
+                    return std::nullopt;
+                }
+
+                chunk.name = name;
+                chunk.return_type = static_cast<ValueType>(return_type);
+
+                for (uint32_t k = 0; k < constant_count; ++k)
+                {
+                    uint8_t type = 0;
+                    Constant c = { ValueType::unit, { 0 } };
+
+                    if (!in.get(type) || !valid_type(type) || !in.get(c.value.i))
+                    {
+                        return std::nullopt;
+                    }
+
+                    c.type = static_cast<ValueType>(type);
+                    chunk.constants.push_back(c);
+                }
+            }
+
+            if (!in.done())
+            {
+                return std::nullopt;
+            }
+
+            return program;
+        }
+
+        /*!
+         * Appends `section` at the next 8-byte boundary, recording where it
+         * went.
+         */
+        void add_section(std::string& out,
+                         std::string_view section,
+                         uint64_t& offset,
+                         uint64_t& size)
+        {
+            serial::align(out, 8);
+            offset = out.size();
+            size = section.size();
+            out += section;
+        }
+
+        std::string_view section(std::string_view file,
+                                 uint64_t offset,
+                                 uint64_t size) noexcept
+        {
+            if (offset > file.size() || size > file.size() - offset)
+            {
+                return {};
+            }
+
+            return file.substr(offset, size);
+        }
+    }
+
+    namespace cache
+    {
+        uint64_t content_hash(std::string_view bytes) noexcept
+        {
+            constexpr uint64_t prime = 0x100000001b3;
+            uint64_t hash = 0xcbf29ce484222325;
+            size_t at = 0;
+
+            for (; at + sizeof(uint64_t) <= bytes.size(); at += sizeof(uint64_t))
+            {
+                uint64_t word;
+                std::memcpy(&word, bytes.data() + at, sizeof(uint64_t));
+                hash = (hash ^ word) * prime;
+            }
+
+            for (; at < bytes.size(); ++at)
+            {
+                hash = (hash ^ static_cast<uint8_t>(bytes[at])) * prime;
+            }
+
+            return hash;
+        }
+
+        std::string path_for(const std::string& source_name)
+        {
+            return source_name + "c";
+        }
+
+        std::optional<CacheEntry> load(const std::string& path,
+                                       std::shared_ptr<const Source> source,
+                                       unsigned opt_level)
+        {
+            std::shared_ptr<const Source> mapped;
+
+            try
+            {
+                mapped = std::make_shared<const Source>(Source::from_file(path));
+            }
+            catch (const std::runtime_error&)
+            {
+                return std::nullopt;
+            }
+
+            const std::string_view file = mapped->view();
+            const std::string_view text = source->view();
+            Header header;
+
+            if (file.size() < sizeof(Header))
+            {
+                return std::nullopt;
+            }
+
+            std::memcpy(&header, file.data(), sizeof(Header));
+
+            if (
+                std::memcmp(header.magic, magic, sizeof(magic)) != 0 ||
+                header.version != format_version                     ||
+                header.source_size != text.size()                    ||
+                header.payload_hash !=
+                    content_hash(file.substr(sizeof(Header)))        ||
+                header.source_hash != content_hash(text)
+            ) {
+                return std::nullopt;
+            }
+
+            std::shared_ptr<const Source> ast_text = std::move(source);
+
+            if (header.flags & has_text)
+            {
+                const std::string_view own_text = section(
+                    file,
+                    header.text_offset,
+                    header.text_size
+                );
+
+                if (own_text.size() != header.text_size)
+                {
+                    return std::nullopt;
+                }
+
+                ast_text = std::make_shared<const Source>(Source::from_buffer(
+                    std::string(own_text),
+                    "<flat ast>"
+                ));
+            }
+
+            // The arena is used where it lies, so it keeps the mapping alive.
+            std::optional<FlatAst> ast = FlatAst::deserialize(
+                section(file, header.ast_offset, header.ast_size),
+                mapped,
+                std::move(ast_text)
+            );
+
+            if (!ast)
+            {
+                return std::nullopt;
+            }
+
+            CacheEntry entry = { std::move(*ast), std::nullopt };
+
+            if ((header.flags & has_program) && header.opt_level == opt_level)
+            {
+                entry.program = deserialize(section(
+                    file,
+                    header.program_offset,
+                    header.program_size
+                ));
+            }
+
+            return entry;
+        }
+
+        bool store(const std::string& path,
+                   const Source& source,
+                   const FlatAst& ast,
+                   const Program* program,
+                   unsigned opt_level)
+        {
+            Header header = {};
+            std::memcpy(header.magic, magic, sizeof(magic));
+            header.version = format_version;
+            header.source_hash = content_hash(source.view());
+            header.source_size = source.view().size();
+            header.opt_level = opt_level;
+
+            std::string out(sizeof(Header), '\0');
+            std::string section;
+
+            ast.serialize(section);
+            add_section(out, section, header.ast_offset, header.ast_size);
+
+            if (ast.source().get() != &source)
+            {
+                header.flags |= has_text;
+                add_section(
+                    out,
+                    ast.source()->view(),
+                    header.text_offset,
+                    header.text_size
+                );
+            }
+
+            if (program)
+            {
+                section.clear();
+                serialize(*program, section);
+                header.flags |= has_program;
+                add_section(
+                    out,
+                    section,
+                    header.program_offset,
+                    header.program_size
+                );
+            }
+
+            header.payload_hash =
+                content_hash(std::string_view(out).substr(sizeof(Header)));
+            std::memcpy(out.data(), &header, sizeof(Header));
+
+            // Unique to this store, as other threads may be writing entries too.
+            static std::atomic<uint64_t> stores = 0;
+            const std::string temp = path + "." + std::to_string(getpid()) +
+                                     "." + std::to_string(stores++);
+
+            {
+                std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+
+                file.write(out.data(), static_cast<std::streamsize>(out.size()));
+                file.close();
+
+                if (!file)
+                {
+                    std::remove(temp.c_str());
+
+                    return false;
+                }
+            }
+
+            if (std::rename(temp.c_str(), path.c_str()) != 0)
+            {
+                std::remove(temp.c_str());
+
+                return false;
+            }
+
+            return true;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Bytecode.h"
+#include "FlatAst.h"
+#include "Source.h"
+
+namespace brouwer
+{
+    struct CacheEntry
+    {
+        FlatAst ast;
+
+        /*!
+         * Only present if the entry was compiled at the optimization level
+         * that it was loaded for.
+         */
+        std::optional<Program> program;
+    };
+
+    /*!
+     * An on-disk cache of parsed (and compiled) source files, so that
+     * unchanged files load without being parsed at all. An entry is one
+     * file: a fixed header naming the format version and the size and hash
+     * of the source it was made from, then 8-byte aligned sections holding
+     * the `FlatAst` columns, the AST's own text if its lexemes don't index
+     * the source, and optionally the compiled `Program`. Entries are mapped
+     * rather than read, and one that is stale, truncated or from another
+     * version simply misses.
+     */
+    namespace cache
+    {
+        /*!
+         * 64-bit FNV-1a, taken a word rather than a byte at a time (and then
+         * over the trailing bytes). Both steps are bijective, so any one
+         * changed word still changes the hash.
+         */
+        uint64_t content_hash(std::string_view bytes) noexcept;
+
+        /*!
+         * Where the entry for `source_name` lives: alongside it, with a
+         * trailing `c` (`script.bwr` -> `script.bwrc`).
+         */
+        std::string path_for(const std::string& source_name);
+
+        std::optional<CacheEntry> load(const std::string& path,
+                                       std::shared_ptr<const Source> source,
+                                       unsigned opt_level);
+
+        /*!
+         * Writes the entry for `ast`, parsed from `source`, and `program`
+         * if it was compiled, to a temporary file that then replaces `path`,
+         * so that readers never see half an entry. Returns whether it
+         * could.
+         */
+        bool store(const std::string& path,
+                   const Source& source,
+                   const FlatAst& ast,
+                   const Program* program,
+                   unsigned opt_level);
+    }
+}
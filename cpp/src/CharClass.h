@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace brouwer
+{
+    /*!
+     * A set of bytes as a 256-bit bitmap, built at compile time, so that
+     * membership is a shift and a mask.
+     */
+    class CharClass
+    {
+        public:
+            constexpr explicit CharClass(std::string_view chars) noexcept
+                : bits{}
+            {
+                for (const char c : chars)
+                {
+                    const unsigned char byte = static_cast<unsigned char>(c);
+
+                    this->bits[byte >> 6] |= uint64_t(1) << (byte & 63);
+                }
+            }
+
+            constexpr bool contains(char c) const noexcept
+            {
+                const unsigned char byte = static_cast<unsigned char>(c);
+
+                return (this->bits[byte >> 6] >> (byte & 63)) & 1;
+            }
+
+        private:
+            uint64_t bits[4];
+    };
+
+    namespace chars
+    {
+        // operator symbol = "?" | "<" | ">" | "=" | ... | ":" | ";" ;
+        constexpr CharClass operator_symbols("?<>=%\\~!@#$|&*/+^-:;");
+
+        // The characters that may follow a backslash in a character or
+        // string literal.
+        constexpr CharClass escapes("'\"tvnrb0");
+
+        constexpr CharClass chr_specials("'\\");
+
+        constexpr CharClass str_specials("\"\\");
+    }
+}
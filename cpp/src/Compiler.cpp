@@ -0,0 +1,1383 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Compiler.h"
+#include "Ir.h"
+#include "Keyword.h"
+#include "Optimizer.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    using AST = Compiler::AST;
+
+    static std::string type_error(ValueType expected, ValueType got)
+    {
+        std::string err_msg = "expected a value of type ";
+        err_msg += value_type_name(expected);
+        err_msg += ", got ";
+        err_msg += value_type_name(got);
+
+        return err_msg;
+    }
+
+    static ir::Expr leaf(ir::Op op, ValueType type)
+    {
+        return ir::Expr(ir::Node{ op, type });
+    }
+
+    static ir::Expr unary(ir::Op op, ValueType type, ir::Expr operand)
+    {
+        ir::Expr e = leaf(op, type);
+        e.add_child(std::move(operand));
+
+        return e;
+    }
+
+    static ir::Expr int_const(int64_t i)
+    {
+        ir::Node n = { ir::Op::intConst, ValueType::int_ };
+        n.value.i = i;
+
+        return ir::Expr(n);
+    }
+
+    static ir::Expr float_const(double f)
+    {
+        ir::Node n = { ir::Op::floatConst, ValueType::float_ };
+        n.value.f = f;
+
+        return ir::Expr(n);
+    }
+
+    static ir::Expr load(uint8_t slot, ValueType type)
+    {
+        ir::Node n = { ir::Op::load, type };
+        n.index = slot;
+
+        return ir::Expr(n);
+    }
+
+    static ir::Expr store(uint8_t slot, ir::Expr value)
+    {
+        ir::Node n = { ir::Op::store, ValueType::unit };
+        n.index = slot;
+
+        ir::Expr e(n);
+        e.add_child(std::move(value));
+
+        return e;
+    }
+
+    static void require_value(const ir::Expr& e, std::string_view what)
+    {
+        if (e.val().type == ValueType::unit)
+        {
+            throw std::runtime_error(std::string(what) + " has no value");
+        }
+    }
+
+    /*!
+     * Makes `e` a `to`, which only ever widens an `Int` to a `Float`.
+     */
+    static ir::Expr coerce(ir::Expr e, ValueType to)
+    {
+        const ValueType from = e.val().type;
+
+        if (from == to)
+        {
+            return e;
+        }
+
+        if (from == ValueType::int_ && to == ValueType::float_)
+        {
+            return unary(ir::Op::intToFloat, to, std::move(e));
+        }
+
+        throw std::runtime_error(type_error(to, from));
+    }
+
+    static ValueType common_type(ValueType a, ValueType b) noexcept
+    {
+        return a == ValueType::float_ || b == ValueType::float_
+            ? ValueType::float_
+            : ValueType::int_;
+    }
+
+    static int precedence(std::string_view op) noexcept
+    {
+        if (op == "*" || op == "/" || op == "%")
+        {
+            return 7;
+        }
+
+        if (op == "+" || op == "-")
+        {
+            return 6;
+        }
+
+        if (
+            op == "<"  || op == "<=" || op == ">"  || op == ">=" ||
+            op == "==" || op == "/=" || op == "!="
+        ) {
+            return 4;
+        }
+
+        return -1;
+    }
+
+    static ir::Expr binary(std::string_view op, ir::Expr lhs, ir::Expr rhs)
+    {
+        require_value(lhs, "left operand of " + std::string(op));
+        require_value(rhs, "right operand of " + std::string(op));
+
+        const ValueType type = common_type(lhs.val().type, rhs.val().type);
+        ir::Node n = { ir::Op::add, type };
+
+        if (op == "+")      { n.op = ir::Op::add; }
+        else if (op == "-") { n.op = ir::Op::sub; }
+        else if (op == "*") { n.op = ir::Op::mul; }
+        else if (op == "/") { n.op = ir::Op::div; }
+        else if (op == "%") { n.op = ir::Op::mod; }
+        else
+        {
+            n.op = ir::Op::compare;
+            n.type = ValueType::int_;
+
+            if (op == "==")      { n.cmp = ir::Cmp::eq; }
+            else if (op == "<")  { n.cmp = ir::Cmp::lt; }
+            else if (op == "<=") { n.cmp = ir::Cmp::le; }
+            else if (op == ">")  { n.cmp = ir::Cmp::gt; }
+            else if (op == ">=") { n.cmp = ir::Cmp::ge; }
+            else                 { n.cmp = ir::Cmp::ne; }
+        }
+
+        ir::Expr e(n);
+        e.add_child(coerce(std::move(lhs), type));
+        e.add_child(coerce(std::move(rhs), type));
+
+        return e;
+    }
+
+    static ir::Expr condition(ir::Expr cond)
+    {
+        if (cond.val().type != ValueType::int_)
+        {
+            throw std::runtime_error("condition must be an Int");
+        }
+
+        return cond;
+    }
+
+    /*!
+     * An `if_` whose value is that of its branches when both have one.
+     */
+    static ir::Expr make_if(ir::Expr cond,
+                            ir::Expr then,
+                            std::optional<ir::Expr> otherwise)
+    {
+        ValueType type = ValueType::unit;
+
+        if (
+            otherwise                           &&
+            then.val().type != ValueType::unit  &&
+            otherwise->val().type != ValueType::unit
+        ) {
+            type = common_type(then.val().type, otherwise->val().type);
+            then = coerce(std::move(then), type);
+            otherwise = coerce(std::move(*otherwise), type);
+        }
+
+        ir::Expr e = leaf(ir::Op::if_, type);
+        e.add_child(condition(std::move(cond)));
+        e.add_child(std::move(then));
+
+        if (otherwise)
+        {
+            e.add_child(std::move(*otherwise));
+        }
+
+        return e;
+    }
+
+    static bool is_fn_line(const AST& node) noexcept
+    {
+        return node.val().type == TokenType::line &&
+               node.child_count() == 1            &&
+               node[0].child_count() == 1         &&
+               node[0][0][0].val().type == TokenType::fnDecl;
+    }
+
+    static size_t find_child(const AST& node,
+                             TokenType type,
+                             size_t from = 0) noexcept
+    {
+        while (from < node.child_count() && node[from].val().type != type)
+        {
+            ++from;
+        }
+
+        return from;
+    }
+
+    static SymbolId symbol_of(const AST& ident)
+    {
+        if (ident.val().symbol == no_symbol)
+        {
+            throw std::logic_error("identifier without a symbol");
+        }
+
+        return ident.val().symbol;
+    }
+
+    /*!
+     * Emits the IR of one function body into its chunk, keeping track of
+     * how deep the operand stack gets.
+     */
+    class CodeGen
+    {
+        public:
+            explicit CodeGen(Chunk& target) noexcept : chunk(target) {}
+
+            void emit_body(const ir::Expr& body)
+            {
+                emit(body, true);
+
+                if (body.val().type == ValueType::unit)
+                {
+                    if (this->chunk.return_type == ValueType::float_)
+                    {
+                        emit_float(0.0);
+                    }
+                    else
+                    {
+                        emit_int(0);
+                    }
+                }
+
+                op(Opcode::ret, -1);
+            }
+
+        private:
+            Chunk& chunk;
+
+            int depth = 0;
+
+            void adjust(int effect)
+            {
+                this->depth += effect;
+
+                if (this->depth > this->chunk.max_stack)
+                {
+                    if (this->depth > UINT16_MAX)
+                    {
+                        throw std::runtime_error(
+                            "expression too deep in " + this->chunk.name
+                        );
+                    }
+
+                    this->chunk.max_stack =
+                        static_cast<uint16_t>(this->depth);
+                }
+            }
+
+            void op(Opcode o, int effect)
+            {
+                this->chunk.emit(o);
+                adjust(effect);
+            }
+
+            static Opcode offset(Opcode base, uint8_t n) noexcept
+            {
+                return static_cast<Opcode>(static_cast<uint8_t>(base) + n);
+            }
+
+            void emit_int(int64_t i)
+            {
+                Constant c = { ValueType::int_, { 0 } };
+                c.value.i = i;
+
+                this->chunk.emit_constant(c);
+                adjust(1);
+            }
+
+            void emit_float(double f)
+            {
+                Constant c = { ValueType::float_, { 0 } };
+                c.value.f = f;
+
+                this->chunk.emit_constant(c);
+                adjust(1);
+            }
+
+            void emit_local(Opcode short_form, Opcode long_form,
+                            uint32_t slot, int effect)
+            {
+                if (slot < 4)
+                {
+                    op(offset(short_form, static_cast<uint8_t>(slot)), effect);
+
+                    return;
+                }
+
+                op(long_form, effect);
+                this->chunk.emit_u8(static_cast<uint8_t>(slot));
+            }
+
+            /*!
+             * Emits a jump with a placeholder offset, returning where the
+             * offset goes so that `land` can fill it in.
+             */
+            size_t jump(Opcode o, int effect)
+            {
+                op(o, effect);
+                const size_t at = this->chunk.code.size();
+                this->chunk.emit_u16(0);
+
+                return at;
+            }
+
+            void patch(size_t at, size_t target)
+            {
+                const long delta =
+                    static_cast<long>(target) - static_cast<long>(at + 2);
+
+                if (delta < INT16_MIN || delta > INT16_MAX)
+                {
+                    throw std::runtime_error(
+                        "function " + this->chunk.name + " is too large"
+                    );
+                }
+
+                this->chunk.patch_u16(
+                    at,
+                    static_cast<uint16_t>(static_cast<int16_t>(delta))
+                );
+            }
+
+            void land(size_t at)
+            {
+                patch(at, this->chunk.code.size());
+            }
+
+            static Opcode branch_unless(ir::Cmp cmp) noexcept
+            {
+                switch (cmp)
+                {
+                    case ir::Cmp::eq: return Opcode::ifne;
+                    case ir::Cmp::ne: return Opcode::ifeq;
+                    case ir::Cmp::lt: return Opcode::ifge;
+                    case ir::Cmp::le: return Opcode::ifgt;
+                    case ir::Cmp::gt: return Opcode::ifle;
+                    default:          return Opcode::iflt;
+                }
+            }
+
+            /*!
+             * Emits `cond` so that control falls through when it holds, and
+             * records the jumps taken when it doesn't in `exits`.
+             */
+            void jump_unless(const ir::Expr& cond, std::vector<size_t>& exits)
+            {
+                const ir::Node& n = cond.val();
+
+                if (n.op != ir::Op::compare)
+                {
+                    emit(cond, true);
+                    exits.push_back(jump(Opcode::ifeq, -1));
+
+                    return;
+                }
+
+                emit(cond[0], true);
+                emit(cond[1], true);
+
+                if (cond[0].val().type == ValueType::float_)
+                {
+                    // NaN has to make every comparison but `!=` false.
+                    const bool below = n.cmp == ir::Cmp::lt ||
+                                       n.cmp == ir::Cmp::le;
+
+                    op(below ? Opcode::fcmpg : Opcode::fcmpl, -1);
+                }
+                else
+                {
+                    op(Opcode::icmp, -1);
+                }
+
+                exits.push_back(jump(branch_unless(n.cmp), -1));
+            }
+
+            static Opcode arithmetic(ir::Op o, ValueType type) noexcept
+            {
+                const bool f = type == ValueType::float_;
+
+                switch (o)
+                {
+                    case ir::Op::add: return f ? Opcode::fadd : Opcode::iadd;
+                    case ir::Op::sub: return f ? Opcode::fsub : Opcode::isub;
+                    case ir::Op::mul: return f ? Opcode::fmul : Opcode::imul;
+                    case ir::Op::div: return f ? Opcode::fdiv : Opcode::idiv;
+                    default:          return f ? Opcode::fmod : Opcode::imod;
+                }
+            }
+
+            /*!
+             * Emits `e`, leaving its value on the stack if `keep` is set and
+             * it has one, and nothing otherwise.
+             */
+            void emit(const ir::Expr& e, bool keep)
+            {
+                const ir::Node& n = e.val();
+
+                switch (n.op)
+                {
+                    case ir::Op::intConst:
+                        if (keep)
+                        {
+                            emit_int(n.value.i);
+                        }
+
+                        return;
+                    case ir::Op::floatConst:
+                        if (keep)
+                        {
+                            emit_float(n.value.f);
+                        }
+
+                        return;
+                    case ir::Op::load:
+                        if (keep)
+                        {
+                            emit_local(Opcode::load_0, Opcode::load, n.index, 1);
+                        }
+
+                        return;
+                    case ir::Op::store:
+                        emit(e[0], true);
+                        emit_local(Opcode::store_0, Opcode::store, n.index, -1);
+
+                        return;
+                    case ir::Op::add:
+                    case ir::Op::sub:
+                    case ir::Op::mul:
+                    case ir::Op::div:
+                    case ir::Op::mod:
+                        emit(e[0], true);
+                        emit(e[1], true);
+                        op(arithmetic(n.op, n.type), -1);
+
+                        break;
+                    case ir::Op::neg:
+                        emit(e[0], true);
+                        op(n.type == ValueType::float_ ? Opcode::fneg
+                                                       : Opcode::ineg, 0);
+
+                        break;
+                    case ir::Op::intToFloat:
+                        emit(e[0], true);
+                        op(Opcode::i2f, 0);
+
+                        break;
+                    case ir::Op::floatToInt:
+                        emit(e[0], true);
+                        op(Opcode::f2i, 0);
+
+                        break;
+                    case ir::Op::compare:
+                    {
+                        std::vector<size_t> exits;
+                        jump_unless(e, exits);
+                        emit_int(1);
+                        const size_t end = jump(Opcode::goto_, 0);
+
+                        for (const size_t at : exits)
+                        {
+                            land(at);
+                        }
+
+                        adjust(-1);
+                        emit_int(0);
+                        land(end);
+
+                        break;
+                    }
+                    case ir::Op::call:
+                    {
+                        const size_t argc = e.child_count();
+
+                        for (size_t i = 0; i < argc; ++i)
+                        {
+                            emit(e[i], true);
+                        }
+
+                        op(Opcode::call, 1 - static_cast<int>(argc));
+                        this->chunk.emit_u16(static_cast<uint16_t>(n.index));
+
+                        // Unit functions still return a placeholder.
+                        if (n.type == ValueType::unit)
+                        {
+                            op(Opcode::pop, -1);
+
+                            return;
+                        }
+
+                        break;
+                    }
+                    case ir::Op::print:
+                        emit(e[0], true);
+                        op(e[0].val().type == ValueType::float_
+                               ? Opcode::fprint
+                               : Opcode::iprint,
+                           -1);
+
+                        return;
+                    case ir::Op::return_:
+                        emit(e[0], true);
+                        op(Opcode::ret, -1);
+
+                        return;
+                    case ir::Op::if_:
+                    {
+                        const bool value = keep && n.type != ValueType::unit;
+                        std::vector<size_t> exits;
+
+                        jump_unless(e[0], exits);
+                        emit(e[1], value);
+
+                        if (e.child_count() < 3)
+                        {
+                            for (const size_t at : exits)
+                            {
+                                land(at);
+                            }
+
+                            return;
+                        }
+
+                        const size_t end = jump(Opcode::goto_, 0);
+
+                        for (const size_t at : exits)
+                        {
+                            land(at);
+                        }
+
+                        if (value)
+                        {
+                            adjust(-1);
+                        }
+
+                        emit(e[2], value);
+                        land(end);
+
+                        return;
+                    }
+                    case ir::Op::while_:
+                    {
+                        const size_t top = this->chunk.code.size();
+                        std::vector<size_t> exits;
+
+                        jump_unless(e[0], exits);
+                        emit(e[1], false);
+                        patch(jump(Opcode::goto_, 0), top);
+
+                        for (const size_t at : exits)
+                        {
+                            land(at);
+                        }
+
+                        return;
+                    }
+                    case ir::Op::seq:
+                    {
+                        const bool value = keep && n.type != ValueType::unit;
+                        const size_t count = e.child_count();
+
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            emit(e[i], value && i + 1 == count);
+                        }
+
+                        return;
+                    }
+                }
+
+                if (!keep)
+                {
+                    op(Opcode::pop, -1);
+                }
+            }
+    };
+
+    Compiler::Compiler(CompilerOptions opts) noexcept : options(opts) {}
+
+    Program Compiler::compile(const AST& root)
+    {
+        const AST& prog =
+            root.val().type == TokenType::root ? root[0] : root;
+
+        this->functions.clear();
+        this->function_ids.clear();
+
+        declare_functions(prog);
+
+        Program program;
+        program.chunks.resize(this->functions.size() + 1);
+
+        enter_function(ValueType::unit, true);
+
+        // The top level's value is never used, hence the `unit` type.
+        ir::Expr main = leaf(ir::Op::seq, ValueType::unit);
+
+        for (size_t i = 0; i < prog.child_count(); ++i)
+        {
+            const AST& item = prog[i];
+
+            if (
+                item.val().type == TokenType::line &&
+                item.child_count() > 0             &&
+                !is_fn_line(item)
+            ) {
+                main.add_child(lower_expr(item[0]));
+            }
+        }
+
+        Chunk& main_chunk = program.chunks[0];
+        main_chunk.name = "<main>";
+        main_chunk.local_count = this->slot_count;
+
+        generate(main_chunk, main);
+
+        for (size_t f = 0; f < this->functions.size(); ++f)
+        {
+            const Function& fn = this->functions[f];
+            Chunk& chunk = program.chunks[f + 1];
+
+            enter_function(fn.return_type, false);
+
+            for (size_t p = 0; p < fn.params.size(); ++p)
+            {
+                declare_local(fn.params[p], fn.param_types[p]);
+            }
+
+            ir::Expr body = lower_lines(*fn.decl, fn.first_line, SIZE_MAX);
+
+            if (body.val().type != ValueType::unit)
+            {
+                body = coerce(std::move(body), fn.return_type);
+            }
+
+            chunk.name = std::string((*fn.decl)[1].val().lexeme);
+            chunk.arity = static_cast<uint8_t>(fn.params.size());
+            chunk.local_count = this->slot_count;
+            chunk.return_type = fn.return_type;
+
+            generate(chunk, body);
+        }
+
+        return program;
+    }
+
+    void Compiler::generate(Chunk& chunk, const ir::Expr& body) const
+    {
+        if (this->options.opt_level >= 1)
+        {
+            CodeGen(chunk).emit_body(opt::fold(body));
+        }
+        else
+        {
+            CodeGen(chunk).emit_body(body);
+        }
+
+        if (this->options.opt_level >= 2)
+        {
+            opt::peephole(chunk);
+        }
+    }
+
+    /*!
+     * Registers every top-level `fn` up front, so that functions can call
+     * each other (and themselves) regardless of declaration order.
+     */
+    void Compiler::declare_functions(const AST& prog)
+    {
+        for (size_t i = 0; i < prog.child_count(); ++i)
+        {
+            if (!is_fn_line(prog[i]))
+            {
+                continue;
+            }
+
+            const AST& decl = prog[i][0][0][0];
+            const AST& name = decl[1];
+            Function fn = { &decl, {}, {}, ValueType::int_, 2 };
+
+            while (
+                fn.first_line < decl.child_count() &&
+                decl[fn.first_line].val().type == TokenType::param
+            ) {
+                const AST& param = decl[fn.first_line];
+                const size_t pattern = find_child(param, TokenType::pattern);
+                const size_t type = find_child(param, TokenType::typeIdent);
+
+                fn.params.push_back(symbol_of(pattern_ident(param[pattern])));
+                fn.param_types.push_back(
+                    type < param.child_count() ? type_named(param[type])
+                                               : ValueType::int_
+                );
+
+                ++fn.first_line;
+            }
+
+            if (
+                fn.first_line < decl.child_count() &&
+                decl[fn.first_line].val().type == TokenType::rArrow
+            ) {
+                fn.return_type = type_named(decl[fn.first_line + 1]);
+                fn.first_line += 2;
+            }
+
+            if (fn.params.size() > UINT8_MAX)
+            {
+                throw std::runtime_error(
+                    "too many parameters for " + std::string(name.val().lexeme)
+                );
+            }
+
+            const auto inserted = this->function_ids.emplace(
+                symbol_of(name),
+                static_cast<uint32_t>(this->functions.size() + 1)
+            );
+
+            if (!inserted.second)
+            {
+                throw std::runtime_error(
+                    "function " + std::string(name.val().lexeme) +
+                        " is declared more than once"
+                );
+            }
+
+            this->functions.push_back(std::move(fn));
+        }
+    }
+
+    void Compiler::enter_function(ValueType ret, bool is_top_level) noexcept
+    {
+        this->locals.clear();
+        this->slot_count = 0;
+        this->return_type = ret;
+        this->top_level = is_top_level;
+    }
+
+    uint8_t Compiler::allocate_slot()
+    {
+        if (this->slot_count > UINT8_MAX)
+        {
+            throw std::runtime_error("too many local variables");
+        }
+
+        return static_cast<uint8_t>(this->slot_count++);
+    }
+
+    Compiler::Local Compiler::declare_local(SymbolId name, ValueType type)
+    {
+        const Local local = { allocate_slot(), type };
+        this->locals[name] = local;
+
+        return local;
+    }
+
+    /*!
+     * The `line`s among the children of `parent` in `[first, last)`, as a
+     * `seq` with the value of the last one.
+     */
+    ir::Expr Compiler::lower_lines(const AST& parent, size_t first, size_t last)
+    {
+        std::vector<ir::Expr> items;
+
+        for (size_t i = first; i < parent.child_count() && i < last; ++i)
+        {
+            const AST& line = parent[i];
+
+            if (line.val().type == TokenType::line && line.child_count() > 0)
+            {
+                items.push_back(lower_expr(line[0]));
+            }
+        }
+
+        ir::Expr seq = leaf(
+            ir::Op::seq,
+            items.empty() ? ValueType::unit : items.back().val().type
+        );
+        seq.reserve(items.size());
+
+        for (ir::Expr& item : items)
+        {
+            seq.add_child(std::move(item));
+        }
+
+        return seq;
+    }
+
+    /*!
+     * An `expr` is a flat run of subexpressions; operands that sit next to
+     * each other are function application, and what separates them are
+     * binary operators, parsed here by precedence climbing.
+     */
+    ir::Expr Compiler::lower_expr(const AST& expr)
+    {
+        std::vector<Item> items;
+        items.reserve(expr.child_count());
+
+        for (size_t i = 0; i < expr.child_count(); ++i)
+        {
+            const AST& node = expr[i][0];
+            const TokenType type = node.val().type;
+
+            if (type == TokenType::op)
+            {
+                items.push_back({ &node, node.val().lexeme, false });
+
+                continue;
+            }
+
+            // `x - 1` parses as `x` followed by the literal `-1`.
+            if (
+                type == TokenType::numLit        &&
+                !items.empty()                   &&
+                items.back().op.empty()          &&
+                node[0][0].val().type == TokenType::minus
+            ) {
+                items.push_back({ &node, node[0][0].val().lexeme, false });
+                items.push_back({ &node, {}, true });
+
+                continue;
+            }
+
+            items.push_back({ &node, {}, false });
+        }
+
+        size_t i = 0;
+        ir::Expr e = lower_binary(items, i, 0);
+
+        if (i < items.size())
+        {
+            throw std::runtime_error(
+                "unexpected operator: " + std::string(items[i].op)
+            );
+        }
+
+        return e;
+    }
+
+    ir::Expr Compiler::lower_binary(const std::vector<Item>& items,
+                                    size_t& i,
+                                    int min_precedence)
+    {
+        ir::Expr lhs = lower_operand(items, i);
+
+        while (i < items.size())
+        {
+            const std::string_view op = items[i].op;
+            const int prec = precedence(op);
+
+            if (prec < 0)
+            {
+                throw std::runtime_error(
+                    "unsupported operator: " + std::string(op)
+                );
+            }
+
+            if (prec < min_precedence)
+            {
+                break;
+            }
+
+            ++i;
+
+            ir::Expr rhs = lower_binary(items, i, prec + 1);
+            lhs = binary(op, std::move(lhs), std::move(rhs));
+        }
+
+        return lhs;
+    }
+
+    ir::Expr Compiler::lower_operand(const std::vector<Item>& items, size_t& i)
+    {
+        if (i >= items.size())
+        {
+            throw std::runtime_error("expected an operand");
+        }
+
+        if (!items[i].op.empty())
+        {
+            if (items[i].op != "-")
+            {
+                throw std::runtime_error(
+                    "unexpected operator: " + std::string(items[i].op)
+                );
+            }
+
+            ++i;
+
+            ir::Expr operand = lower_operand(items, i);
+            require_value(operand, "operand of unary -");
+
+            const ValueType type = operand.val().type;
+
+            return unary(ir::Op::neg, type, std::move(operand));
+        }
+
+        size_t end = i;
+
+        while (end < items.size() && items[end].op.empty())
+        {
+            ++end;
+        }
+
+        const Item& head = items[i];
+
+        if (end - i == 1)
+        {
+            i = end;
+
+            return lower_atom(*head.node, head.unsigned_literal);
+        }
+
+        std::vector<ir::Expr> args;
+
+        for (size_t k = i + 1; k < end; ++k)
+        {
+            args.push_back(
+                lower_atom(*items[k].node, items[k].unsigned_literal)
+            );
+        }
+
+        i = end;
+
+        return lower_call(*head.node, std::move(args));
+    }
+
+    ir::Expr Compiler::lower_call(const AST& callee, std::vector<ir::Expr> args)
+    {
+        if (
+            callee.val().type != TokenType::qualIdent ||
+            callee[0].val().type != TokenType::ident
+        ) {
+            throw std::runtime_error("only named functions can be called");
+        }
+
+        const AST& name = callee[0];
+        const std::string_view lexeme = name.val().lexeme;
+        const auto fn_id = this->function_ids.find(symbol_of(name));
+
+        if (fn_id == this->function_ids.end())
+        {
+            if (lexeme == "print")
+            {
+                if (args.size() != 1)
+                {
+                    throw std::runtime_error("print takes one argument");
+                }
+
+                require_value(args[0], "argument of print");
+
+                return unary(ir::Op::print, ValueType::unit, std::move(args[0]));
+            }
+
+            throw std::runtime_error(
+                "unknown function: " + std::string(lexeme)
+            );
+        }
+
+        const Function& fn = this->functions[fn_id->second - 1];
+
+        if (args.size() != fn.params.size())
+        {
+            throw std::runtime_error(
+                std::string(lexeme) + " takes " +
+                    std::to_string(fn.params.size()) + " argument(s), got " +
+                    std::to_string(args.size())
+            );
+        }
+
+        ir::Node n = { ir::Op::call, fn.return_type };
+        n.index = fn_id->second;
+
+        ir::Expr call(n);
+        call.reserve(args.size());
+
+        for (size_t k = 0; k < args.size(); ++k)
+        {
+            require_value(args[k], "argument of " + std::string(lexeme));
+            call.add_child(coerce(std::move(args[k]), fn.param_types[k]));
+        }
+
+        return call;
+    }
+
+    ir::Expr Compiler::lower_atom(const AST& node, bool unsigned_literal)
+    {
+        switch (node.val().type)
+        {
+            case TokenType::numLit:
+                return lower_numLit(node, unsigned_literal);
+            case TokenType::qualIdent:
+                return lower_qualIdent(node);
+            case TokenType::parened:
+                return lower_expr(node[1]);
+            case TokenType::assign:
+                return lower_assign(node);
+            case TokenType::var:
+                return lower_var(node);
+            case TokenType::ifElse:
+                return lower_ifElse(node);
+            case TokenType::while_:
+                return lower_while(node);
+            case TokenType::case_:
+                return lower_case(node);
+            case TokenType::return_:
+                return lower_return(node);
+            case TokenType::fnDecl:
+                throw std::runtime_error(
+                    "functions can only be declared at the top level"
+                );
+            default:
+                throw std::runtime_error(
+                    "cannot compile " +
+                        std::string(token_type_name(node.val().type)) + " yet"
+                );
+        }
+    }
+
+    /*!
+     * The parser has already converted the literal, sign and all; when the
+     * caller applies the sign itself, only the magnitude is wanted.
+     */
+    ir::Expr Compiler::lower_numLit(const AST& num_lit, bool unsigned_literal)
+    {
+        const AST& lit = num_lit[0];
+        const LiteralValue value = lit.val().value;
+        const bool has_minus = lit[0].val().type == TokenType::minus;
+
+        if (lit.val().type == TokenType::intLit)
+        {
+            if (!unsigned_literal || !has_minus)
+            {
+                return int_const(value.integer);
+            }
+
+            if (value.integer == INT64_MIN)
+            {
+                throw std::runtime_error(
+                    "integer literal out of range: " +
+                        std::string(lit[1].val().lexeme)
+                );
+            }
+
+            return int_const(-value.integer);
+        }
+
+        return float_const(
+            unsigned_literal ? std::fabs(value.real) : value.real
+        );
+    }
+
+    ir::Expr Compiler::lower_qualIdent(const AST& qual_ident)
+    {
+        const AST& name = qual_ident[0];
+
+        if (name.val().type != TokenType::ident)
+        {
+            throw std::runtime_error("qualified names are not supported yet");
+        }
+
+        // Unsigned `NaN` and `Infinity` reach here rather than `numLit`,
+        // since `qualIdent` is tried first.
+        switch (classify_word(name.val().lexeme))
+        {
+            case TokenType::nanKeyword:
+                return float_const(std::numeric_limits<double>::quiet_NaN());
+            case TokenType::infinityKeyword:
+                return float_const(std::numeric_limits<double>::infinity());
+            default:
+                break;
+        }
+
+        const SymbolId sym = symbol_of(name);
+        const auto local = this->locals.find(sym);
+
+        if (local != this->locals.end())
+        {
+            return load(local->second.slot, local->second.type);
+        }
+
+        if (this->function_ids.count(sym) != 0)
+        {
+            return lower_call(qual_ident, {});
+        }
+
+        throw std::runtime_error(
+            "unknown identifier: " + std::string(name.val().lexeme)
+        );
+    }
+
+    ir::Expr Compiler::lower_assign(const AST& assign)
+    {
+        return lower_store(assign[0], lower_expr(assign[2]), nullptr);
+    }
+
+    ir::Expr Compiler::lower_var(const AST& var)
+    {
+        const AST* declared_type = nullptr;
+
+        if (var[2].val().type == TokenType::colon)
+        {
+            declared_type = &var[3];
+        }
+
+        return lower_store(
+            var[1],
+            lower_expr(var[var.child_count() - 1]),
+            declared_type
+        );
+    }
+
+    ir::Expr Compiler::lower_ifElse(const AST& if_else)
+    {
+        const size_t else_at = find_child(if_else, TokenType::elseKeyword);
+        ir::Expr cond = lower_expr(if_else[1]);
+        ir::Expr then = lower_lines(if_else, 2, else_at);
+        std::optional<ir::Expr> otherwise;
+
+        if (else_at < if_else.child_count())
+        {
+            const AST& next = if_else[else_at + 1];
+
+            if (next.val().type == TokenType::ifElse)
+            {
+                otherwise = lower_ifElse(next);
+            }
+            else
+            {
+                otherwise = lower_lines(if_else, else_at + 1, SIZE_MAX);
+            }
+        }
+
+        return make_if(std::move(cond), std::move(then), std::move(otherwise));
+    }
+
+    ir::Expr Compiler::lower_while(const AST& while_)
+    {
+        ir::Expr e = leaf(ir::Op::while_, ValueType::unit);
+        e.add_child(condition(lower_expr(while_[1])));
+        e.add_child(lower_lines(while_, 2, SIZE_MAX));
+
+        return e;
+    }
+
+    /*!
+     * Matches the scrutinee, kept in a slot of its own, against each branch
+     * in turn: literals become an `if_` chain, and a binding or `_` ends it.
+     */
+    ir::Expr Compiler::lower_case(const AST& case_)
+    {
+        ir::Expr scrutinee = lower_expr(case_[1]);
+        require_value(scrutinee, "case scrutinee");
+
+        const ValueType type = scrutinee.val().type;
+        const uint8_t temp = allocate_slot();
+
+        std::vector<std::optional<ir::Expr>> tests;
+        std::vector<ir::Expr> bodies;
+
+        for (size_t b = 2; b < case_.child_count(); ++b)
+        {
+            const AST& branch = case_[b];
+            const AST& pattern = branch[0][0];
+            std::optional<ir::Expr> test;
+            std::optional<ir::Expr> binding;
+
+            switch (pattern.val().type)
+            {
+                case TokenType::numLit:
+                    test = binary(
+                        "==",
+                        load(temp, type),
+                        lower_numLit(pattern, false)
+                    );
+                    break;
+                case TokenType::ident:
+                {
+                    const Local local = declare_local(symbol_of(pattern), type);
+                    binding = store(local.slot, load(temp, type));
+                    break;
+                }
+                case TokenType::underscore:
+                    break;
+                default:
+                    throw std::runtime_error(
+                        "only literal, variable and _ patterns are supported"
+                    );
+            }
+
+            ir::Expr body = lower_lines(branch, 2, SIZE_MAX);
+
+            if (binding)
+            {
+                ir::Expr seq = leaf(ir::Op::seq, body.val().type);
+                seq.add_child(std::move(*binding));
+                seq.add_child(std::move(body));
+                body = std::move(seq);
+            }
+
+            tests.push_back(std::move(test));
+            bodies.push_back(std::move(body));
+        }
+
+        if (bodies.empty())
+        {
+            throw std::runtime_error("case without any branches");
+        }
+
+        // Folded from the back; anything after an irrefutable branch is
+        // unreachable and gets dropped.
+        std::optional<ir::Expr> chain;
+
+        for (size_t b = bodies.size(); b-- > 0;)
+        {
+            if (!tests[b])
+            {
+                chain = std::move(bodies[b]);
+            }
+            else
+            {
+                chain = make_if(
+                    std::move(*tests[b]),
+                    std::move(bodies[b]),
+                    std::move(chain)
+                );
+            }
+        }
+
+        ir::Expr e = leaf(ir::Op::seq, chain->val().type);
+        e.add_child(store(temp, std::move(scrutinee)));
+        e.add_child(std::move(*chain));
+
+        return e;
+    }
+
+    ir::Expr Compiler::lower_return(const AST& return_)
+    {
+        if (this->top_level)
+        {
+            throw std::runtime_error("return outside of a function");
+        }
+
+        ir::Expr value = lower_expr(return_[1]);
+        require_value(value, "returned expression");
+
+        return unary(
+            ir::Op::return_,
+            ValueType::unit,
+            coerce(std::move(value), this->return_type)
+        );
+    }
+
+    ir::Expr Compiler::lower_store(const AST& pattern,
+                                   ir::Expr value,
+                                   const AST* declared_type)
+    {
+        const AST& ident = pattern_ident(pattern);
+        const SymbolId sym = symbol_of(ident);
+
+        require_value(value, "value assigned to " + std::string(
+            ident.val().lexeme
+        ));
+
+        if (declared_type)
+        {
+            value = coerce(std::move(value), type_named(*declared_type));
+        }
+
+        const auto local = this->locals.find(sym);
+
+        if (local != this->locals.end())
+        {
+            if (declared_type && value.val().type != local->second.type)
+            {
+                throw std::runtime_error(
+                    std::string(ident.val().lexeme) + " is already declared "
+                        "as " + std::string(value_type_name(local->second.type))
+                );
+            }
+
+            return store(
+                local->second.slot,
+                coerce(std::move(value), local->second.type)
+            );
+        }
+
+        const Local fresh = declare_local(sym, value.val().type);
+
+        return store(fresh.slot, std::move(value));
+    }
+
+    const AST& Compiler::pattern_ident(const AST& pattern)
+    {
+        if (
+            pattern.child_count() != 1 ||
+            pattern[0].val().type != TokenType::ident
+        ) {
+            throw std::runtime_error(
+                "only plain variable patterns are supported here"
+            );
+        }
+
+        return pattern[0];
+    }
+
+    /*!
+     * The `ValueType` named by a type annotation.
+     */
+    ValueType Compiler::type_named(const AST& type)
+    {
+        const AST* node = &type;
+
+        while (
+            node->val().type != TokenType::ident &&
+            node->child_count() == 1
+        ) {
+            node = &(*node)[0];
+        }
+
+        if (node->val().type == TokenType::ident)
+        {
+            const std::string_view name = node->val().lexeme;
+
+            if (name == "Int")
+            {
+                return ValueType::int_;
+            }
+
+            if (name == "Float")
+            {
+                return ValueType::float_;
+            }
+
+            throw std::runtime_error("unsupported type: " + std::string(name));
+        }
+
+        throw std::runtime_error("only Int and Float types are supported");
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Ir.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    struct CompilerOptions
+    {
+        /*!
+         * `0` emits the IR as lowered, `1` folds constant expressions first
+         * (see `opt::fold`), and `2` also runs `opt::peephole` over every
+         * chunk.
+         */
+        unsigned opt_level = 2;
+    };
+
+    /*!
+     * Compiles a parsed program into `Program` bytecode. The tree is first
+     * lowered into typed IR (see Ir.h), resolving names and inserting
+     * conversions, and the IR is then emitted one chunk per function.
+     *
+     * Only the numeric core of the language is supported so far: `Int` and
+     * `Float` values, arithmetic and comparisons, variables, `if`/`else`,
+     * `while`, `case` over literals and bindings, top-level `fn`s, and the
+     * `print` builtin. Parameters and return types are `Int` unless
+     * annotated. Anything else is reported as a `std::runtime_error`.
+     */
+    class Compiler
+    {
+        public:
+            using AST = Tree<Token>;
+
+            explicit Compiler(CompilerOptions opts = {}) noexcept;
+
+            Program compile(const AST& root);
+
+        private:
+            struct Function
+            {
+                const AST* decl;
+
+                std::vector<SymbolId> params;
+
+                std::vector<ValueType> param_types;
+
+                ValueType return_type;
+
+                size_t first_line;
+            };
+
+            struct Local
+            {
+                uint8_t slot;
+
+                ValueType type;
+            };
+
+            /*!
+             * An operand or operator of an `expr`, as the subexpressions are
+             * split up for precedence parsing.
+             */
+            struct Item
+            {
+                const AST* node;
+
+                std::string_view op;
+
+                bool unsigned_literal;
+            };
+
+            CompilerOptions options;
+
+            std::vector<Function> functions;
+
+            std::unordered_map<SymbolId, uint32_t> function_ids;
+
+            std::unordered_map<SymbolId, Local> locals;
+
+            uint16_t slot_count;
+
+            ValueType return_type;
+
+            bool top_level;
+
+            void declare_functions(const AST& prog);
+
+            void generate(Chunk& chunk, const ir::Expr& body) const;
+
+            void enter_function(ValueType ret, bool is_top_level) noexcept;
+
+            uint8_t allocate_slot();
+
+            Local declare_local(SymbolId name, ValueType type);
+
+            ir::Expr lower_lines(const AST& parent, size_t first, size_t last);
+
+            ir::Expr lower_expr(const AST& expr);
+
+            ir::Expr lower_binary(const std::vector<Item>& items,
+                                  size_t& i,
+                                  int min_precedence);
+
+            ir::Expr lower_operand(const std::vector<Item>& items, size_t& i);
+
+            ir::Expr lower_call(const AST& callee,
+                                std::vector<ir::Expr> args);
+
+            ir::Expr lower_atom(const AST& node, bool unsigned_literal);
+
+            ir::Expr lower_numLit(const AST& num_lit, bool unsigned_literal);
+
+            ir::Expr lower_qualIdent(const AST& qual_ident);
+
+            ir::Expr lower_assign(const AST& assign);
+
+            ir::Expr lower_var(const AST& var);
+
+            ir::Expr lower_ifElse(const AST& if_else);
+
+            ir::Expr lower_while(const AST& while_);
+
+            ir::Expr lower_case(const AST& case_);
+
+            ir::Expr lower_return(const AST& return_);
+
+            ir::Expr lower_store(const AST& pattern,
+                                 ir::Expr value,
+                                 const AST* declared_type);
+
+            static const AST& pattern_ident(const AST& pattern);
+
+            static ValueType type_named(const AST& type);
+    };
+}
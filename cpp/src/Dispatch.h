@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "CharClass.h"
+#include "Token.h"
+
+namespace brouwer
+{
+    /*!
+     * FIRST sets of the `subexpression` alternatives of brouwer.ebnf, i.e. the
+     * bytes that each of those rules can possibly start with. Everything here
+     * is evaluated at compile time.
+     */
+    namespace first
+    {
+        // letter = "A" | ... | "Z" | "a" | ... | "z" ;
+        constexpr bool is_letter(unsigned char c) noexcept
+        {
+            return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+        }
+
+        // digit = "0" | ... | "9" ;
+        constexpr bool is_digit(unsigned char c) noexcept
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        constexpr bool is_operator_symbol(unsigned char c) noexcept
+        {
+            return chars::operator_symbols.contains(static_cast<char>(c));
+        }
+
+        // identifier = letter | ( letter | "_" ), ... ;
+        constexpr bool identifier(unsigned char c) noexcept
+        {
+            return is_letter(c) || c == '_';
+        }
+
+        // real literal | integer literal, both optionally signed, plus the
+        // "NaN" and "Infinity" keywords.
+        constexpr bool numeric_literal(unsigned char c) noexcept
+        {
+            return c == '-' || is_digit(c) || c == 'N' || c == 'I';
+        }
+
+        // pattern = identifier | character literal | string literal
+        //         | numeric literal | "_" | "(" ... | "[" ... | "{" ... ;
+        constexpr bool pattern(unsigned char c) noexcept
+        {
+            return identifier(c)         ||
+                   c == '\''             ||
+                   c == '"'              ||
+                   numeric_literal(c)    ||
+                   c == '('              ||
+                   c == '['              ||
+                   c == '{';
+        }
+
+        /*!
+         * The keyword that `rule` has to start with when its lookahead is a
+         * word, or `TokenType::ident` for rules that may start with any word.
+         */
+        constexpr TokenType leading_keyword(TokenType rule) noexcept
+        {
+            switch (rule)
+            {
+                case TokenType::var:     return TokenType::varKeyword;
+                case TokenType::fnDecl:  return TokenType::fnKeyword;
+                case TokenType::return_: return TokenType::returnKeyword;
+                case TokenType::case_:   return TokenType::caseKeyword;
+                case TokenType::ifElse:  return TokenType::ifKeyword;
+                case TokenType::try_:    return TokenType::tryKeyword;
+                case TokenType::while_:  return TokenType::whileKeyword;
+                case TokenType::for_:    return TokenType::forKeyword;
+                default:                 return TokenType::ident;
+            }
+        }
+
+        constexpr bool subexpression(TokenType rule, unsigned char c) noexcept
+        {
+            switch (rule)
+            {
+                case TokenType::var:       return c == 'v';
+                case TokenType::assign:    return pattern(c);
+                case TokenType::fnDecl:    return c == 'f';
+                case TokenType::parened:   return c == '(';
+                case TokenType::return_:   return c == 'r';
+                case TokenType::case_:     return c == 'c';
+                case TokenType::ifElse:    return c == 'i';
+                case TokenType::try_:      return c == 't';
+                case TokenType::while_:    return c == 'w';
+                case TokenType::for_:      return c == 'f';
+                case TokenType::lambda:    return c == '\\';
+                case TokenType::tupleLit:  return c == '(';
+                case TokenType::listLit:   return c == '[';
+                case TokenType::listComp:  return c == '[';
+                case TokenType::dictLit:   return c == '{';
+                case TokenType::dictComp:  return c == '{';
+                case TokenType::setLit:    return c == '{';
+                case TokenType::setComp:   return c == '{';
+                case TokenType::qualIdent: return identifier(c);
+                case TokenType::infixed:   return c == '`';
+                case TokenType::numLit:    return numeric_literal(c);
+                case TokenType::chrLit:    return c == '\'';
+                case TokenType::strLit:    return c == '"';
+                case TokenType::op:        return is_operator_symbol(c);
+                default:                   return true;
+            }
+        }
+    }
+
+    /*!
+     * Maps every lookahead byte to a bitmask over `alternatives` (bit `i`
+     * standing for `alternatives[i]`) of the rules that could start with it.
+     */
+    template<class Alternative, size_t N>
+    constexpr std::array<uint32_t, 256> build_dispatch(
+        const Alternative (&alternatives)[N]
+    ) noexcept
+    {
+        static_assert(N <= 32, "dispatch masks hold at most 32 alternatives");
+
+        std::array<uint32_t, 256> table = {};
+
+        for (size_t c = 1; c < table.size(); ++c)
+        {
+            for (size_t i = 0; i < N; ++i)
+            {
+                const unsigned char byte = static_cast<unsigned char>(c);
+
+                if (first::subexpression(alternatives[i].rule, byte))
+                {
+                    table[c] |= uint32_t(1) << i;
+                }
+            }
+        }
+
+        return table;
+    }
+
+    /*!
+     * Maps the classification of a lookahead word (see `classify_word`) to a
+     * bitmask over `alternatives` of the rules that could start with that
+     * word. Keywords stay valid identifiers, so only the keyword-led rules
+     * are filtered, plus `numLit`, whose only words are NaN and Infinity.
+     */
+    template<class Alternative, size_t N>
+    constexpr std::array<uint32_t, token_type_count> build_word_filter(
+        const Alternative (&alternatives)[N]
+    ) noexcept
+    {
+        static_assert(N <= 32, "dispatch masks hold at most 32 alternatives");
+
+        std::array<uint32_t, token_type_count> table = {};
+
+        for (size_t w = 0; w < table.size(); ++w)
+        {
+            const TokenType word = static_cast<TokenType>(w);
+
+            for (size_t i = 0; i < N; ++i)
+            {
+                const TokenType rule = alternatives[i].rule;
+                const TokenType keyword = first::leading_keyword(rule);
+                bool viable = keyword == TokenType::ident || keyword == word;
+
+                if (rule == TokenType::numLit)
+                {
+                    viable = word == TokenType::nanKeyword ||
+                             word == TokenType::infinityKeyword;
+                }
+
+                if (viable)
+                {
+                    table[w] |= uint32_t(1) << i;
+                }
+            }
+        }
+
+        return table;
+    }
+}
@@ -0,0 +1,280 @@
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "Dump.h"
+#include "FlatAst.h"
+#include "Serial.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    std::optional<DumpFormat> dump_format_named(std::string_view name) noexcept
+    {
+        if (name == "pretty")
+        {
+            return DumpFormat::pretty;
+        }
+
+        if (name == "sexpr")
+        {
+            return DumpFormat::sexpr;
+        }
+
+        if (name == "json")
+        {
+            return DumpFormat::json;
+        }
+
+        if (name == "binary")
+        {
+            return DumpFormat::binary;
+        }
+
+        return std::nullopt;
+    }
+
+    Dumper::Dumper(std::ostream& os, DumpFormat fmt, size_t chunk_size)
+        : out(os), format(fmt), chunk(chunk_size)
+    {
+        this->buffer.reserve(chunk_size);
+    }
+
+    Dumper::~Dumper()
+    {
+        flush();
+    }
+
+    void Dumper::dump(const Tree<Token>& tree, size_t depth)
+    {
+        const size_t base = this->format == DumpFormat::pretty ? depth : 0;
+
+        tree.walk(
+            [this, base](const Tree<Token>& node, size_t level) {
+                this->open(
+                    node.val().type,
+                    node.val().lexeme,
+                    node.child_count(),
+                    base + level
+                );
+
+                return true;
+            },
+            [this](const Tree<Token>& node, size_t) {
+                this->close(node.child_count());
+            }
+        );
+
+        end();
+    }
+
+    void Dumper::dump(const FlatAst& ast, NodeId id, size_t depth)
+    {
+        const size_t base = this->format == DumpFormat::pretty ? depth : 0;
+
+        ast.walk(
+            id,
+            [this, &ast, base](NodeId node, size_t level) {
+                this->open(
+                    ast.type(node),
+                    ast.lexeme(node),
+                    ast.child_count(node),
+                    base + level
+                );
+
+                return true;
+            },
+            [this, &ast](NodeId node, size_t) {
+                this->close(ast.child_count(node));
+            }
+        );
+
+        end();
+    }
+
+    void Dumper::flush()
+    {
+        spill();
+        this->out.flush();
+    }
+
+    void Dumper::spill()
+    {
+        this->out.write(
+            this->buffer.data(),
+            static_cast<std::streamsize>(this->buffer.size())
+        );
+        this->buffer.clear();
+    }
+
+    void Dumper::open(TokenType type,
+                      std::string_view lexeme,
+                      size_t children,
+                      size_t depth)
+    {
+        const std::string_view name = token_type_name(type);
+        std::string& buf = this->buffer;
+
+        switch (this->format)
+        {
+            case DumpFormat::pretty:
+                buf.append(2 * depth, ' ');
+                buf += u8" └─ ";
+                buf += name;
+
+                if (!lexeme.empty())
+                {
+                    buf += " \"";
+                    buf += lexeme;
+                    buf += '"';
+                }
+
+                buf += '\n';
+
+                break;
+
+            case DumpFormat::sexpr:
+                if (depth > 0)
+                {
+                    buf += ' ';
+                }
+
+                buf += '(';
+                buf += name;
+
+                if (!lexeme.empty())
+                {
+                    buf += ' ';
+                    quoted(lexeme);
+                }
+
+                break;
+
+            case DumpFormat::json:
+            {
+                // Depths are relative to the tree being dumped here.
+                if (depth == 0)
+                {
+                    this->siblings.clear();
+                }
+
+                if (depth < this->siblings.size() && this->siblings[depth])
+                {
+                    buf += ',';
+                }
+
+                this->siblings.resize(depth + 1);
+                this->siblings[depth] = true;
+                this->siblings.push_back(false);
+
+                buf += "{\"type\":\"";
+                buf += name;
+                buf += '"';
+
+                if (!lexeme.empty())
+                {
+                    buf += ",\"lexeme\":";
+                    quoted(lexeme);
+                }
+
+                if (children > 0)
+                {
+                    buf += ",\"children\":[";
+                }
+
+                break;
+            }
+
+            case DumpFormat::binary:
+                buf += static_cast<char>(type);
+                serial::put(buf, static_cast<uint32_t>(children));
+                serial::put(buf, static_cast<uint32_t>(lexeme.size()));
+                buf += lexeme;
+
+                break;
+        }
+    }
+
+    void Dumper::close(size_t children)
+    {
+        switch (this->format)
+        {
+            case DumpFormat::pretty:
+            case DumpFormat::binary:
+                break;
+
+            case DumpFormat::sexpr:
+                this->buffer += ')';
+
+                break;
+
+            case DumpFormat::json:
+                this->buffer += children > 0 ? "]}" : "}";
+
+                break;
+        }
+
+        if (this->buffer.size() >= this->chunk)
+        {
+            spill();
+        }
+    }
+
+    /*!
+     * Ends one tree: a line of its own, in the one-tree-per-line formats.
+     */
+    void Dumper::end()
+    {
+        if (
+            this->format == DumpFormat::sexpr ||
+            this->format == DumpFormat::json
+        ) {
+            this->buffer += '\n';
+        }
+    }
+
+    /*!
+     * `text` as a JSON string literal, which the S-expression format uses
+     * too: quotes, backslashes and control characters are escaped, and every
+     * other byte is kept as it is.
+     */
+    void Dumper::quoted(std::string_view text)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+        std::string& buf = this->buffer;
+
+        buf += '"';
+
+        for (const char c : text)
+        {
+            switch (c)
+            {
+                case '"':  buf += "\\\""; break;
+                case '\\': buf += "\\\\"; break;
+                case '\n': buf += "\\n";  break;
+                case '\r': buf += "\\r";  break;
+                case '\t': buf += "\\t";  break;
+
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        buf += "\\u00";
+                        buf += hex[(c >> 4) & 0xf];
+                        buf += hex[c & 0xf];
+                    }
+                    else
+                    {
+                        buf += c;
+                    }
+
+                    break;
+            }
+        }
+
+        buf += '"';
+    }
+}
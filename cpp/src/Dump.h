@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FlatAst.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    enum class DumpFormat : uint8_t
+    {
+        /*!
+         * The indented tree that `Parser::log_depthfirst` prints, one node
+         * per line.
+         */
+          pretty
+
+        /*!
+         * `(type "lexeme" child...)`, one tree per line.
+         */
+        , sexpr
+
+        /*!
+         * `{"type": ..., "lexeme": ..., "children": [...]}`, one tree per
+         * line, with no `lexeme` or `children` where there are none.
+         */
+        , json
+
+        /*!
+         * Every node in preorder: its type as one byte, then its child count
+         * and lexeme length as `uint32_t`s in host (little-endian) order, then
+         * the lexeme's bytes.
+         */
+        , binary
+    };
+
+    /*!
+     * The format called `name` ("pretty", "sexpr", "json" or "binary").
+     */
+    std::optional<DumpFormat> dump_format_named(std::string_view name) noexcept;
+
+    /*!
+     * Writes trees to a stream in one of the formats above. Everything goes
+     * into one buffer, which is handed to the stream whenever it holds
+     * `chunk` bytes or more, and on `flush()` and destruction; once it has
+     * grown to size, dumping allocates nothing.
+     */
+    class Dumper
+    {
+        public:
+            explicit Dumper(std::ostream& out,
+                            DumpFormat format = DumpFormat::pretty,
+                            size_t chunk = 1 << 16);
+
+            Dumper(const Dumper& that) = delete;
+
+            Dumper& operator=(const Dumper& that) = delete;
+
+            ~Dumper();
+
+            /*!
+             * In the pretty format, indented as if `tree` were at `depth`
+             * in some larger tree; the other formats write each tree as a
+             * document of its own.
+             */
+            void dump(const Tree<Token>& tree, size_t depth = 0);
+
+            void dump(const FlatAst& ast, NodeId id = 0, size_t depth = 0);
+
+            void flush();
+
+        private:
+            void open(TokenType type,
+                      std::string_view lexeme,
+                      size_t children,
+                      size_t depth);
+
+            void close(size_t children);
+
+            void end();
+
+            void quoted(std::string_view text);
+
+            void spill();
+
+            std::ostream& out;
+
+            DumpFormat format;
+
+            size_t chunk;
+
+            std::string buffer;
+
+            /*!
+             * Whether the next node at each depth follows a sibling, and so
+             * needs a separator (JSON only).
+             */
+            std::vector<bool> siblings;
+    };
+}
@@ -0,0 +1,544 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "FlatAst.h"
+#include "Serial.h"
+#include "Source.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    static_assert(
+        static_cast<size_t>(TokenType::backtick) <= UINT8_MAX,
+        "token types must fit in the arena's byte-sized type column"
+    );
+
+    FlatAst FlatAst::from_tree(
+        const Tree<Token>& tree,
+        std::shared_ptr<const Source> source,
+        bool share_subtrees
+    ) {
+        FlatAst flat;
+        Columns columns;
+        const auto build = share_subtrees ? &FlatAst::build_shared
+                                          : &FlatAst::build;
+
+        if (source)
+        {
+            flat.text = std::move(source);
+
+            if ((flat.*build)(columns, tree, nullptr))
+            {
+                flat.adopt(std::move(columns));
+
+                return flat;
+            }
+
+            columns = Columns();
+        }
+
+        std::string pool;
+        (flat.*build)(columns, tree, &pool);
+        flat.text = std::make_shared<const Source>(
+            Source::from_buffer(std::move(pool), "<flat ast>")
+        );
+        flat.adopt(std::move(columns));
+
+        return flat;
+    }
+
+    std::optional<FlatAst> FlatAst::deserialize(
+        std::string_view bytes,
+        std::shared_ptr<const void> backing,
+        std::shared_ptr<const Source> text
+    ) {
+        serial::Reader in(bytes);
+        uint32_t node_count = 0;
+        uint32_t link_count = 0;
+        uint32_t number_count = 0;
+        FlatAst flat;
+
+        if (
+            !in.get(node_count)                             ||
+            !in.get(link_count)                             ||
+            !in.get(number_count)                           ||
+            !in.align(8)                                    ||
+            !in.get_array(flat.numbers, number_count)       ||
+            !in.get_array(flat.types, node_count)           ||
+            !in.align(4)                                    ||
+            !in.get_array(flat.first_child, node_count)     ||
+            !in.get_array(flat.child_counts, node_count)    ||
+            !in.get_array(flat.lexeme_start, node_count)    ||
+            !in.get_array(flat.lexeme_length, node_count)   ||
+            !in.get_array(flat.symbols, node_count)         ||
+            !in.get_array(flat.children, link_count)        ||
+            !in.done()
+        ) {
+            return std::nullopt;
+        }
+
+        flat.storage = std::move(backing);
+        flat.nodes = node_count;
+        flat.links = link_count;
+        flat.number_count = number_count;
+        flat.text = std::move(text);
+
+        if (!flat.valid())
+        {
+            return std::nullopt;
+        }
+
+        return flat;
+    }
+
+    void FlatAst::serialize(std::string& out) const
+    {
+        const size_t base = out.size();
+        const auto put_array = [&](const auto* array, size_t count) {
+            out.append(
+                reinterpret_cast<const char*>(array),
+                count * sizeof(*array)
+            );
+        };
+
+        serial::put(out, static_cast<uint32_t>(this->nodes));
+        serial::put(out, static_cast<uint32_t>(this->links));
+        serial::put(out, static_cast<uint32_t>(this->number_count));
+        out.resize(base + (out.size() - base + 7) / 8 * 8, '\0');
+        put_array(this->numbers, this->number_count);
+        put_array(this->types, this->nodes);
+        out.resize(base + (out.size() - base + 3) / 4 * 4, '\0');
+        put_array(this->first_child, this->nodes);
+        put_array(this->child_counts, this->nodes);
+        put_array(this->lexeme_start, this->nodes);
+        put_array(this->lexeme_length, this->nodes);
+        put_array(this->symbols, this->nodes);
+        put_array(this->children, this->links);
+    }
+
+    const std::shared_ptr<const Source>& FlatAst::source() const noexcept
+    {
+        return this->text;
+    }
+
+    Tree<Token> FlatAst::to_tree(NodeId id) const
+    {
+        Tree<Token> tree(this->token(id));
+        std::vector<std::pair<NodeId, Tree<Token>*>> stack = { { id, &tree } };
+
+        while (!stack.empty())
+        {
+            const auto [node, into] = stack.back();
+            stack.pop_back();
+
+            const uint32_t child_count = this->child_count(node);
+
+            // Reserved up front, so the pointers pushed below stay valid.
+            into->reserve(child_count);
+
+            for (uint32_t i = 0; i < child_count; ++i)
+            {
+                const NodeId child = this->child(node, i);
+
+                stack.emplace_back(
+                    child,
+                    &into->emplace_child(this->token(child))
+                );
+            }
+        }
+
+        return tree;
+    }
+
+    bool FlatAst::empty() const noexcept
+    {
+        return this->nodes == 0;
+    }
+
+    size_t FlatAst::node_count() const noexcept
+    {
+        return this->nodes;
+    }
+
+    size_t FlatAst::tree_size() const
+    {
+        if (this->nodes == 0)
+        {
+            return 0;
+        }
+
+        // How many times each node appears in the tree: once for the root,
+        // and once per appearance of each parent, which always comes first.
+        std::vector<size_t> uses(this->nodes, 0);
+        size_t total = 0;
+
+        uses[0] = 1;
+
+        for (NodeId id = 0; id < this->nodes; ++id)
+        {
+            total += uses[id];
+
+            for (uint32_t i = 0; i < this->child_count(id); ++i)
+            {
+                uses[this->child(id, i)] += uses[id];
+            }
+        }
+
+        return total;
+    }
+
+    TokenType FlatAst::type(NodeId id) const noexcept
+    {
+        return static_cast<TokenType>(this->types[id]);
+    }
+
+    std::string_view FlatAst::lexeme(NodeId id) const noexcept
+    {
+        return this->text->view().substr(
+            this->lexeme_start[id],
+            this->lexeme_length[id]
+        );
+    }
+
+    SymbolId FlatAst::symbol(NodeId id) const noexcept
+    {
+        return has_value(this->type(id)) ? no_symbol : this->symbols[id];
+    }
+
+    LiteralValue FlatAst::value(NodeId id) const noexcept
+    {
+        if (!has_value(this->type(id)))
+        {
+            return LiteralValue{ 0 };
+        }
+
+        return this->numbers[this->symbols[id]];
+    }
+
+    Token FlatAst::token(NodeId id) const noexcept
+    {
+        Token token(this->type(id), this->lexeme(id), this->symbol(id));
+        token.value = this->value(id);
+
+        return token;
+    }
+
+    uint32_t FlatAst::child_count(NodeId id) const noexcept
+    {
+        return this->child_counts[id];
+    }
+
+    NodeId FlatAst::child(NodeId id, uint32_t i) const noexcept
+    {
+        return this->children[this->first_child[id] + i];
+    }
+
+    size_t FlatAst::memory_usage() const noexcept
+    {
+        return this->nodes * (sizeof(uint8_t) + 4 * sizeof(uint32_t)) +
+               this->nodes * sizeof(SymbolId)                         +
+               this->links * sizeof(NodeId)                           +
+               this->number_count * sizeof(LiteralValue);
+    }
+
+    void FlatAst::clear() noexcept
+    {
+        *this = FlatAst();
+    }
+
+    /*!
+     * Appends `tree` breadth-first. With no `pool`, lexemes become spans of
+     * `text` and this fails on the first one that lies outside of it;
+     * otherwise they're copied into `pool` and spans index that instead.
+     */
+    bool FlatAst::build(Columns& columns,
+                        const Tree<Token>& tree,
+                        std::string* pool) const
+    {
+        std::vector<const Tree<Token>*> queue = { &tree };
+
+        if (!this->add_node(columns, tree.val(), pool))
+        {
+            return false;
+        }
+
+        // Breadth-first, so that the children of every node get consecutive
+        // ids and one contiguous range of `children`.
+        for (size_t head = 0; head < queue.size(); ++head)
+        {
+            const Tree<Token>& node = *queue[head];
+            const size_t child_count = node.child_count();
+
+            columns.first_child[head] =
+                static_cast<uint32_t>(columns.children.size());
+            columns.child_counts[head] = static_cast<uint32_t>(child_count);
+
+            for (size_t i = 0; i < child_count; ++i)
+            {
+                const Tree<Token>& child = node.get_child(i);
+
+                columns.children.push_back(
+                    static_cast<NodeId>(columns.types.size())
+                );
+
+                if (!this->add_node(columns, child.val(), pool))
+                {
+                    return false;
+                }
+
+                queue.push_back(&child);
+            }
+        }
+
+        return true;
+    }
+
+    static size_t mix(size_t hash, size_t value) noexcept
+    {
+        return (hash ^ value) * 0x100000001b3;
+    }
+
+    /*!
+     * As `build`, but with each distinct subtree appended once. Subtrees are
+     * numbered in postorder as they are first seen, so every child's number
+     * is less than its parent's, and the root's is the greatest; ids are
+     * those numbers reversed.
+     */
+    bool FlatAst::build_shared(Columns& columns,
+                               const Tree<Token>& tree,
+                               std::string* pool) const
+    {
+        struct Distinct
+        {
+            const Token* token;
+
+            size_t kids_start;
+
+            uint32_t child_count;
+
+            size_t hash;
+        };
+
+        std::vector<Distinct> distinct;
+
+        // The numbers of each distinct subtree's children, by range.
+        std::vector<uint32_t> kids;
+
+        // Numbers of the subtrees whose parent isn't finished yet, in order.
+        std::vector<uint32_t> finished;
+
+        const auto hash_of = [&distinct](uint32_t n) {
+            return distinct[n].hash;
+        };
+        const auto same = [&distinct, &kids](uint32_t a, uint32_t b) {
+            const Distinct& x = distinct[a];
+            const Distinct& y = distinct[b];
+
+            return x.hash == y.hash &&
+                   x.token->type == y.token->type &&
+                   x.token->lexeme == y.token->lexeme &&
+                   x.token->symbol == y.token->symbol &&
+                   std::memcmp(
+                       &x.token->value,
+                       &y.token->value,
+                       sizeof(LiteralValue)
+                   ) == 0 &&
+                   x.child_count == y.child_count &&
+                   std::equal(
+                       kids.begin() + x.kids_start,
+                       kids.begin() + x.kids_start + x.child_count,
+                       kids.begin() + y.kids_start
+                   );
+        };
+        std::unordered_set<uint32_t, decltype(hash_of), decltype(same)>
+            seen(0, hash_of, same);
+
+        tree.walk(
+            [](const Tree<Token>&, size_t) { return true; },
+            [&](const Tree<Token>& node, size_t) {
+                const uint32_t child_count =
+                    static_cast<uint32_t>(node.child_count());
+                const Token& token = node.val();
+                size_t hash = mix(
+                    std::hash<std::string_view>()(token.lexeme),
+                    static_cast<size_t>(token.type)
+                );
+
+                hash = mix(hash, token.symbol);
+
+                const size_t kids_start = kids.size();
+
+                kids.insert(
+                    kids.end(),
+                    finished.end() - child_count,
+                    finished.end()
+                );
+                finished.resize(finished.size() - child_count);
+
+                for (size_t k = kids_start; k < kids.size(); ++k)
+                {
+                    hash = mix(hash, kids[k]);
+                }
+
+                distinct.push_back({ &token, kids_start, child_count, hash });
+
+                const auto [found, added] = seen.insert(
+                    static_cast<uint32_t>(distinct.size() - 1)
+                );
+
+                if (!added)
+                {
+                    distinct.pop_back();
+                    kids.resize(kids_start);
+                }
+
+                finished.push_back(*found);
+            }
+        );
+
+        const uint32_t count = static_cast<uint32_t>(distinct.size());
+
+        for (uint32_t id = 0; id < count; ++id)
+        {
+            const Distinct& d = distinct[count - 1 - id];
+
+            if (!this->add_node(columns, *d.token, pool))
+            {
+                return false;
+            }
+
+            columns.first_child[id] =
+                static_cast<uint32_t>(columns.children.size());
+            columns.child_counts[id] = d.child_count;
+
+            for (size_t k = 0; k < d.child_count; ++k)
+            {
+                columns.children.push_back(count - 1 - kids[d.kids_start + k]);
+            }
+        }
+
+        return true;
+    }
+
+    bool FlatAst::add_node(Columns& columns,
+                           const Token& token,
+                           std::string* pool) const
+    {
+        const std::string_view lex = token.lexeme;
+        size_t start = 0;
+
+        if (pool)
+        {
+            start = pool->size();
+            *pool += lex;
+        }
+        else if (!lex.empty())
+        {
+            const std::string_view base = this->text->view();
+
+            if (
+                lex.data() < base.data() ||
+                lex.data() + lex.size() > base.data() + base.size()
+            ) {
+                return false;
+            }
+
+            start = static_cast<size_t>(lex.data() - base.data());
+        }
+
+        columns.types.push_back(static_cast<uint8_t>(token.type));
+        columns.first_child.push_back(0);
+        columns.child_counts.push_back(0);
+        columns.lexeme_start.push_back(static_cast<uint32_t>(start));
+        columns.lexeme_length.push_back(static_cast<uint32_t>(lex.size()));
+        // A numeric literal has no symbol, so its slot indexes its value.
+        if (has_value(token.type))
+        {
+            columns.symbols.push_back(
+                static_cast<SymbolId>(columns.numbers.size())
+            );
+            columns.numbers.push_back(token.value);
+        }
+        else
+        {
+            columns.symbols.push_back(token.symbol);
+        }
+
+        return true;
+    }
+
+    /*!
+     * Takes ownership of `columns`, pointing the accessors at them.
+     */
+    void FlatAst::adopt(Columns columns)
+    {
+        const auto owned = std::make_shared<const Columns>(std::move(columns));
+
+        this->nodes = owned->types.size();
+        this->links = owned->children.size();
+        this->number_count = owned->numbers.size();
+        this->types = owned->types.data();
+        this->first_child = owned->first_child.data();
+        this->child_counts = owned->child_counts.data();
+        this->lexeme_start = owned->lexeme_start.data();
+        this->lexeme_length = owned->lexeme_length.data();
+        this->symbols = owned->symbols.data();
+        this->children = owned->children.data();
+        this->numbers = owned->numbers.data();
+        this->storage = owned;
+    }
+
+    /*!
+     * Whether every id, child range and lexeme span is in bounds, and every
+     * child comes after its parent as `build` lays them out, so that none of
+     * the accessors can read past the arena and no walk can loop.
+     */
+    bool FlatAst::valid() const noexcept
+    {
+        const size_t text_size = this->text ? this->text->view().size() : 0;
+
+        for (size_t id = 0; id < this->nodes; ++id)
+        {
+            const size_t first = this->first_child[id];
+            const size_t count = this->child_counts[id];
+
+            if (
+                this->types[id] >= token_type_count                     ||
+                first > this->links                                     ||
+                count > this->links - first                             ||
+                this->lexeme_start[id] > text_size                      ||
+                this->lexeme_length[id] > text_size - this->lexeme_start[id]
+            ) {
+                return false;
+            }
+
+            if (
+                has_value(static_cast<TokenType>(this->types[id])) &&
+                this->symbols[id] >= this->number_count
+            ) {
+                return false;
+            }
+
+            for (size_t k = first; k < first + count; ++k)
+            {
+                if (this->children[k] <= id || this->children[k] >= this->nodes)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Source.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    using NodeId = uint32_t;
+
+    /*!
+     * A whole AST held in one arena of parallel arrays rather than as a tree
+     * of individually allocated nodes. Each node is a 32-bit id into those
+     * arrays: its token type, a range of the `children` id list, and a span of
+     * the lexeme text. Node ids are assigned breadth-first (or, in a shared
+     * arena, as below), so the root is always node 0, every child comes after
+     * its parent, and the whole tree is freed at once.
+     *
+     * Lexeme spans point into the source the tree was parsed from, which the
+     * arena keeps alive. Trees whose lexemes don't all lie within `source`
+     * (or that come without one) get a private copy of their text instead.
+     *
+     * The arrays are immutable once built, and accessed through plain
+     * pointers, so that an arena can also be used in place from a mapped
+     * file (see `deserialize`). Copies share them.
+     */
+    class FlatAst
+    {
+        public:
+            /*!
+             * With `share_subtrees`, subtrees that are structurally identical
+             * (the same types, lexemes and symbols all the way down) are
+             * stored once, as one node with several parents; a lexeme keeps
+             * the span of its first occurrence. Within such an arena, two
+             * subtrees are equal exactly when their ids are. Ids are then in
+             * reverse postorder rather than breadth-first.
+             */
+            static FlatAst from_tree(
+                const Tree<Token>& tree,
+                std::shared_ptr<const Source> source = nullptr,
+                bool share_subtrees = false
+            );
+
+            /*!
+             * Uses what `serialize` wrote in place, with lexeme spans
+             * indexing `text`: `bytes` must be 8-byte aligned, and stay valid
+             * for as long as `backing` does. Returns `nullopt` if `bytes` is
+             * not a well-formed tree over `text`.
+             */
+            static std::optional<FlatAst> deserialize(
+                std::string_view bytes,
+                std::shared_ptr<const void> backing,
+                std::shared_ptr<const Source> text
+            );
+
+            /*!
+             * Appends the arena's arrays (but not its text) to `out`, each
+             * aligned for its type relative to where they start.
+             */
+            void serialize(std::string& out) const;
+
+            /*!
+             * The text that lexeme spans index.
+             */
+            const std::shared_ptr<const Source>& source() const noexcept;
+
+            /*!
+             * The returned tree views this arena's text, so it must not
+             * outlive it.
+             */
+            Tree<Token> to_tree(NodeId id = 0) const;
+
+            bool empty() const noexcept;
+
+            size_t node_count() const noexcept;
+
+            /*!
+             * How many nodes `to_tree()` would give: more than `node_count()`
+             * if subtrees are shared.
+             */
+            size_t tree_size() const;
+
+            TokenType type(NodeId id) const noexcept;
+
+            std::string_view lexeme(NodeId id) const noexcept;
+
+            /*!
+             * `no_symbol` for numeric literals, whose symbol slot indexes
+             * their value instead.
+             */
+            SymbolId symbol(NodeId id) const noexcept;
+
+            /*!
+             * Zero unless `has_value(type(id))`.
+             */
+            LiteralValue value(NodeId id) const noexcept;
+
+            Token token(NodeId id) const noexcept;
+
+            uint32_t child_count(NodeId id) const noexcept;
+
+            NodeId child(NodeId id, uint32_t i) const noexcept;
+
+            size_t memory_usage() const noexcept;
+
+            /*!
+             * Visits the subtree at `root` depth-first, without recursing:
+             * like `Tree::walk`, `pre(id, depth)` returns whether to visit
+             * the children of `id`, and `post(id, depth)` runs once they are
+             * done.
+             */
+            template<class Pre, class Post>
+            void walk(NodeId root, Pre&& pre, Post&& post) const
+            {
+                // (node, index of the next child to visit)
+                std::vector<std::pair<NodeId, uint32_t>> stack;
+
+                if (pre(root, size_t(0)))
+                {
+                    stack.emplace_back(root, 0);
+                }
+                else
+                {
+                    post(root, size_t(0));
+                }
+
+                while (!stack.empty())
+                {
+                    auto& [id, next] = stack.back();
+
+                    if (next == this->child_count(id))
+                    {
+                        const NodeId done = id;
+                        stack.pop_back();
+                        post(done, stack.size());
+
+                        continue;
+                    }
+
+                    const NodeId child = this->child(id, next++);
+                    const size_t depth = stack.size();
+
+                    if (pre(child, depth))
+                    {
+                        stack.emplace_back(child, 0);
+                    }
+                    else
+                    {
+                        post(child, depth);
+                    }
+                }
+            }
+
+            void clear() noexcept;
+
+        private:
+            /*!
+             * The arrays of an arena built from a tree.
+             */
+            struct Columns
+            {
+                std::vector<uint8_t> types;
+
+                std::vector<uint32_t> first_child;
+
+                std::vector<uint32_t> child_counts;
+
+                std::vector<uint32_t> lexeme_start;
+
+                std::vector<uint32_t> lexeme_length;
+
+                std::vector<SymbolId> symbols;
+
+                std::vector<LiteralValue> numbers;
+
+                std::vector<NodeId> children;
+            };
+
+            bool build(Columns& columns,
+                       const Tree<Token>& tree,
+                       std::string* pool) const;
+
+            bool build_shared(Columns& columns,
+                              const Tree<Token>& tree,
+                              std::string* pool) const;
+
+            bool add_node(Columns& columns,
+                          const Token& token,
+                          std::string* pool) const;
+
+            void adopt(Columns columns);
+
+            bool valid() const noexcept;
+
+            /*!
+             * Whatever owns the arrays below.
+             */
+            std::shared_ptr<const void> storage;
+
+            size_t nodes = 0;
+
+            size_t links = 0;
+
+            size_t number_count = 0;
+
+            const uint8_t* types = nullptr;
+
+            const uint32_t* first_child = nullptr;
+
+            const uint32_t* child_counts = nullptr;
+
+            const uint32_t* lexeme_start = nullptr;
+
+            const uint32_t* lexeme_length = nullptr;
+
+            const SymbolId* symbols = nullptr;
+
+            const LiteralValue* numbers = nullptr;
+
+            const NodeId* children = nullptr;
+
+            std::shared_ptr<const Source> text;
+    };
+}
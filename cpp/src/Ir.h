@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Bytecode.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    /*!
+     * The compiler's intermediate representation: a typed expression tree
+     * with names already resolved to local slots and function indices, and
+     * implicit conversions made explicit. Statements are expressions of type
+     * `unit`.
+     */
+    namespace ir
+    {
+        enum class Op : uint8_t
+        {
+              intConst   // `value.i`
+            , floatConst // `value.f`
+            , load       // local `index`
+            , store      // local `index` = child 0
+            , add
+            , sub
+            , mul
+            , div
+            , mod
+            , neg
+            , intToFloat
+            , floatToInt
+            , compare    // `cmp` of children 0 and 1, as an int
+            , call       // chunk `index`, with the children as arguments
+            , print
+            , return_
+            , if_        // cond, then [, else]
+            , while_     // cond, body
+            , seq        // the value of the last child, if any
+        };
+
+        enum class Cmp : uint8_t
+        {
+              eq
+            , ne
+            , lt
+            , le
+            , gt
+            , ge
+        };
+
+        struct Node
+        {
+            Op op;
+
+            ValueType type;
+
+            Cmp cmp = Cmp::eq;
+
+            uint32_t index = 0;
+
+            Value value = { 0 };
+        };
+
+        using Expr = Tree<Node>;
+    }
+}
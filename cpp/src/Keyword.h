@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string_view>
+
+#include "Token.h"
+
+namespace brouwer
+{
+    /*!
+     * Classifies an identifier-shaped word as the keyword token it spells,
+     * or as `TokenType::ident` if it isn't a reserved word. Switching on the
+     * first byte and then comparing the rest once amounts to a two-level
+     * trie over the reserved words.
+     */
+    constexpr TokenType classify_word(std::string_view word) noexcept
+    {
+        if (word.empty())
+        {
+            return TokenType::ident;
+        }
+
+        const std::string_view rest = word.substr(1);
+
+        switch (word[0])
+        {
+            case '_':
+                return rest.empty() ? TokenType::underscore : TokenType::ident;
+            case 'a':
+                return rest == "s" ? TokenType::asKeyword : TokenType::ident;
+            case 'c':
+                if (rest == "ase")
+                {
+                    return TokenType::caseKeyword;
+                }
+
+                return rest == "atch" ? TokenType::catchKeyword
+                                      : TokenType::ident;
+            case 'e':
+                if (rest == "lse")
+                {
+                    return TokenType::elseKeyword;
+                }
+
+                return rest == "xposing" ? TokenType::exposingKeyword
+                                         : TokenType::ident;
+            case 'f':
+                if (rest == "n")
+                {
+                    return TokenType::fnKeyword;
+                }
+
+                return rest == "or" ? TokenType::forKeyword : TokenType::ident;
+            case 'h':
+                return rest == "iding" ? TokenType::hidingKeyword
+                                       : TokenType::ident;
+            case 'i':
+                if (rest == "f")
+                {
+                    return TokenType::ifKeyword;
+                }
+
+                if (rest == "n")
+                {
+                    return TokenType::inKeyword;
+                }
+
+                return rest == "mport" ? TokenType::importKeyword
+                                       : TokenType::ident;
+            case 'm':
+                return rest == "odule" ? TokenType::moduleKeyword
+                                       : TokenType::ident;
+            case 'r':
+                return rest == "eturn" ? TokenType::returnKeyword
+                                       : TokenType::ident;
+            case 't':
+                return rest == "ry" ? TokenType::tryKeyword : TokenType::ident;
+            case 'v':
+                return rest == "ar" ? TokenType::varKeyword : TokenType::ident;
+            case 'w':
+                return rest == "hile" ? TokenType::whileKeyword
+                                      : TokenType::ident;
+            case 'N':
+                return rest == "aN" ? TokenType::nanKeyword : TokenType::ident;
+            case 'I':
+                return rest == "nfinity" ? TokenType::infinityKeyword
+                                         : TokenType::ident;
+            default:
+                return TokenType::ident;
+        }
+    }
+}
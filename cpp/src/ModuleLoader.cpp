@@ -0,0 +1,294 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ModuleLoader.h"
+#include "Parser.h"
+#include "ThreadPool.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    namespace fs = std::filesystem;
+
+    static std::string canonical_path(const fs::path& path)
+    {
+        std::error_code ec;
+        const fs::path canon = fs::weakly_canonical(path, ec);
+
+        return ec ? path.string() : canon.string();
+    }
+
+    std::vector<size_t> ModuleGraph::order() const
+    {
+        enum class Mark : uint8_t
+        {
+              unvisited
+            , visiting
+            , done
+        };
+
+        std::vector<Mark> marks(this->modules.size(), Mark::unvisited);
+        std::vector<size_t> ordered;
+
+        // (module, index of the next import to visit)
+        std::vector<std::pair<size_t, size_t>> stack;
+
+        for (const size_t root : this->roots)
+        {
+            if (marks[root] != Mark::unvisited)
+            {
+                continue;
+            }
+
+            marks[root] = Mark::visiting;
+            stack.emplace_back(root, 0);
+
+            while (!stack.empty())
+            {
+                auto& [id, next] = stack.back();
+                const std::vector<size_t>& imports = this->modules[id].imports;
+
+                if (next == imports.size())
+                {
+                    marks[id] = Mark::done;
+                    ordered.push_back(id);
+                    stack.pop_back();
+
+                    continue;
+                }
+
+                const size_t dep = imports[next++];
+
+                if (marks[dep] == Mark::visiting)
+                {
+                    std::string cycle = this->modules[dep].path;
+                    size_t i = stack.size();
+
+                    while (stack[i - 1].first != dep)
+                    {
+                        --i;
+                    }
+
+                    for (; i < stack.size(); ++i)
+                    {
+                        cycle += " -> " + this->modules[stack[i].first].path;
+                    }
+
+                    throw std::runtime_error(
+                        "import cycle: " + cycle + " -> " +
+                            this->modules[dep].path
+                    );
+                }
+
+                if (marks[dep] == Mark::unvisited)
+                {
+                    marks[dep] = Mark::visiting;
+                    stack.emplace_back(dep, 0);
+                }
+            }
+        }
+
+        return ordered;
+    }
+
+    ModuleLoader::ModuleLoader(ThreadPool& workers, LoaderOptions opts)
+        : pool(workers), options(std::move(opts)), pending(0) {}
+
+    ModuleGraph ModuleLoader::load(const std::vector<std::string>& roots)
+    {
+        ModuleGraph graph;
+
+        for (const std::string& root : roots)
+        {
+            const auto [id, added] = this->claim(canonical_path(root));
+
+            graph.roots.push_back(id);
+
+            if (added)
+            {
+                this->schedule(id);
+            }
+        }
+
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->idle.wait(guard, [this]() { return this->pending == 0; });
+
+        graph.modules.reserve(this->modules.size());
+
+        for (Module& module : this->modules)
+        {
+            graph.modules.push_back(std::move(module));
+        }
+
+        this->modules.clear();
+        this->ids.clear();
+
+        return graph;
+    }
+
+    std::vector<std::string_view> ModuleLoader::import_names(
+        const Tree<Token>& root
+    ) {
+        std::vector<std::string_view> names;
+
+        for (size_t i = 0; i < root.child_count(); ++i)
+        {
+            const Tree<Token>& prog = root.get_child(i);
+
+            if (prog.val().type != TokenType::prog)
+            {
+                continue;
+            }
+
+            // Imports all come right after the (optional) module declaration.
+            for (size_t k = 0; k < prog.child_count(); ++k)
+            {
+                const Tree<Token>& item = prog.get_child(k);
+
+                if (item.val().type == TokenType::modDecl)
+                {
+                    continue;
+                }
+
+                if (item.val().type != TokenType::import)
+                {
+                    break;
+                }
+
+                names.push_back(item.get_child(1).val().lexeme);
+            }
+        }
+
+        return names;
+    }
+
+    std::pair<size_t, bool> ModuleLoader::claim(const std::string& path)
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        const auto [it, added] = this->ids.emplace(path, this->modules.size());
+
+        if (added)
+        {
+            this->modules.emplace_back().path = path;
+        }
+
+        return { it->second, added };
+    }
+
+    void ModuleLoader::schedule(size_t id)
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            ++this->pending;
+        }
+
+        this->pool.submit([this, id]() {
+            this->parse(id);
+
+            std::lock_guard<std::mutex> guard(this->lock);
+
+            if (--this->pending == 0)
+            {
+                this->idle.notify_all();
+            }
+        });
+    }
+
+    /*!
+     * Parses module `id`, then claims and schedules each import that no
+     * other module has claimed yet. Only this call touches the module until
+     * `load` collects it.
+     */
+    void ModuleLoader::parse(size_t id)
+    {
+        Module* module = nullptr;
+
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            module = &this->modules[id];
+        }
+
+        std::vector<std::string_view> names;
+
+        try
+        {
+            Parser parser(module->path, this->options.parser);
+
+            module->source = parser.shared_source();
+            module->ast = parser.parse();
+
+            if (!module->ast)
+            {
+                module->error = "ast == nullopt";
+
+                return;
+            }
+
+            names = import_names(*module->ast);
+        }
+        catch (const std::exception& e)
+        {
+            module->ast.reset();
+            module->error = e.what();
+
+            return;
+        }
+
+        for (const std::string_view name : names)
+        {
+            const std::optional<std::string> path =
+                this->resolve(name, module->path);
+
+            if (!path)
+            {
+                module->missing.emplace_back(name);
+
+                continue;
+            }
+
+            const auto [dep, added] = this->claim(*path);
+
+            module->imports.push_back(dep);
+
+            if (added)
+            {
+                this->schedule(dep);
+            }
+        }
+    }
+
+    std::optional<std::string> ModuleLoader::resolve(
+        std::string_view name,
+        const std::string& importer
+    ) const {
+        const std::string file = std::string(name) + ".bwr";
+        const fs::path here = fs::path(importer).parent_path() / file;
+        std::error_code ec;
+
+        if (fs::is_regular_file(here, ec))
+        {
+            return canonical_path(here);
+        }
+
+        for (const std::string& dir : this->options.search_path)
+        {
+            const fs::path there = fs::path(dir) / file;
+
+            if (fs::is_regular_file(there, ec))
+            {
+                return canonical_path(there);
+            }
+        }
+
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Parser.h"
+#include "Source.h"
+#include "ThreadPool.h"
+#include "Token.h"
+#include "Tree.h"
+
+namespace brouwer
+{
+    struct Module
+    {
+        /*!
+         * Canonical, so that every spelling of a path names one module.
+         */
+        std::string path;
+
+        /*!
+         * Keeps the text that `ast`'s lexemes point into alive.
+         */
+        std::shared_ptr<const Source> source;
+
+        std::optional<Tree<Token>> ast;
+
+        /*!
+         * Why `path` failed to load or parse, if it did.
+         */
+        std::string error;
+
+        /*!
+         * The modules this one imports, as indices into `ModuleGraph::modules`,
+         * in the order the imports appear.
+         */
+        std::vector<size_t> imports;
+
+        /*!
+         * Imported module names that did not resolve to any file.
+         */
+        std::vector<std::string> missing;
+    };
+
+    struct ModuleGraph
+    {
+        std::vector<Module> modules;
+
+        std::vector<size_t> roots;
+
+        /*!
+         * Every module reachable from `roots`, each after all of the modules
+         * it imports. Throws `std::runtime_error` naming the cycle if the
+         * imports are not a DAG.
+         */
+        std::vector<size_t> order() const;
+    };
+
+    struct LoaderOptions
+    {
+        ParserOptions parser;
+
+        /*!
+         * Where `import X` looks for `X.bwr` once the importer's own
+         * directory doesn't have it, in order.
+         */
+        std::vector<std::string> search_path;
+    };
+
+    /*!
+     * Parses a set of scripts and, transitively, every module they import.
+     * Each parsed module's imports are resolved and queued on the pool as
+     * soon as it is done, so whichever worker is free takes the next module
+     * off the frontier, and independent modules parse at the same time. A
+     * module is parsed exactly once, however many modules import it.
+     */
+    class ModuleLoader
+    {
+        public:
+            explicit ModuleLoader(ThreadPool& pool, LoaderOptions opts = {});
+
+            ModuleGraph load(const std::vector<std::string>& roots);
+
+            /*!
+             * The names of the modules imported by the tree that `parse()`
+             * returned, in order.
+             */
+            static std::vector<std::string_view>
+            import_names(const Tree<Token>& root);
+
+        private:
+            /*!
+             * The id of the module at `path`, and whether this call added it
+             * (and so must schedule it).
+             */
+            std::pair<size_t, bool> claim(const std::string& path);
+
+            void schedule(size_t id);
+
+            void parse(size_t id);
+
+            std::optional<std::string> resolve(std::string_view name,
+                                               const std::string& importer) const;
+
+            ThreadPool& pool;
+
+            LoaderOptions options;
+
+            std::mutex lock;
+
+            std::condition_variable idle;
+
+            /*!
+             * A deque, so that workers can hold on to their module while
+             * others are added.
+             */
+            std::deque<Module> modules;
+
+            std::unordered_map<std::string, size_t> ids;
+
+            size_t pending;
+    };
+}
@@ -0,0 +1,659 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Arith.h"
+#include "Bytecode.h"
+#include "Ir.h"
+#include "Optimizer.h"
+
+namespace brouwer
+{
+    namespace
+    {
+        Constant int_constant(int64_t i) noexcept
+        {
+            Constant c = { ValueType::int_, { 0 } };
+            c.value.i = i;
+
+            return c;
+        }
+
+        Constant float_constant(double f) noexcept
+        {
+            Constant c = { ValueType::float_, { 0 } };
+            c.value.f = f;
+
+            return c;
+        }
+
+        /*!
+         * What `op` leaves on the stack given `a` and `b` beneath it, if it
+         * is arithmetic that can be done ahead of time.
+         */
+        std::optional<Constant> evaluate(Opcode op, Value a, Value b) noexcept
+        {
+            switch (op)
+            {
+                case Opcode::iadd: return int_constant(arith::add(a.i, b.i));
+                case Opcode::isub: return int_constant(arith::sub(a.i, b.i));
+                case Opcode::imul: return int_constant(arith::mul(a.i, b.i));
+                case Opcode::fadd: return float_constant(a.f + b.f);
+                case Opcode::fsub: return float_constant(a.f - b.f);
+                case Opcode::fmul: return float_constant(a.f * b.f);
+                case Opcode::fdiv: return float_constant(a.f / b.f);
+                case Opcode::fmod: return float_constant(std::fmod(a.f, b.f));
+                case Opcode::icmp: return int_constant(arith::cmp(a.i, b.i));
+                case Opcode::idiv:
+                    if (b.i == 0)
+                    {
+                        return std::nullopt;
+                    }
+
+                    return int_constant(arith::div(a.i, b.i));
+                case Opcode::imod:
+                    if (b.i == 0)
+                    {
+                        return std::nullopt;
+                    }
+
+                    return int_constant(arith::mod(a.i, b.i));
+                case Opcode::fcmpl:
+                    return int_constant(arith::cmp(a.f, b.f, -1));
+                case Opcode::fcmpg:
+                    return int_constant(arith::cmp(a.f, b.f, 1));
+                default:
+                    return std::nullopt;
+            }
+        }
+
+        std::optional<Constant> evaluate(Opcode op, Value a) noexcept
+        {
+            switch (op)
+            {
+                case Opcode::ineg: return int_constant(arith::sub(0, a.i));
+                case Opcode::fneg: return float_constant(-a.f);
+                case Opcode::i2f:
+                    return float_constant(static_cast<double>(a.i));
+                case Opcode::f2i: return int_constant(arith::to_int(a.f));
+                default:          return std::nullopt;
+            }
+        }
+
+        /*!
+         * Whether the branch `op` is taken when it pops `v`.
+         */
+        bool taken(Opcode op, int64_t v) noexcept
+        {
+            switch (op)
+            {
+                case Opcode::ifeq: return v == 0;
+                case Opcode::ifne: return v != 0;
+                case Opcode::iflt: return v < 0;
+                case Opcode::ifge: return v >= 0;
+                case Opcode::ifgt: return v > 0;
+                default:           return v <= 0;
+            }
+        }
+
+        bool is_jump(Opcode op) noexcept
+        {
+            return op >= Opcode::goto_ && op <= Opcode::ifle;
+        }
+
+        bool is_const(const ir::Expr& e) noexcept
+        {
+            return e.val().op == ir::Op::intConst ||
+                   e.val().op == ir::Op::floatConst;
+        }
+
+        ir::Expr const_expr(Constant c)
+        {
+            ir::Node n = {
+                c.type == ValueType::float_ ? ir::Op::floatConst
+                                            : ir::Op::intConst,
+                c.type
+            };
+            n.value = c.value;
+
+            return ir::Expr(n);
+        }
+
+        /*!
+         * The instruction that the code generator emits for `op` on values
+         * of `type`.
+         */
+        Opcode opcode_of(ir::Op op, ValueType type) noexcept
+        {
+            const bool f = type == ValueType::float_;
+
+            switch (op)
+            {
+                case ir::Op::add:        return f ? Opcode::fadd : Opcode::iadd;
+                case ir::Op::sub:        return f ? Opcode::fsub : Opcode::isub;
+                case ir::Op::mul:        return f ? Opcode::fmul : Opcode::imul;
+                case ir::Op::div:        return f ? Opcode::fdiv : Opcode::idiv;
+                case ir::Op::mod:        return f ? Opcode::fmod : Opcode::imod;
+                case ir::Op::neg:        return f ? Opcode::fneg : Opcode::ineg;
+                case ir::Op::intToFloat: return Opcode::i2f;
+                default:                 return Opcode::f2i;
+            }
+        }
+
+        /*!
+         * Folds a `compare`, with NaN making every comparison but `!=`
+         * false, as it does at runtime.
+         */
+        int64_t compare(ir::Cmp cmp, ValueType type, Value a, Value b) noexcept
+        {
+            const bool below = cmp == ir::Cmp::lt || cmp == ir::Cmp::le;
+            const int64_t order = type == ValueType::float_
+                ? arith::cmp(a.f, b.f, below ? 1 : -1)
+                : arith::cmp(a.i, b.i);
+
+            switch (cmp)
+            {
+                case ir::Cmp::eq: return order == 0;
+                case ir::Cmp::ne: return order != 0;
+                case ir::Cmp::lt: return order < 0;
+                case ir::Cmp::le: return order <= 0;
+                case ir::Cmp::gt: return order > 0;
+                default:          return order >= 0;
+            }
+        }
+
+        /*!
+         * One decoded instruction. Constant pushes all become `ldc`s with
+         * their `value`, and local accesses all become `load`/`store`s with
+         * their slot as the `operand`, so that they are re-encoded in the
+         * shortest form. A jump's `operand` is the index of the instruction
+         * that it lands on.
+         */
+        struct Insn
+        {
+            Opcode op;
+
+            uint32_t operand = 0;
+
+            Constant value = { ValueType::unit, { 0 } };
+
+            bool is_target = false;
+        };
+
+        std::vector<Insn> decode(const Chunk& chunk)
+        {
+            std::vector<Insn> insns;
+            std::vector<size_t> index_at(chunk.code.size() + 1, SIZE_MAX);
+
+            for (size_t at = 0; at < chunk.code.size();)
+            {
+                const uint8_t raw = chunk.code[at];
+
+                if (raw >= opcode_count)
+                {
+                    throw std::logic_error("undefined opcode in bytecode");
+                }
+
+                const Opcode op = static_cast<Opcode>(raw);
+                Insn insn = { op };
+
+                index_at[at] = insns.size();
+
+                if (op >= Opcode::iconst_n1 && op <= Opcode::iconst_3)
+                {
+                    insn.op = Opcode::ldc;
+                    insn.value = int_constant(
+                        raw - static_cast<uint8_t>(Opcode::iconst_0)
+                    );
+                }
+                else if (op >= Opcode::fconst_n1 && op <= Opcode::fconst_3)
+                {
+                    insn.op = Opcode::ldc;
+                    insn.value = float_constant(
+                        raw - static_cast<uint8_t>(Opcode::fconst_0)
+                    );
+                }
+                else if (op >= Opcode::load_0 && op <= Opcode::load_3)
+                {
+                    insn.op = Opcode::load;
+                    insn.operand = raw - static_cast<uint8_t>(Opcode::load_0);
+                }
+                else if (op >= Opcode::store_0 && op <= Opcode::store_3)
+                {
+                    insn.op = Opcode::store;
+                    insn.operand = raw - static_cast<uint8_t>(Opcode::store_0);
+                }
+                else if (op == Opcode::load || op == Opcode::store)
+                {
+                    insn.operand = chunk.code[at + 1];
+                }
+                else if (op == Opcode::ldc)
+                {
+                    insn.value = chunk.constants[chunk.read_u16(at + 1)];
+                }
+                else if (is_jump(op))
+                {
+                    const int16_t delta =
+                        static_cast<int16_t>(chunk.read_u16(at + 1));
+
+                    // Resolved to an instruction index below.
+                    insn.operand = static_cast<uint32_t>(
+                        static_cast<long>(at) + 3 + delta
+                    );
+                }
+                else if (op == Opcode::call)
+                {
+                    insn.operand = chunk.read_u16(at + 1);
+                }
+
+                insns.push_back(insn);
+                at += 1 + operand_size(op);
+            }
+
+            index_at[chunk.code.size()] = insns.size();
+
+            for (Insn& insn : insns)
+            {
+                if (is_jump(insn.op))
+                {
+                    if (
+                        insn.operand > chunk.code.size() ||
+                        index_at[insn.operand] == SIZE_MAX
+                    ) {
+                        throw std::logic_error("jump into an instruction");
+                    }
+
+                    insn.operand =
+                        static_cast<uint32_t>(index_at[insn.operand]);
+                }
+            }
+
+            return insns;
+        }
+
+        void encode(const std::vector<Insn>& insns, Chunk& chunk)
+        {
+            std::vector<size_t> offsets(insns.size() + 1);
+            std::vector<std::pair<size_t, uint32_t>> jumps;
+
+            chunk.code.clear();
+            chunk.constants.clear();
+
+            for (size_t i = 0; i < insns.size(); ++i)
+            {
+                const Insn& insn = insns[i];
+                offsets[i] = chunk.code.size();
+
+                if (insn.op == Opcode::ldc)
+                {
+                    chunk.emit_constant(insn.value);
+                }
+                else if (insn.op == Opcode::load || insn.op == Opcode::store)
+                {
+                    const Opcode short_form = insn.op == Opcode::load
+                        ? Opcode::load_0
+                        : Opcode::store_0;
+
+                    if (insn.operand < 4)
+                    {
+                        chunk.emit(static_cast<Opcode>(
+                            static_cast<uint8_t>(short_form) + insn.operand
+                        ));
+                    }
+                    else
+                    {
+                        chunk.emit(insn.op);
+                        chunk.emit_u8(static_cast<uint8_t>(insn.operand));
+                    }
+                }
+                else if (is_jump(insn.op))
+                {
+                    chunk.emit(insn.op);
+                    jumps.emplace_back(chunk.code.size(), insn.operand);
+                    chunk.emit_u16(0);
+                }
+                else if (insn.op == Opcode::call)
+                {
+                    chunk.emit(insn.op);
+                    chunk.emit_u16(static_cast<uint16_t>(insn.operand));
+                }
+                else
+                {
+                    chunk.emit(insn.op);
+                }
+            }
+
+            offsets[insns.size()] = chunk.code.size();
+
+            // The code only ever shrinks, so every offset still fits.
+            for (const auto& [at, target] : jumps)
+            {
+                const long delta = static_cast<long>(offsets[target]) -
+                                   static_cast<long>(at + 2);
+
+                chunk.patch_u16(
+                    at,
+                    static_cast<uint16_t>(static_cast<int16_t>(delta))
+                );
+            }
+        }
+
+        /*!
+         * Drops the instructions rewritten to `nop`s, moving jumps that
+         * landed on one to whatever follows it.
+         */
+        void compact(std::vector<Insn>& insns)
+        {
+            std::vector<uint32_t> remap(insns.size() + 1);
+            uint32_t kept = 0;
+
+            for (size_t i = 0; i < insns.size(); ++i)
+            {
+                remap[i] = kept;
+
+                if (insns[i].op != Opcode::nop)
+                {
+                    ++kept;
+                }
+            }
+
+            remap[insns.size()] = kept;
+            size_t out = 0;
+
+            for (Insn& insn : insns)
+            {
+                if (insn.op == Opcode::nop)
+                {
+                    continue;
+                }
+
+                if (is_jump(insn.op))
+                {
+                    insn.operand = remap[insn.operand];
+                }
+
+                insns[out++] = insn;
+            }
+
+            insns.resize(out);
+        }
+
+        void mark_targets(std::vector<Insn>& insns)
+        {
+            for (Insn& insn : insns)
+            {
+                insn.is_target = false;
+            }
+
+            for (const Insn& insn : insns)
+            {
+                if (is_jump(insn.op) && insn.operand < insns.size())
+                {
+                    insns[insn.operand].is_target = true;
+                }
+            }
+        }
+
+        /*!
+         * Rewrites whatever starts at `insns[i]`, returning whether anything
+         * changed. Rewrites that need another stack slot bump `max_stack`.
+         */
+        bool rewrite(std::vector<Insn>& insns, size_t i, uint16_t& max_stack)
+        {
+            Insn& a = insns[i];
+            Insn none = { Opcode::nop };
+
+            // Only `a` may be a jump target, so that the window runs
+            // straight through. Past that, the window only sees `nop`s,
+            // which match nothing.
+            const auto next = [&](size_t k) -> Insn& {
+                const size_t at = i + k;
+
+                return at < insns.size() && !insns[at].is_target
+                    ? insns[at]
+                    : none;
+            };
+
+            Insn& b = next(1);
+            Insn& c = next(2);
+
+            if (is_jump(a.op) && a.operand == i + 1)
+            {
+                a.op = Opcode::nop;
+
+                return true;
+            }
+
+            if (a.op == Opcode::ldc && b.op == Opcode::ldc)
+            {
+                const auto result = evaluate(c.op, a.value.value, b.value.value);
+
+                if (result)
+                {
+                    a.op = b.op = c.op = Opcode::nop;
+                    c = { Opcode::ldc, 0, *result };
+
+                    return true;
+                }
+            }
+
+            if (a.op == Opcode::ldc)
+            {
+                const auto result = evaluate(b.op, a.value.value);
+
+                if (result)
+                {
+                    a.op = Opcode::nop;
+                    b = { Opcode::ldc, 0, *result };
+
+                    return true;
+                }
+
+                if (b.op >= Opcode::ifeq && b.op <= Opcode::ifle)
+                {
+                    a.op = Opcode::nop;
+
+                    if (taken(b.op, a.value.value.i))
+                    {
+                        b.op = Opcode::goto_;
+                    }
+                    else
+                    {
+                        b.op = Opcode::nop;
+                    }
+
+                    return true;
+                }
+            }
+
+            if (
+                (a.op == Opcode::ldc || a.op == Opcode::load ||
+                 a.op == Opcode::dup) &&
+                b.op == Opcode::pop
+            ) {
+                a.op = b.op = Opcode::nop;
+
+                return true;
+            }
+
+            if (
+                a.op == Opcode::load  &&
+                b.op == Opcode::store &&
+                a.operand == b.operand
+            ) {
+                a.op = b.op = Opcode::nop;
+
+                return true;
+            }
+
+            if (
+                a.op == Opcode::store  &&
+                b.op == Opcode::load   &&
+                c.op == Opcode::store  &&
+                a.operand == b.operand &&
+                a.operand == c.operand
+            ) {
+                b.op = c.op = Opcode::nop;
+
+                return true;
+            }
+
+            if (
+                a.op == Opcode::store &&
+                b.op == Opcode::load  &&
+                a.operand == b.operand &&
+                max_stack < UINT16_MAX
+            ) {
+                const bool target = a.is_target;
+
+                b = a;
+                b.is_target = false;
+                a = { Opcode::dup };
+                a.is_target = target;
+                ++max_stack;
+
+                return true;
+            }
+
+            return false;
+        }
+    }
+
+    namespace opt
+    {
+        ir::Expr fold(const ir::Expr& e)
+        {
+            const ir::Node& n = e.val();
+            ir::Expr folded(n);
+            folded.reserve(e.child_count());
+
+            if (n.op == ir::Op::if_ || n.op == ir::Op::while_)
+            {
+                ir::Expr cond = fold(e[0]);
+
+                // Only the branch that runs is folded, and kept.
+                if (
+                    is_const(cond) &&
+                    (n.op == ir::Op::if_ || cond.val().value.i == 0)
+                ) {
+                    const size_t branch = cond.val().value.i != 0 ? 1 : 2;
+
+                    if (
+                        branch < e.child_count() &&
+                        e[branch].val().type == n.type
+                    ) {
+                        return fold(e[branch]);
+                    }
+
+                    // The `if` has no value, so neither may the branch.
+                    ir::Expr seq(ir::Node{ ir::Op::seq, ValueType::unit });
+
+                    if (branch < e.child_count())
+                    {
+                        seq.add_child(fold(e[branch]));
+                    }
+
+                    return seq;
+                }
+
+                folded.add_child(std::move(cond));
+            }
+
+            for (size_t i = folded.child_count(); i < e.child_count(); ++i)
+            {
+                folded.add_child(fold(e[i]));
+            }
+
+            switch (n.op)
+            {
+                case ir::Op::add:
+                case ir::Op::sub:
+                case ir::Op::mul:
+                case ir::Op::div:
+                case ir::Op::mod:
+                    if (is_const(folded[0]) && is_const(folded[1]))
+                    {
+                        const auto result = evaluate(
+                            opcode_of(n.op, n.type),
+                            folded[0].val().value,
+                            folded[1].val().value
+                        );
+
+                        if (result)
+                        {
+                            return const_expr(*result);
+                        }
+                    }
+
+                    break;
+                case ir::Op::neg:
+                case ir::Op::intToFloat:
+                case ir::Op::floatToInt:
+                    if (is_const(folded[0]))
+                    {
+                        const auto result = evaluate(
+                            opcode_of(n.op, n.type),
+                            folded[0].val().value
+                        );
+
+                        if (result)
+                        {
+                            return const_expr(*result);
+                        }
+                    }
+
+                    break;
+                case ir::Op::compare:
+                    if (is_const(folded[0]) && is_const(folded[1]))
+                    {
+                        return const_expr(int_constant(compare(
+                            n.cmp,
+                            folded[0].val().type,
+                            folded[0].val().value,
+                            folded[1].val().value
+                        )));
+                    }
+
+                    break;
+                default:
+                    break;
+            }
+
+            return folded;
+        }
+
+        void peephole(Chunk& chunk)
+        {
+            std::vector<Insn> insns = decode(chunk);
+
+            for (bool changed = true; changed;)
+            {
+                changed = false;
+                mark_targets(insns);
+
+                for (size_t i = 0; i < insns.size(); ++i)
+                {
+                    if (insns[i].op == Opcode::nop)
+                    {
+                        changed = true;
+
+                        continue;
+                    }
+
+                    if (rewrite(insns, i, chunk.max_stack))
+                    {
+                        changed = true;
+                    }
+                }
+
+                compact(insns);
+            }
+
+            encode(insns, chunk);
+        }
+    }
+}
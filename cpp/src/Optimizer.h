@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "Ir.h"
+
+namespace brouwer
+{
+    namespace opt
+    {
+        /*!
+         * Returns `e` with every operation on constants replaced by its
+         * result, and `if`s and `while`s on constant conditions reduced to
+         * the branch that runs. Results are computed exactly as the VM
+         * would, so integer division by a constant zero is left in place
+         * to fail at runtime.
+         */
+        ir::Expr fold(const ir::Expr& e);
+
+        /*!
+         * Rewrites short instruction sequences in `chunk` into cheaper
+         * ones: constant pushes followed by arithmetic become one push,
+         * `store_n; load_n` becomes `dup; store_n`, pushes that are popped
+         * straight away disappear, branches on constants become `goto`s (or
+         * nothing), and `nop`s and jumps to the next instruction are
+         * dropped. Nothing is rewritten across a jump target.
+         */
+        void peephole(Chunk& chunk);
+    }
+}
@@ -1,14 +1,30 @@
 #include <ctype.h>
 
-#include <fstream>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_set>
 #include <vector>
 
+#include "CharClass.h"
+#include "Dispatch.h"
+#include "Dump.h"
+#include "FlatAst.h"
+#include "Keyword.h"
 #include "Parser.h"
+#include "Scan.h"
+#include "Source.h"
 #include "Tree.h"
 #include "Token.h"
 
@@ -16,168 +32,1238 @@ namespace brouwer
 {
     using AST = Tree<Token>;
 
-    const std::unordered_set<char> Parser::esc_chars =
+#ifdef BROUWER_PROFILE_RULES
+    class Parser::Profiled
     {
-        '\'', '"', 't', 'v', 'n', 'r', 'b', '0'
-    };
+        public:
+            Profiled(Parser& p, TokenType profiled) noexcept
+                : parser(p)
+                , rule(profiled)
+                , outer(p.profiled_rule)
+                , start(std::chrono::steady_clock::now())
+            {
+                this->parser.rule_profiles[static_cast<size_t>(this->rule)]
+                    .attempts++;
+                this->parser.profiled_rule = this;
+            }
+
+            Profiled(const Profiled& that) = delete;
+
+            Profiled& operator=(const Profiled& that) = delete;
+
+            ~Profiled()
+            {
+                const uint64_t took = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - this->start
+                    ).count()
+                );
+                RuleProfile& stats =
+                    this->parser.rule_profiles[static_cast<size_t>(this->rule)];
+
+                (this->success ? stats.successes : stats.failures)++;
+                stats.total_ns += took;
+                stats.self_ns += took - std::min(took, this->nested_ns);
+
+                if (this->outer)
+                {
+                    this->outer->nested_ns += took;
+                }
+
+                this->parser.profiled_rule = this->outer;
+            }
+
+            void succeeded() noexcept
+            {
+                this->success = true;
+            }
+
+            TokenType profiled() const noexcept
+            {
+                return this->rule;
+            }
+
+        private:
+            Parser& parser;
+
+            TokenType rule;
+
+            Profiled* outer;
+
+            std::chrono::steady_clock::time_point start;
 
-    const std::unordered_set<char> Parser::op_chars =
+            uint64_t nested_ns = 0;
+
+            bool success = false;
+    };
+#else
+    class Parser::Profiled
     {
-        '?', '<', '>', '=', '%', '\\', '~', '!',
-        '@', '#', '$', '|', '&', '*',  '/', '+',
-        '^', '-', ':', ';'
+        public:
+            Profiled(Parser&, TokenType) noexcept {}
+
+            void succeeded() noexcept {}
     };
+#endif
 
-    const std::unordered_set<std::string> Parser::reserved_ops =
+    /*!
+     * Operators that are punctuation of some enclosing rule (`=`, `|`, `->`,
+     * `--`, ...) rather than operators in their own right.
+     */
+    static constexpr bool is_reserved_op(std::string_view op) noexcept
     {
-        ":", "->", "=>", "<-", "--", "|", "\\", "=",
-        ".", "::"
-    };
+        switch (op.size())
+        {
+            case 1:
+                switch (op[0])
+                {
+                    case ':': case '|': case '\\': case '=': case '.':
+                        return true;
+                    default:
+                        return false;
+                }
+            case 2:
+                return op == "->" || op == "=>" || op == "<-" ||
+                       op == "--" || op == "::";
+            default:
+                return false;
+        }
+    }
 
-    Parser::Parser(const std::string& filename) : charstream(filename.c_str())
+    /*!
+     * The alternatives of `subexpr`, in the order they are tried. Each kind
+     * of bracket has just one, which parses the first element once before
+     * telling its rules apart: `parened` stands for tuples too, `listLit`
+     * for list comprehensions, and `dictLit` for sets and comprehensions.
+     */
+    constexpr Parser::SubexprAlternative Parser::subexpr_alternatives[19] =
     {
-        this->currentindent = "";
+        { TokenType::var,       &Parser::parse_var },
+        { TokenType::assign,    &Parser::parse_assign },
+        { TokenType::fnDecl,    &Parser::parse_fnDecl },
+        { TokenType::parened,   &Parser::parse_parenthesized },
+        { TokenType::return_,   &Parser::parse_return },
+        { TokenType::case_,     &Parser::parse_case },
+        { TokenType::ifElse,    &Parser::parse_ifElse },
+        { TokenType::try_,      &Parser::parse_try },
+        { TokenType::while_,    &Parser::parse_while },
+        { TokenType::for_,      &Parser::parse_for },
+        { TokenType::lambda,    &Parser::parse_lambda },
+        { TokenType::listLit,   &Parser::parse_bracketed },
+        { TokenType::dictLit,   &Parser::parse_braced },
+        { TokenType::qualIdent, &Parser::parse_qualIdent },
+        { TokenType::infixed,   &Parser::parse_infixed },
+        { TokenType::numLit,    &Parser::parse_numLit },
+        { TokenType::chrLit,    &Parser::parse_chrLit },
+        { TokenType::strLit,    &Parser::parse_strLit },
+        { TokenType::op,        &Parser::parse_op }
+    };
 
-        this->ch = ' '; // Dummy value
+    constexpr std::array<uint32_t, 256> Parser::subexpr_dispatch =
+        build_dispatch(subexpr_alternatives);
 
-        if (!this->charstream.is_open())
+    constexpr std::array<uint32_t, token_type_count> Parser::subexpr_word_filter =
+        build_word_filter(subexpr_alternatives);
+
+    TextEdit TextEdit::between(std::string_view before,
+                               std::string_view after) noexcept
+    {
+        const size_t shorter = std::min(before.size(), after.size());
+        size_t prefix = 0;
+
+        while (prefix < shorter && before[prefix] == after[prefix])
         {
-            throw std::runtime_error("Failed to open " + filename);
+            ++prefix;
+        }
+
+        size_t suffix = 0;
+
+        while (
+            suffix < shorter - prefix &&
+            before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix]
+        ) {
+            ++suffix;
         }
+
+        return { prefix, before.size() - suffix, after.size() - suffix };
+    }
+
+    Parser::Parser(const std::string& filename, ParserOptions opts)
+        : Parser(Source::from_file(filename), opts) {}
+
+    Parser::Parser(Source src, ParserOptions opts)
+        : Parser(std::make_shared<const Source>(std::move(src)), opts) {}
+
+    Parser::Parser(std::shared_ptr<const Source> src, ParserOptions opts)
+        : options(opts), source(std::move(src))
+    {
+        this->buf = this->source->view();
+
+        rewind({ 0, 1, 0, {} });
     }
 
+    /*!
+     * Whether `str_repr` puts a space after a node of type `type`: all but
+     * the pieces of string and character literals are space-separated.
+     */
+    static bool spaced(TokenType type) noexcept
+    {
+        return type != TokenType::strChr      &&
+               type != TokenType::chrChr      &&
+               type != TokenType::doubleQuote &&
+               type != TokenType::singleQuote;
+    }
+
+    /*!
+     * A node with a lexeme stands for its whole subtree; the text of any
+     * other node is that of its children, in order.
+     */
     std::string Parser::str_repr(const AST& ast) noexcept
     {
-        if (!ast.val().lexeme.empty())
+        std::string ret = "";
+
+        ast.walk(
+            [&ret](const AST& node, size_t) {
+                ret += node.val().lexeme;
+
+                return node.val().lexeme.empty();
+            },
+            [&ret](const AST& node, size_t depth) {
+                if (depth > 0 && spaced(node.val().type))
+                {
+                    ret.push_back(' ');
+                }
+            }
+        );
+
+        return ret;
+    }
+
+    void Parser::log_depthfirst(const AST& ast,
+                                size_t cur_depth,
+                                std::ostream& out)
+    {
+        Dumper(out).dump(ast, cur_depth);
+    }
+
+    std::string Parser::str_repr(const FlatAst& ast, NodeId id) noexcept
+    {
+        std::string ret = "";
+
+        ast.walk(
+            id,
+            [&ret, &ast](NodeId node, size_t) {
+                const std::string_view lex = ast.lexeme(node);
+                ret += lex;
+
+                return lex.empty();
+            },
+            [&ret, &ast](NodeId node, size_t depth) {
+                if (depth > 0 && spaced(ast.type(node)))
+                {
+                    ret.push_back(' ');
+                }
+            }
+        );
+
+        return ret;
+    }
+
+    void Parser::log_depthfirst(const FlatAst& ast,
+                                NodeId id,
+                                size_t cur_depth,
+                                std::ostream& out)
+    {
+        Dumper(out).dump(ast, id, cur_depth);
+    }
+
+    /*!
+     * Parses the whole source and then packs the result into a `FlatAst`, so
+     * only the arena stays resident once this returns.
+     */
+    std::optional<FlatAst> Parser::parse_flat()
+    {
+        std::optional<AST> ast = parse();
+
+        if (!ast)
         {
-            return ast.val().lexeme;
+            return {};
         }
 
-        std::string ret = "";
-        const size_t child_count = ast.child_count();
+        return FlatAst::from_tree(
+            *ast,
+            this->source,
+            this->options.share_subtrees
+        );
+    }
 
-        for (size_t i = 0; i < child_count; ++i)
+    std::optional<AST> Parser::parse()
+    {
+        if (!parser_stack_fits(this->options))
         {
-            const AST& child_ast = ast.get_child(i);
-            ret += str_repr(child_ast);
+            return on_parser_stack(this->options, [&]() { return parse(); });
+        }
+
+        AST mainAst({ TokenType::root, "" });
+        AST prog({ TokenType::prog, "" });
+
+        begin(true);
+        parse_prog([&](AST item) { prog.add_child(std::move(item)); });
 
-            const TokenType child_type = child_ast.val().type;
+        mainAst.reserve(1);
+        mainAst.add_child(std::move(prog));
+        this->items_valid = true;
+
+        return mainAst;
+    }
+
+    size_t Parser::parse_each(const std::function<void(AST)>& consume)
+    {
+        if (!parser_stack_fits(this->options))
+        {
+            return on_parser_stack(this->options, [&]() {
+                return parse_each(consume);
+            });
+        }
 
+        size_t count = 0;
+
+        begin(false);
+        parse_prog([&](AST item) {
+            ++count;
+            consume(std::move(item));
+        });
+
+        return count;
+    }
+
+    /*!
+     * Chunks any smaller than this aren't worth a worker's time.
+     */
+    static constexpr size_t min_chunk_size = 256 * 1024;
+
+    std::optional<AST> Parser::parse_parallel(ThreadPool& pool)
+    {
+        if (!parser_stack_fits(this->options))
+        {
+            return on_parser_stack(this->options, [&]() {
+                return parse_parallel(pool);
+            });
+        }
+
+        AST mainAst({ TokenType::root, "" });
+        AST prog({ TokenType::prog, "" });
+        const std::function<void(AST)> add = [&](AST item) {
+            prog.add_child(std::move(item));
+        };
+
+        begin(false);
+        parse_header(add);
+
+        // A few chunks per worker, so that a slow one doesn't hold up the
+        // rest for long.
+        const size_t chunks = std::min(
+            pool.size() * 4,
+            (this->buf.size() - this->pos) / min_chunk_size
+        );
+        const std::vector<Cursor> starts = chunks > 1
+            ? split_points(this->buf, mark(), chunks)
+            : std::vector<Cursor>();
+        const auto stop_of = [&](size_t i) {
+            return i < starts.size() ? starts[i].pos : SIZE_MAX;
+        };
+        std::vector<std::future<Chunk>> parsed;
+
+        parsed.reserve(starts.size());
+
+        for (size_t i = 0; i < starts.size(); ++i)
+        {
+            parsed.push_back(pool.submit(
+                [text = this->source,
+                 opts = this->options,
+                 start = starts[i],
+                 stop = stop_of(i + 1)]() {
+                    return parse_chunk(text, opts, start, stop);
+                }
+            ));
+        }
+
+        // The stretch before the first split is parsed here meanwhile.
+        bool complete = parse_items(add, stop_of(0));
+
+        for (size_t i = 0; i < parsed.size() && complete; ++i)
+        {
+            Chunk chunk = parsed[i].get();
+
+            this->stats.hits += chunk.stats.hits;
+            this->stats.misses += chunk.stats.misses;
+
+#ifdef BROUWER_PROFILE_RULES
+            for (size_t r = 0; r < this->rule_profiles.size(); ++r)
+            {
+                RuleProfile& into = this->rule_profiles[r];
+                const RuleProfile& from = chunk.profile[r];
+
+                into.attempts += from.attempts;
+                into.successes += from.successes;
+                into.failures += from.failures;
+                into.rewound += from.rewound;
+                into.total_ns += from.total_ns;
+                into.self_ns += from.self_ns;
+            }
+#endif
+
+            // The chunk is only good if the text before it, parsed in order,
+            // ended exactly where it began. Otherwise it was split inside an
+            // item, and its stretch is parsed again from where that item
+            // really ended.
             if (
-                child_type != TokenType::strChr      &&
-                child_type != TokenType::chrChr      &&
-                child_type != TokenType::doubleQuote &&
-                child_type != TokenType::singleQuote
+                this->pos != chunk.start.pos        ||
+                this->lineno != chunk.start.line    ||
+                !this->currentindent.empty()
             ) {
-                ret.push_back(' ');
+                complete = parse_items(add, stop_of(i + 1));
+
+                continue;
+            }
+
+            if (chunk.error)
+            {
+                std::rethrow_exception(chunk.error);
             }
+
+            adopt(chunk, add);
+            rewind(chunk.end);
+            complete = chunk.complete;
         }
 
-        return ret;
+        mainAst.reserve(1);
+        mainAst.add_child(std::move(prog));
+
+        return mainAst;
     }
 
-    void Parser::log_depthfirst(const AST& ast, size_t cur_depth)
+    /*!
+     * Up to `chunks - 1` places after `from` to split `text` at, about
+     * evenly spaced: the starts of unindented lines that begin outside any
+     * string literal or comment, and don't carry on the item before them
+     * (with `else` or `catch`). This is only a guess at where items start;
+     * `parse_parallel` checks it.
+     */
+    std::vector<Parser::Cursor> Parser::split_points(std::string_view text,
+                                                     const Cursor& from,
+                                                     size_t chunks)
     {
-        for (size_t i = 0; i < cur_depth; ++i)
+        const size_t spacing = (text.size() - from.pos) / chunks;
+        const auto starts_item = [&](size_t at) {
+            if (at >= text.size() || isspace(text[at]))
+            {
+                return false;
+            }
+
+            size_t end = at;
+
+            while (
+                end < text.size() && (isalnum(text[end]) || text[end] == '_')
+            ) {
+                ++end;
+            }
+
+            const TokenType word = classify_word(text.substr(at, end - at));
+
+            return word != TokenType::elseKeyword &&
+                   word != TokenType::catchKeyword;
+        };
+
+        std::vector<Cursor> points;
+        size_t next = from.pos + spacing;
+        size_t line = from.line;
+        bool in_string = false;
+
+        for (
+            size_t at = from.pos;
+            at < text.size() && points.size() + 1 < chunks;
+            ++at
+        ) {
+            const char c = text[at];
+
+            if (in_string)
+            {
+                if (c == '\\' && at + 1 < text.size() && text[at + 1] != '\n')
+                {
+                    ++at;
+                }
+                else if (c == '"')
+                {
+                    in_string = false;
+                }
+                else if (c == '\n')
+                {
+                    ++line;
+                }
+
+                continue;
+            }
+
+            switch (c)
+            {
+                case '"':
+                    in_string = true;
+                    break;
+
+                case '\'':
+                    // Up to the closing quote, which would otherwise open
+                    // another literal.
+                    if (at + 1 < text.size())
+                    {
+                        line += text[at + 1] == '\n';
+                        at += text[at + 1] == '\\' ? 3 : 2;
+                    }
+                    break;
+
+                case '-':
+                    if (at + 1 < text.size() && text[at + 1] == '-')
+                    {
+                        at = scan::find_line_end(text, at) - 1;
+                    }
+                    break;
+
+                case '\n':
+                    ++line;
+
+                    if (at + 1 >= next && starts_item(at + 1))
+                    {
+                        points.push_back({ at + 1, line, at + 1, {} });
+                        next = at + 1 + spacing;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        return points;
+    }
+
+    /*!
+     * Parses the items of `text` from `start` (the start of an unindented
+     * line) until one ends at or past `stop`, on a parser of its own.
+     */
+    Parser::Chunk Parser::parse_chunk(std::shared_ptr<const Source> text,
+                                      const ParserOptions& opts,
+                                      const Cursor& start,
+                                      size_t stop)
+    {
+        if (!parser_stack_fits(opts))
         {
-            std::cout << "  ";
+            return on_parser_stack(opts, [&]() {
+                return parse_chunk(std::move(text), opts, start, stop);
+            });
         }
 
-        const std::string& lex = ast.val().lexeme;
+        Parser parser(std::move(text), opts);
+        Chunk chunk;
 
-        if (lex.empty())
+        chunk.start = start;
+        parser.rewind(start);
+
+        try
         {
-            std::cout << u8" └─ "
-                      << token_type_names.at(ast.val().type)
-                      << '\n';
+            chunk.complete = parser.parse_items(
+                [&](AST item) { chunk.items.push_back(std::move(item)); },
+                stop
+            );
         }
-        else
+        catch (...)
         {
-            std::cout << u8" └─ "
-                      << token_type_names.at(ast.val().type)
-                      << " \""
-                      << lex
-                      << "\"\n";
+            chunk.error = std::current_exception();
         }
 
-        const size_t child_count = ast.child_count();
+        chunk.end = parser.mark();
+        chunk.symbols = std::move(parser.symbol_table);
+        chunk.stats = parser.stats;
+        chunk.profile = parser.rule_profiles;
+
+        return chunk;
+    }
+
+    /*!
+     * Renumbers the symbols of `tree` through `ids`.
+     */
+    static void relabel(Tree<Token>& tree,
+                        const std::vector<SymbolId>& ids) noexcept
+    {
+        std::vector<Tree<Token>*> stack = { &tree };
 
-        for (size_t i = 0; i < child_count; ++i)
+        while (!stack.empty())
         {
-            log_depthfirst(ast.get_child(i), cur_depth + 1);
+            Tree<Token>& node = *stack.back();
+            stack.pop_back();
+
+            SymbolId& symbol = node.val().symbol;
+
+            if (symbol != no_symbol)
+            {
+                symbol = ids[symbol];
+            }
+
+            for (size_t i = 0; i < node.child_count(); ++i)
+            {
+                stack.push_back(&node.get_child(i));
+            }
         }
     }
 
-    std::optional<AST> Parser::parse()
+    /*!
+     * Hands the items of a chunk that lines up to `emit`, with their symbols
+     * interned here. Interning the chunk's names in the order it first met
+     * them gives each the id that parsing everything here would have.
+     */
+    void Parser::adopt(Chunk& chunk, const std::function<void(AST)>& emit)
     {
-        char last_ch = '\0';
+        std::vector<SymbolId> ids(chunk.symbols.size());
+        bool same = true;
 
-        while (this->charstream >> std::noskipws >> this->ch)
+        for (SymbolId id = 0; id < ids.size(); ++id)
         {
-            if (!isspace(this->ch))
+            ids[id] = this->symbol_table.intern(chunk.symbols.name(id));
+            same = same && ids[id] == id;
+        }
+
+        for (AST& item : chunk.items)
+        {
+            if (!same)
             {
-                break;
+                relabel(item, ids);
             }
 
+            emit(std::move(item));
+        }
+    }
+
+    /*!
+     * Readies a fresh parse of the whole source, up to its first token.
+     * Only a parse whose tree `reparse` may be handed later needs to `track`
+     * where its items start.
+     */
+    void Parser::begin(bool track, bool recover_errors)
+    {
+        this->items_valid = false;
+        this->tracking = track;
+        this->recovering = recover_errors;
+        this->failed = false;
+        this->diagnostics.clear();
+        this->items.clear();
+        this->generations.assign(1, { this->source, 0 });
+        this->header_generation = 0;
+
+        char last_ch = '\0';
+
+        while (isspace(this->ch))
+        {
             last_ch = this->ch;
+            advance();
         }
 
         if (last_ch != '\0' && !isnewline(last_ch))
         {
-            throw std::runtime_error(
+            fail(
+                TokenType::root,
                 "source must not start with leading whitespace"
             );
+            recover(0);
+        }
+    }
+
+    ParseResult Parser::parse_recovering()
+    {
+        if (!parser_stack_fits(this->options))
+        {
+            return on_parser_stack(this->options, [&]() {
+                return parse_recovering();
+            });
         }
 
         AST mainAst({ TokenType::root, "" });
-        std::optional<AST> prog = parse_prog();
+        AST prog({ TokenType::prog, "" });
+
+        begin(false, true);
+        parse_prog([&](AST item) { prog.add_child(std::move(item)); });
+        this->recovering = false;
+
+        mainAst.reserve(1);
+        mainAst.add_child(std::move(prog));
+
+        return { std::move(mainAst), std::move(this->diagnostics) };
+    }
 
-        if (!prog)
+    /*!
+     * Reports a malformed input. Unless recovering, that means throwing;
+     * otherwise the first error of the item is recorded, and from then on
+     * the parser looks as if it were at the end of the input, at the start
+     * of a line, so that every rule still on the stack fails (or finishes)
+     * straight away instead of unwinding. `rewind` can't move it back until
+     * `recover`.
+     */
+    std::nullopt_t Parser::fail(TokenType rule, std::string message)
+    {
+        if (!this->recovering)
         {
-            return {};
+            throw std::runtime_error(message);
         }
 
-        mainAst.add_child(std::move(*prog));
+        if (!this->failed)
+        {
+            this->diagnostics.push_back({
+                rule,
+                this->pos,
+                line_number(),
+                column_number(),
+                std::move(message)
+            });
 
-        return mainAst;
+            this->failed = true;
+            this->pos = this->buf.size();
+            this->line_start = this->pos;
+            this->currentindent = {};
+            this->ch = '\0';
+        }
+
+        return std::nullopt;
     }
 
-    std::optional<AST> Parser::parse_prog()
+    std::nullopt_t Parser::too_deep(TokenType rule)
     {
-        AST prog({ TokenType::prog, "" });
+        return fail(
+            rule,
+            "nesting exceeds the limit of " +
+                std::to_string(this->options.max_depth) + " levels"
+        );
+    }
+
+    /*!
+     * Clears the failure of the item that began at `from`, and resumes at the
+     * next top-level (unindented) line after the error. That can be the
+     * error's own line, when it was only noticed there, past the item's
+     * first line.
+     */
+    void Parser::recover(size_t from) noexcept
+    {
+        const Diagnostic& error = this->diagnostics.back();
+        const size_t error_line_start = error.offset - (error.column - 1);
+        const auto starts_item = [&](size_t at) {
+            return at < this->buf.size()     &&
+                   !isblank(this->buf[at])   &&
+                   !isnewline(this->buf[at]);
+        };
+
+        size_t resume = error_line_start;
+        size_t line = error.line;
+
+        if (resume <= from || !starts_item(resume))
+        {
+            resume = error.offset;
+
+            do
+            {
+                resume = this->buf.find('\n', resume);
+
+                if (resume == std::string_view::npos)
+                {
+                    resume = this->buf.size();
+
+                    break;
+                }
+
+                ++resume;
+                ++line;
+            } while (resume < this->buf.size() && !starts_item(resume));
+        }
+
+        this->failed = false;
+        this->memo.clear();
+        this->pattern_ends.clear();
+        rewind({ resume, line, resume, {} });
+    }
+
+    /*!
+     * Points the lexemes of `tree` that view `from` at the same bytes of
+     * `to`, `shift` bytes further on.
+     */
+    static void rebase(Tree<Token>& tree,
+                       std::string_view from,
+                       std::string_view to,
+                       size_t shift) noexcept
+    {
+        const char* const base = from.data();
+        std::vector<Tree<Token>*> stack = { &tree };
+
+        while (!stack.empty())
+        {
+            Tree<Token>& node = *stack.back();
+            stack.pop_back();
+
+            std::string_view& lex = node.val().lexeme;
+
+            if (
+                !lex.empty()                          &&
+                lex.data() >= base                    &&
+                lex.data() + lex.size() <= base + from.size()
+            ) {
+                lex = to.substr(
+                    static_cast<size_t>(lex.data() - base) + shift,
+                    lex.size()
+                );
+            }
+
+            for (size_t i = 0; i < node.child_count(); ++i)
+            {
+                stack.push_back(&node.get_child(i));
+            }
+        }
+    }
+
+    /*!
+     * How many earlier texts a reparsed tree may keep viewing. Past this,
+     * the items of the least used one are rebased onto the current text.
+     */
+    static constexpr size_t max_generations = 8;
+
+    std::optional<AST> Parser::reparse(AST previous,
+                                       Source updated,
+                                       const TextEdit& edit)
+    {
+        if (!parser_stack_fits(this->options))
+        {
+            return on_parser_stack(this->options, [&]() {
+                return reparse(std::move(previous), std::move(updated), edit);
+            });
+        }
+
+        const std::string_view old_buf = this->buf;
+
+        this->source = std::make_shared<const Source>(std::move(updated));
+        this->buf = this->source->view();
+        this->reparse_counts = ReparseStats();
+
+        const size_t item_count = this->items.size();
+
+        // How many items start at or before the edit.
+        const size_t edited = static_cast<size_t>(
+            std::upper_bound(
+                this->items.begin(),
+                this->items.end(),
+                edit.start,
+                [](size_t at, const Item& item) { return at < item.start.pos; }
+            ) - this->items.begin()
+        );
+
+        // An edit to the item before the first line could turn that line
+        // into a header item (an import, say), so only items from the second
+        // line on are ever parsed on their own.
+        if (
+            !this->items_valid                                 ||
+            edit.start > edit.old_end                          ||
+            edit.start > edit.new_end                          ||
+            edit.old_end > old_buf.size()                      ||
+            edit.new_end > this->buf.size()                    ||
+            old_buf.size() - (edit.old_end - edit.start) !=
+                this->buf.size() - (edit.new_end - edit.start) ||
+            previous.child_count() != 1                        ||
+            previous.get_child(0).child_count() < item_count   ||
+            edited < 2
+        ) {
+            this->restart();
+            this->reparse_counts.full = true;
+
+            return parse();
+        }
+
+        // The item before the edited one is parsed again as well, as the edit
+        // may have indented the edited line into that item's block.
+        const size_t first = edited - 2;
+        const size_t delta_pos = edit.new_end - edit.old_end;
+        const size_t delta_lines = static_cast<size_t>(
+            std::count(
+                this->buf.begin() + edit.start,
+                this->buf.begin() + edit.new_end,
+                '\n'
+            ) -
+            std::count(
+                old_buf.begin() + edit.start,
+                old_buf.begin() + edit.old_end,
+                '\n'
+            )
+        );
+
+        AST& prog = previous.get_child(0);
+        std::vector<AST> old_items = prog.take_children();
+        const size_t header_count = old_items.size() - item_count;
+        std::vector<AST> kept;
+        std::vector<Item> old_starts;
+
+        old_starts.swap(this->items);
+        this->items_valid = false;
+        this->generations.push_back({ this->source, 0 });
+        kept.reserve(old_items.size());
+
+        // Reused items keep viewing the text they were parsed from, which
+        // holds the same bytes, so nothing but their starts need moving.
+        for (size_t i = 0; i < header_count + first; ++i)
+        {
+            kept.push_back(std::move(old_items[i]));
+        }
+
+        for (size_t i = 0; i < first; ++i)
+        {
+            this->items.push_back(moved(old_starts[i], 0, 0));
+        }
+
+        this->restart();
+        rewind(moved(old_starts[first], 0, 0).start);
+        prog.set_children(std::move(kept));
 
+        size_t resumed = item_count;
+        const std::function<void(AST)> add = [&](AST item) {
+            prog.add_child(std::move(item));
+        };
+
+        while (!at_end())
+        {
+            // Past the edit, identical state at the start of an old item
+            // means that everything from there on parses just as it did.
+            if (this->line_start >= edit.new_end)
+            {
+                const size_t old_pos = this->pos - delta_pos;
+                const auto found = std::lower_bound(
+                    old_starts.begin() + first,
+                    old_starts.end(),
+                    old_pos,
+                    [](const Item& item, size_t at) {
+                        return item.start.pos < at;
+                    }
+                );
+
+                if (
+                    found != old_starts.end()                                &&
+                    found->start.pos == old_pos                              &&
+                    found->start.line_start == this->line_start - delta_pos  &&
+                    found->start.indent.size() == this->currentindent.size()
+                ) {
+                    resumed = static_cast<size_t>(found - old_starts.begin());
+
+                    break;
+                }
+            }
+
+            ++this->reparse_counts.reparsed;
+
+            if (!parse_item(add))
+            {
+                break;
+            }
+        }
+
+        for (size_t i = resumed; i < item_count; ++i)
+        {
+            prog.add_child(std::move(old_items[header_count + i]));
+            this->items.push_back(moved(old_starts[i], delta_pos, delta_lines));
+        }
+
+        this->reparse_counts.reused = first + (item_count - resumed);
+        this->items_valid = true;
+        retire_generations(prog);
+
+        return previous;
+    }
+
+    /*!
+     * `item`, from before an edit, as it lies in the current text: `shift`
+     * bytes and `lines` lines further on.
+     */
+    Parser::Item Parser::moved(const Item& item,
+                               size_t shift,
+                               size_t lines) const noexcept
+    {
+        const size_t at = item.start.pos + shift;
+        const size_t indent = item.start.indent.size();
+
+        return {
+            {
+                at,
+                item.start.line + lines,
+                item.start.line_start + shift,
+                this->buf.substr(at - indent, indent)
+            },
+            item.generation,
+            item.origin
+        };
+    }
+
+    /*!
+     * Drops the texts that no item views any more, and rebases the items of
+     * the least used ones onto the current text while there are too many.
+     */
+    void Parser::retire_generations(AST& prog)
+    {
+        const uint32_t current =
+            static_cast<uint32_t>(this->generations.size() - 1);
+        const size_t header_count = prog.child_count() - this->items.size();
+
+        for (Generation& generation : this->generations)
+        {
+            generation.items = 0;
+        }
+
+        ++this->generations[this->header_generation].items;
+
+        for (const Item& item : this->items)
+        {
+            ++this->generations[item.generation].items;
+        }
+
+        size_t live = 0;
+
+        for (const Generation& generation : this->generations)
+        {
+            live += generation.items > 0;
+        }
+
+        for (; live > max_generations; --live)
+        {
+            uint32_t fewest = current;
+
+            for (uint32_t g = 0; g < current; ++g)
+            {
+                const size_t count = this->generations[g].items;
+
+                if (
+                    count > 0 && g != this->header_generation &&
+                    (fewest == current || count < this->generations[fewest].items)
+                ) {
+                    fewest = g;
+                }
+            }
+
+            if (fewest == current)
+            {
+                break;
+            }
+
+            const std::string_view from = this->generations[fewest].text->view();
+
+            for (size_t i = 0; i < this->items.size(); ++i)
+            {
+                Item& item = this->items[i];
+
+                if (item.generation != fewest)
+                {
+                    continue;
+                }
+
+                rebase(
+                    prog.get_child(header_count + i),
+                    from,
+                    this->buf,
+                    item.start.pos - item.origin
+                );
+                item.generation = current;
+                item.origin = item.start.pos;
+                ++this->generations[current].items;
+            }
+
+            this->generations[fewest].items = 0;
+        }
+
+        std::vector<uint32_t> renumbered(this->generations.size());
+        uint32_t next = 0;
+
+        for (uint32_t g = 0; g < this->generations.size(); ++g)
+        {
+            renumbered[g] = next;
+
+            if (this->generations[g].items > 0)
+            {
+                this->generations[next++] = std::move(this->generations[g]);
+            }
+        }
+
+        this->generations.resize(next);
+        this->header_generation = renumbered[this->header_generation];
+
+        for (Item& item : this->items)
+        {
+            item.generation = renumbered[item.generation];
+        }
+    }
+
+    const ReparseStats& Parser::reparse_stats() const noexcept
+    {
+        return this->reparse_counts;
+    }
+
+    const MemoStats& Parser::memo_stats() const noexcept
+    {
+        return this->stats;
+    }
+
+    const RuleProfiles& Parser::rule_profile() const noexcept
+    {
+        return this->rule_profiles;
+    }
+
+    bool Parser::profiling() noexcept
+    {
+#ifdef BROUWER_PROFILE_RULES
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    const std::shared_ptr<const Source>& Parser::shared_source() const noexcept
+    {
+        return this->source;
+    }
+
+    const SymbolTable& Parser::symbols() const noexcept
+    {
+        return this->symbol_table;
+    }
+
+    /*!
+     * Parses the items of `prog` (the module declaration, imports, and then
+     * lines), handing each to `emit` as soon as it is complete.
+     */
+    void Parser::parse_prog(const std::function<void(AST)>& emit)
+    {
+        parse_header(emit);
+        parse_items(emit, SIZE_MAX);
+    }
+
+    /*!
+     * Parses the module declaration and imports, if any.
+     */
+    void Parser::parse_header(const std::function<void(AST)>& emit)
+    {
+        const size_t header_start = this->pos;
         std::optional<AST> module_decl = parse_modDecl();
 
-        if (module_decl)
+        if (this->failed)
         {
-            prog.add_child(std::move(*module_decl));
+            recover(header_start);
+        }
+        else if (module_decl)
+        {
+            emit(std::move(*module_decl));
         }
 
-        while (!this->charstream.eof() || !this->charhistory.empty())
+        while (!at_end())
         {
+            const size_t import_start = this->pos;
             std::optional<AST> import = parse_import();
 
+            if (this->failed)
+            {
+                recover(import_start);
+
+                continue;
+            }
+
             if (!import)
             {
                 break;
             }
 
-            prog.add_child(std::move(*import));
+            emit(std::move(*import));
         }
+    }
 
-        while (!this->charstream.eof() || !this->charhistory.empty())
+    /*!
+     * Parses top-level lines until one ends at or past `stop`, or the input
+     * does. Returns false if a line doesn't parse, which ends the parse.
+     */
+    bool Parser::parse_items(const std::function<void(AST)>& emit,
+                             size_t stop)
+    {
+        while (!at_end() && this->pos < stop)
         {
-            std::optional<AST> line = parse_line(true);
+            if (!parse_item(emit))
+            {
+                return false;
+            }
+        }
 
-            if (!line)
+        return true;
+    }
+
+    /*!
+     * Parses one top-level line (and any block hanging off it) and hands it
+     * to `emit`, recording where it started if tracking.
+     */
+    bool Parser::parse_item(const std::function<void(AST)>& emit)
+    {
+        // Top-level lines never backtrack into one another, so nothing
+        // memoized for an earlier line can be looked up again.
+        this->memo.clear();
+        this->pattern_ends.clear();
+
+        const size_t line_start_pos = this->pos;
+
+        if (this->tracking)
+        {
+            this->items.push_back({
+                mark(),
+                static_cast<uint32_t>(this->generations.size() - 1),
+                this->pos
+            });
+        }
+
+        std::optional<AST> line = parse_line(true);
+
+        if (line && !this->failed && this->pos == line_start_pos)
+        {
+            std::string err_msg = "unexpected character: ";
+            err_msg += this->ch;
+
+            fail(TokenType::line, err_msg);
+        }
+
+        if (!line || this->failed)
+        {
+            if (this->tracking)
             {
-                break;
+                this->items.pop_back();
             }
 
-            prog.add_child(std::move(*line));
+            if (!this->failed)
+            {
+                return false;
+            }
+
+            // Only when recovering: the line is dropped, and parsing goes on
+            // from the next one.
+            recover(line_start_pos);
+
+            return true;
         }
 
-        return prog;
+        emit(std::move(*line));
+
+        return true;
+    }
+
+    /*!
+     * Forgets everything cached about the text, as after it changes.
+     */
+    void Parser::restart() noexcept
+    {
+        this->failed = false;
+        this->memo.clear();
+        this->pattern_ends.clear();
+        this->word_pos = SIZE_MAX;
+        rewind({ 0, 1, 0, {} });
     }
 
     std::optional<AST> Parser::parse_modDecl()
@@ -196,7 +1282,8 @@ namespace brouwer
 
         if (!mod_name)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::modDecl,
                 "expected name of module to be plain identifier"
             );
         }
@@ -227,7 +1314,8 @@ namespace brouwer
 
             if (!first_ident)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::modDecl,
                     "expected at least one item in module export/hide list"
                 );
             }
@@ -254,7 +1342,8 @@ namespace brouwer
 
         if (!expect_newline())
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::modDecl,
                 "expected newline after module declaration"
             );
         }
@@ -278,7 +1367,8 @@ namespace brouwer
 
         if (!mod_name)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::import,
                 "expected module name after import keyword"
             );
         }
@@ -296,7 +1386,8 @@ namespace brouwer
 
             if (!qual_name)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::import,
                     "expected namespace alias after as keyword"
                 );
             }
@@ -318,7 +1409,8 @@ namespace brouwer
 
             if (!l_paren)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::import,
                     "expected left paren to start import list"
                 );
             }
@@ -329,7 +1421,8 @@ namespace brouwer
 
             if (!first_import_item)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::import,
                     "expected at least one import item in import list"
                 );
             }
@@ -359,7 +1452,8 @@ namespace brouwer
 
             if (!r_paren)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::import,
                     "expected right paren to terminate import list"
                 );
             }
@@ -369,7 +1463,8 @@ namespace brouwer
 
         if (!expect_newline())
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::import,
                 "expected newline after import statement"
             );
         }
@@ -379,15 +1474,20 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_line(bool consume_newline)
     {
+        Profiled profile(*this, TokenType::line);
+
         consume_blanks();
 
         AST line({ TokenType::line, "" });
 
-        std::optional<AST> expr = parse_expr();
-
-        if (expr)
+        if (subexpr_dispatch[static_cast<unsigned char>(this->ch)] != 0)
         {
-            line.add_child(std::move(*expr));
+            std::optional<AST> expr = parse_expr();
+
+            if (expr)
+            {
+                line.add_child(std::move(*expr));
+            }
         }
 
         consume_lineComment(consume_newline);
@@ -397,6 +1497,8 @@ namespace brouwer
             expect_newline();
         }
 
+        profile.succeeded();
+
         return line;
     }
 
@@ -409,43 +1511,11 @@ namespace brouwer
             return false;
         }
 
-        if (isnewline(this->ch))
-        {
-            if (consume_newline)
-            {
-                expect_newline();
-            }
-
-            return true;
-        }
-
-        while (!this->charhistory.empty())
-        {
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
+        skip_to(scan::find_line_end(this->buf, this->pos));
 
-            if (isnewline(this->ch))
-            {
-                if (consume_newline)
-                {
-                    expect_newline();
-                }
-
-                return true;
-            }
-        }
-
-        while (this->charstream >> std::noskipws >> this->ch)
+        if (consume_newline)
         {
-            if (isnewline(this->ch))
-            {
-                if (consume_newline)
-                {
-                    expect_newline();
-                }
-
-                return true;
-            }
+            expect_newline();
         }
 
         return true;
@@ -453,6 +1523,8 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_expr()
     {
+        Profiled profile(*this, TokenType::expr);
+
         consume_blanks();
 
         std::optional<AST> first_subexpr = parse_subexpr();
@@ -465,122 +1537,152 @@ namespace brouwer
         AST expr({ TokenType::expr, "" });
         expr.add_child(std::move(*first_subexpr));
 
-        while (std::optional<AST> subexpr = parse_subexpr())
+        // A subexpression that ends in a block also ends the line it started
+        // on, and with it the expression.
+        while (!at_line_start())
         {
+            std::optional<AST> subexpr = parse_subexpr();
+
+            if (!subexpr)
+            {
+                break;
+            }
+
             expr.add_child(std::move(*subexpr));
         }
 
+        profile.succeeded();
+
         return expr;
     }
 
     std::optional<AST> Parser::parse_subexpr()
     {
-        consume_blanks();
-
-        AST subexpr({ TokenType::subexpr, "" });
+        Profiled profile(*this, TokenType::subexpr);
+        const Nesting level(*this);
 
-        if (std::optional<AST> var = parse_var())
-        {
-            subexpr.add_child(std::move(*var));
-        }
-        else if (std::optional<AST> assign = parse_assign())
-        {
-            subexpr.add_child(std::move(*assign));
-        }
-        else if (std::optional<AST> fnDecl = parse_fnDecl())
-        {
-            subexpr.add_child(std::move(*fnDecl));
-        }
-        else if (std::optional<AST> parened = parse_parened())
-        {
-            subexpr.add_child(std::move(*parened));
-        }
-        else if (std::optional<AST> return_ = parse_return())
-        {
-            subexpr.add_child(std::move(*return_));
-        }
-        else if (std::optional<AST> case_ = parse_case())
-        {
-            subexpr.add_child(std::move(*case_));
-        }
-        else if (std::optional<AST> ifElse = parse_ifElse())
-        {
-            subexpr.add_child(std::move(*ifElse));
-        }
-        else if (std::optional<AST> try_ = parse_try())
-        {
-            subexpr.add_child(std::move(*try_));
-        }
-        else if (std::optional<AST> while_ = parse_while())
-        {
-            subexpr.add_child(std::move(*while_));
-        }
-        else if (std::optional<AST> for_ = parse_for())
-        {
-            subexpr.add_child(std::move(*for_));
-        }
-        else if (std::optional<AST> lambda = parse_lambda())
-        {
-            subexpr.add_child(std::move(*lambda));
-        }
-        else if (std::optional<AST> tupleLit = parse_tupleLit())
-        {
-            subexpr.add_child(std::move(*tupleLit));
-        }
-        else if (std::optional<AST> listLit = parse_listLit())
+        if (level.exceeded())
         {
-            subexpr.add_child(std::move(*listLit));
+            return too_deep(TokenType::subexpr);
         }
-        else if (std::optional<AST> listComp = parse_listComp())
-        {
-            subexpr.add_child(std::move(*listComp));
-        }
-        else if (std::optional<AST> dictLit = parse_dictLit())
-        {
-            subexpr.add_child(std::move(*dictLit));
-        }
-        else if (std::optional<AST> dictComp = parse_dictComp())
-        {
-            subexpr.add_child(std::move(*dictComp));
-        }
-        else if (std::optional<AST> setLit = parse_setLit())
-        {
-            subexpr.add_child(std::move(*setLit));
-        }
-        else if (std::optional<AST> setComp = parse_setComp())
+
+        consume_blanks();
+
+        uint32_t candidates =
+            subexpr_dispatch[static_cast<unsigned char>(this->ch)];
+
+        if (first::identifier(static_cast<unsigned char>(this->ch)))
         {
-            subexpr.add_child(std::move(*setComp));
+            candidates &= subexpr_word_filter[
+                static_cast<size_t>(classify_lookahead())
+            ];
         }
-        else if (std::optional<AST> qual_ident = parse_qualIdent())
+
+        for (size_t i = 0; candidates != 0; ++i, candidates >>= 1)
         {
-            subexpr.add_child(std::move(*qual_ident));
+            if (!(candidates & 1))
+            {
+                continue;
+            }
+
+            const SubexprAlternative& alt = subexpr_alternatives[i];
+
+            if (std::optional<AST> choice = memoized(alt.rule, alt.parse))
+            {
+                AST subexpr({ TokenType::subexpr, "" });
+                subexpr.reserve(1);
+                subexpr.add_child(std::move(*choice));
+                profile.succeeded();
+
+                return subexpr;
+            }
         }
-        else if (std::optional<AST> infixed = parse_infixed())
-        {
-            subexpr.add_child(std::move(*infixed));
+
+        return {};
+    }
+
+    /*!
+     * Whether a successful `rule` keeps its tree in the memo: only the
+     * alternatives that can't contain a subexpression do. A tree that nests
+     * others would hold a copy of every memoized tree inside it, so storing
+     * those would copy each node once per level of nesting.
+     */
+    static constexpr bool memoizes_tree(TokenType rule) noexcept
+    {
+        switch (rule)
+        {
+            case TokenType::qualIdent:
+            case TokenType::infixed:
+            case TokenType::numLit:
+            case TokenType::chrLit:
+            case TokenType::strLit:
+            case TokenType::op:
+                return true;
+            default:
+                return false;
         }
-        else if (std::optional<AST> numLit = parse_numLit())
+    }
+
+    /*!
+     * Runs `parse_rule` at the current offset, or replays its earlier outcome
+     * there when packrat mode is on. Every failure is replayed, but only the
+     * successes of `memoizes_tree` rules; the others parse again, out of
+     * memoized pieces. Exceptions are never memoized; they end the parse
+     * anyway.
+     */
+    std::optional<AST> Parser::memoized(TokenType rule, Rule parse_rule)
+    {
+        if (!this->options.packrat)
         {
-            subexpr.add_child(std::move(*numLit));
+            return profiled(rule, parse_rule);
         }
-        else if (std::optional<AST> chrLit = parse_chrLit())
+
+        const uint64_t key =
+            static_cast<uint64_t>(this->pos) << 8 |
+            static_cast<uint64_t>(rule);
+
+        const auto entry = this->memo.find(key);
+
+        if (entry != this->memo.end())
         {
-            subexpr.add_child(std::move(*chrLit));
+            this->stats.hits++;
+            rewind(entry->second.end);
+
+            if (!entry->second.result)
+            {
+                return {};
+            }
+
+            return entry->second.result->clone();
         }
-        else if (std::optional<AST> strLit = parse_strLit())
+
+        this->stats.misses++;
+
+        std::optional<AST> result = profiled(rule, parse_rule);
+
+        if (!result)
         {
-            subexpr.add_child(std::move(*strLit));
+            this->memo.emplace(key, MemoEntry{ {}, mark() });
         }
-        else if (std::optional<AST> op = parse_op())
+        else if (memoizes_tree(rule))
         {
-            subexpr.add_child(std::move(*op));
+            this->memo.emplace(key, MemoEntry{ result->clone(), mark() });
         }
-        else
+
+        return result;
+    }
+
+    std::optional<AST> Parser::profiled(TokenType rule, Rule parse_rule)
+    {
+        Profiled profile(*this, rule);
+        std::optional<AST> result = (this->*parse_rule)();
+
+        if (result)
         {
-            return {};
+            profile.succeeded();
         }
 
-        return subexpr;
+        return result;
     }
 
     std::optional<AST> Parser::parse_var()
@@ -596,7 +1698,8 @@ namespace brouwer
 
         if (!pattern)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::var,
                 "left-hand side of var assignment must be a pattern"
             );
         }
@@ -613,27 +1716,31 @@ namespace brouwer
 
             if (!type)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::var,
                     "type of var binding must be a valid identifier"
                 );
             }
 
             var.add_child(std::move(*colon));
             var.add_child(std::move(*type));
+
+            consume_blanks();
         }
 
         std::optional<AST> equals = parse_equals();
 
         if (!equals)
         {
-            throw std::runtime_error("var assignment must use =");
+            return fail(TokenType::var, "var assignment must use =");
         }
 
         std::optional<AST> expr = parse_expr();
 
         if (!expr)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::var,
                 "right-hand side of var assignment must be a valid expression"
             );
         }
@@ -644,8 +1751,38 @@ namespace brouwer
         return var;
     }
 
+    /*!
+     * Whether an assignment may start at offset `at`. Every subexpression
+     * tries one first, so this rules out the ones whose pattern was already
+     * parsed there (as part of a bigger one, tried further out): it failed,
+     * or no `=` or `:` follows it. Otherwise each level of `((((x))))`
+     * would parse all of the patterns within it again.
+     */
+    bool Parser::could_assign(size_t at) const noexcept
+    {
+        const auto known = this->pattern_ends.find(at);
+
+        if (known == this->pattern_ends.end())
+        {
+            return true;
+        }
+
+        const size_t next = scan::skip_blanks(this->buf, known->second);
+
+        return known->second != at        &&
+               next < this->buf.size()    &&
+               (this->buf[next] == '=' || this->buf[next] == ':');
+    }
+
     std::optional<AST> Parser::parse_assign()
     {
+        const Cursor start = mark();
+
+        if (!could_assign(scan::skip_blanks(this->buf, this->pos)))
+        {
+            return {};
+        }
+
         std::optional<AST> pattern = parse_pattern();
 
         if (!pattern)
@@ -656,7 +1793,7 @@ namespace brouwer
         consume_blanks();
 
         AST assign({ TokenType::assign, "" });
-        assign.add_child(AST(*pattern));
+        assign.add_child(std::move(*pattern));
 
         if (std::optional<AST> colon = parse_colon())
         {
@@ -664,7 +1801,8 @@ namespace brouwer
 
             if (!type)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::assign,
                     "type of binding must be a valid identifier"
                 );
             }
@@ -679,18 +1817,7 @@ namespace brouwer
 
         if (!equals)
         {
-            this->charhistory.push_front(this->ch);
-            this->charhistory.push_front(' ');
-
-            std::string consumed_pattern = str_repr(*pattern);
-
-            while (consumed_pattern.length() > 1)
-            {
-                this->charhistory.push_front(consumed_pattern.back());
-                consumed_pattern.pop_back();
-            }
-
-            this->ch = consumed_pattern.back();
+            rewind(start);
 
             return {};
         }
@@ -699,7 +1826,8 @@ namespace brouwer
 
         if (!expr)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::assign,
                 "right-hand side of assignment must be a valid expression"
             );
         }
@@ -727,7 +1855,7 @@ namespace brouwer
 
         if (!fn_name)
         {
-            throw std::runtime_error("expected function name");
+            return fail(TokenType::fnDecl, "expected function name");
         }
 
         consume_blanks();
@@ -753,7 +1881,7 @@ namespace brouwer
 
             if (!ret_type)
             {
-                throw std::runtime_error("expected type after arrow");
+                return fail(TokenType::fnDecl, "expected type after arrow");
             }
 
             fnDecl.add_child(std::move(*ret_type));
@@ -764,7 +1892,11 @@ namespace brouwer
         return fnDecl;
     }
 
-    std::optional<AST> Parser::parse_parened()
+    /*!
+     * A parenthesized expression or a tuple, told apart once the first
+     * expression has been parsed.
+     */
+    std::optional<AST> Parser::parse_parenthesized()
     {
         consume_blanks();
 
@@ -779,14 +1911,14 @@ namespace brouwer
 
         if (!expr)
         {
-            throw std::runtime_error("expected expression within parens");
+            return parse_tupleLit(std::move(*l_paren), {});
         }
 
         std::optional<AST> r_paren = parse_rParen();
 
         if (!r_paren)
         {
-            throw std::runtime_error("expected closing paren");
+            return parse_tupleLit(std::move(*l_paren), std::move(expr));
         }
 
         AST parened({ TokenType::parened, "" });
@@ -812,7 +1944,7 @@ namespace brouwer
 
         if (!expr)
         {
-            throw std::runtime_error("expected expression to return");
+            return fail(TokenType::return_, "expected expression to return");
         }
 
         AST return_({ TokenType::return_, "" });
@@ -839,7 +1971,10 @@ namespace brouwer
 
         if (!subject_expr)
         {
-            throw std::runtime_error("expected subject expression for case");
+            return fail(
+                TokenType::case_,
+                "expected subject expression for case"
+            );
         }
 
         AST case_({ TokenType::case_, "" });
@@ -862,18 +1997,26 @@ namespace brouwer
             return {};
         }
 
+        consume_blanks();
+
         std::optional<AST> fat_r_arrow = parse_fatRArrow();
 
         if (!fat_r_arrow)
         {
-            throw std::runtime_error("expected => while parsing case branch");
+            return fail(
+                TokenType::caseBranch,
+                "expected => while parsing case branch"
+            );
         }
 
         std::optional<AST> line = parse_line(false);
 
         if (!line)
         {
-            throw std::runtime_error("expected expression(s) after =>");
+            return fail(
+                TokenType::caseBranch,
+                "expected expression(s) after =>"
+            );
         }
 
         AST caseBranch({ TokenType::caseBranch, "" });
@@ -901,14 +2044,18 @@ namespace brouwer
 
         if (!if_condition)
         {
-            throw std::runtime_error("expected expression as if condition");
+            return fail(
+                TokenType::ifElse,
+                "expected expression as if condition"
+            );
         }
 
         AST ifElse({ TokenType::ifElse, "" });
         ifElse.add_child(std::move(*if_keyword));
         ifElse.add_child(std::move(*if_condition));
 
-        const std::string start_indent = get_block(ifElse, TokenType::line);
+        const std::string_view start_indent =
+            get_block(ifElse, TokenType::line);
 
         if (this->currentindent != start_indent)
         {
@@ -952,11 +2099,13 @@ namespace brouwer
         AST try_({ TokenType::try_, "" });
         try_.add_child(std::move(*try_keyword));
 
-        const std::string start_indent = get_block(try_, TokenType::line);
+        const std::string_view start_indent =
+            get_block(try_, TokenType::line);
 
         if (this->currentindent != start_indent)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::try_,
                 "try must have corresponsing catch on same indent level"
             );
         }
@@ -965,14 +2114,17 @@ namespace brouwer
 
         if (!catch_keyword)
         {
-            throw std::runtime_error("try must have corresponding catch");
+            return fail(TokenType::try_, "try must have corresponding catch");
         }
 
         std::optional<AST> exception_ident = parse_ident();
 
         if (!exception_ident)
         {
-            throw std::runtime_error("catch must name the caught exception");
+            return fail(
+                TokenType::try_,
+                "catch must name the caught exception"
+            );
         }
 
         try_.add_child(std::move(*catch_keyword));
@@ -1000,7 +2152,10 @@ namespace brouwer
 
         if (!while_condition)
         {
-            throw std::runtime_error("expected expression as while condition");
+            return fail(
+                TokenType::while_,
+                "expected expression as while condition"
+            );
         }
 
         AST while_({ TokenType::while_, "" });
@@ -1029,7 +2184,8 @@ namespace brouwer
 
         if (!for_pattern)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::for_,
                 "expected pattern as first part of for header"
             );
         }
@@ -1040,14 +2196,14 @@ namespace brouwer
 
         if (!in_keyword)
         {
-            throw std::runtime_error("missing in keyword of for loop");
+            return fail(TokenType::for_, "missing in keyword of for loop");
         }
 
         std::optional<AST> iterated = parse_expr();
 
         if (!iterated)
         {
-            throw std::runtime_error("for must iterate over an expression");
+            return fail(TokenType::for_, "for must iterate over an expression");
         }
 
         AST for_({ TokenType::for_, "" });
@@ -1076,7 +2232,10 @@ namespace brouwer
 
         if (!first_param)
         {
-            throw std::runtime_error("lambda expression requires 1+ args");
+            return fail(
+                TokenType::lambda,
+                "lambda expression requires 1+ args"
+            );
         }
 
         AST lambda({ TokenType::lambda, "" });
@@ -1104,14 +2263,14 @@ namespace brouwer
 
         if (!arrow)
         {
-            throw std::runtime_error("lambda expression requires ->");
+            return fail(TokenType::lambda, "lambda expression requires ->");
         }
 
         std::optional<AST> expr = parse_expr();
 
         if (!expr)
         {
-            throw std::runtime_error("lambda body must be expression");
+            return fail(TokenType::lambda, "lambda body must be expression");
         }
 
         lambda.add_child(std::move(*arrow));
@@ -1120,21 +2279,15 @@ namespace brouwer
         return lambda;
     }
 
-    std::optional<AST> Parser::parse_tupleLit()
+    /*!
+     * The rest of a tuple, after its left paren and what parsed as its first
+     * element.
+     */
+    std::optional<AST> Parser::parse_tupleLit(AST l_paren,
+                                              std::optional<AST> first_expr)
     {
-        consume_blanks();
-
-        std::optional<AST> l_paren = parse_lParen();
-
-        if (!l_paren)
-        {
-            return {};
-        }
-
-        std::optional<AST> first_expr = parse_expr();
-
         AST tupleLit({ TokenType::tupleLit, "" });
-        tupleLit.add_child(std::move(*l_paren));
+        tupleLit.add_child(std::move(l_paren));
 
         consume_blanks();
 
@@ -1144,7 +2297,8 @@ namespace brouwer
 
             if (!first_comma)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::tupleLit,
                     "expected comma after first tuple element"
                 );
             }
@@ -1153,7 +2307,8 @@ namespace brouwer
 
             if (!second_expr)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::tupleLit,
                     "expected 0 or at least 2 elements in tuple"
                 );
             }
@@ -1184,7 +2339,8 @@ namespace brouwer
 
         if (!r_paren)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::tupleLit,
                 "expected right paren to terminate tuple"
             );
         }
@@ -1194,7 +2350,11 @@ namespace brouwer
         return tupleLit;
     }
 
-    std::optional<AST> Parser::parse_listLit()
+    /*!
+     * A list literal or comprehension, told apart by whether a `|` follows
+     * the first expression.
+     */
+    std::optional<AST> Parser::parse_bracketed()
     {
         consume_blanks();
 
@@ -1205,10 +2365,56 @@ namespace brouwer
             return {};
         }
 
-        std::optional<AST> first_expr = parse_expr();
+        std::optional<AST> expr = parse_expr();
+
+        if (!expr)
+        {
+            if (
+                std::optional<AST> listLit =
+                    parse_listLit(std::move(*l_sq_bracket), {})
+            ) {
+                return listLit;
+            }
+
+            return fail(
+                TokenType::listComp,
+                "expected expression on left-hand side of list comprehension"
+            );
+        }
+
+        if (std::optional<AST> bar = parse_bar())
+        {
+            return parse_listComp(
+                std::move(*l_sq_bracket),
+                std::move(*expr),
+                std::move(*bar)
+            );
+        }
+
+        const Cursor after_expr = mark();
+
+        if (
+            std::optional<AST> listLit =
+                parse_listLit(std::move(*l_sq_bracket), std::move(expr))
+        ) {
+            return listLit;
+        }
+
+        // Neither: report it where the `|` would have been.
+        rewind(after_expr);
+
+        return fail(TokenType::listComp, "expected | for list comprehension");
+    }
 
+    /*!
+     * The rest of a list literal, after its left bracket and first element
+     * (if any). Fails without reporting it if the list isn't closed.
+     */
+    std::optional<AST> Parser::parse_listLit(AST l_sq_bracket,
+                                             std::optional<AST> first_expr)
+    {
         AST listLit({ TokenType::listLit, "" });
-        listLit.add_child(std::move(*l_sq_bracket));
+        listLit.add_child(std::move(l_sq_bracket));
 
         if (first_expr)
         {
@@ -1236,9 +2442,7 @@ namespace brouwer
 
         if (!r_sq_bracket)
         {
-            throw std::runtime_error(
-                "left square bracket in list literal requires ]"
-            );
+            return {};
         }
 
         listLit.add_child(std::move(*r_sq_bracket));
@@ -1246,37 +2450,18 @@ namespace brouwer
         return listLit;
     }
 
-    std::optional<AST> Parser::parse_listComp()
+    /*!
+     * The rest of a list comprehension, after its left bracket, the
+     * expression on its left-hand side and the `|`.
+     */
+    std::optional<AST> Parser::parse_listComp(AST l_sq_bracket,
+                                              AST expr,
+                                              AST bar)
     {
-        consume_blanks();
-
-        std::optional<AST> l_sq_bracket = parse_lSqBracket();
-
-        if (!l_sq_bracket)
-        {
-            return {};
-        }
-
-        std::optional<AST> expr = parse_expr();
-
-        if (!expr)
-        {
-            throw std::runtime_error(
-                "expected expression on left-hand side of list comprehension"
-            );
-        }
-
-        std::optional<AST> bar = parse_bar();
-
-        if (!bar)
-        {
-            throw std::runtime_error("expected | for list comprehension");
-        }
-
         AST listComp({ TokenType::listComp, "" });
-        listComp.add_child(std::move(*l_sq_bracket));
-        listComp.add_child(std::move(*expr));
-        listComp.add_child(std::move(*bar));
+        listComp.add_child(std::move(l_sq_bracket));
+        listComp.add_child(std::move(expr));
+        listComp.add_child(std::move(bar));
 
         std::optional<AST> first_generator = parse_generator();
         std::optional<AST> first_condition = {};
@@ -1322,7 +2507,8 @@ namespace brouwer
 
         if (!r_sq_bracket)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::listComp,
                 "expected ] to terminate list comprehension"
             );
         }
@@ -1332,7 +2518,13 @@ namespace brouwer
         return listComp;
     }
 
-    std::optional<AST> Parser::parse_dictLit()
+    /*!
+     * A dict or set, literal or comprehension. Which of the four it is shows
+     * once the first expression has been parsed: it is a dict's key if an
+     * `=` follows it, and a comprehension's left-hand side if a `|` follows
+     * that.
+     */
+    std::optional<AST> Parser::parse_braced()
     {
         consume_blanks();
 
@@ -1343,76 +2535,143 @@ namespace brouwer
             return {};
         }
 
-        std::optional<AST> first_entry = parse_dictEntry();
+        std::optional<AST> first = parse_expr();
 
-        AST dictLit({ TokenType::dictLit, "" });
-        dictLit.add_child(std::move(*l_curly_bracket));
+        if (!first)
+        {
+            if (
+                std::optional<AST> dictLit =
+                    parse_dictLit(std::move(*l_curly_bracket), {})
+            ) {
+                return dictLit;
+            }
 
-        if (first_entry)
+            return fail(
+                TokenType::setComp,
+                "expected expression on left-hand side of set comprehension"
+            );
+        }
+
+        const Cursor after_first = mark();
+
+        consume_blanks();
+
+        if (std::optional<AST> equals = parse_equals())
         {
-            consume_blanks();
+            std::optional<AST> val = parse_expr();
 
-            while (std::optional<AST> comma = parse_comma())
+            if (!val)
             {
-                std::optional<AST> entry = parse_dictEntry();
+                return fail(
+                    TokenType::dictEntry,
+                    "expected expression to be assigned to dict key"
+                );
+            }
 
-                if (!entry)
-                {
-                    break;
-                }
+            AST entry({ TokenType::dictEntry, "" });
+            entry.add_child(std::move(*first));
+            entry.add_child(std::move(*equals));
+            entry.add_child(std::move(*val));
 
-                dictLit.add_child(std::move(*comma));
-                dictLit.add_child(std::move(*entry));
+            if (std::optional<AST> bar = parse_bar())
+            {
+                return parse_dictComp(
+                    std::move(*l_curly_bracket),
+                    std::move(entry),
+                    std::move(*bar)
+                );
+            }
 
-                consume_blanks();
+            if (
+                std::optional<AST> dictLit =
+                    parse_dictLit(std::move(*l_curly_bracket), std::move(entry))
+            ) {
+                return dictLit;
             }
         }
+        else
+        {
+            rewind(after_first);
 
-        std::optional<AST> r_curly_bracket = parse_rCurlyBracket();
+            if (std::optional<AST> bar = parse_bar())
+            {
+                return parse_setComp(
+                    std::move(*l_curly_bracket),
+                    std::move(*first),
+                    std::move(*bar)
+                );
+            }
 
-        if (!r_curly_bracket)
-        {
-            throw std::runtime_error(
-                "left curly bracket in dict literal requires }"
-            );
+            if (
+                std::optional<AST> setLit =
+                    parse_setLit(std::move(*l_curly_bracket), std::move(first))
+            ) {
+                return setLit;
+            }
         }
 
-        dictLit.add_child(std::move(*r_curly_bracket));
+        // None of the four: report it where a set's `|` would have been.
+        rewind(after_first);
 
-        return dictLit;
+        return fail(TokenType::setComp, "expected | for set comprehension");
     }
 
-    std::optional<AST> Parser::parse_dictComp()
+    /*!
+     * The rest of a dict literal, after its left bracket and first entry (if
+     * any). Fails without reporting it if the dict isn't closed.
+     */
+    std::optional<AST> Parser::parse_dictLit(AST l_curly_bracket,
+                                             std::optional<AST> first_entry)
     {
-        consume_blanks();
-
-        std::optional<AST> l_curly_bracket = parse_lCurlyBracket();
+        AST dictLit({ TokenType::dictLit, "" });
+        dictLit.add_child(std::move(l_curly_bracket));
 
-        if (!l_curly_bracket)
+        if (first_entry)
         {
-            return {};
+            dictLit.add_child(std::move(*first_entry));
+
+            consume_blanks();
+
+            while (std::optional<AST> comma = parse_comma())
+            {
+                std::optional<AST> entry = parse_dictEntry();
+
+                if (!entry)
+                {
+                    break;
+                }
+
+                dictLit.add_child(std::move(*comma));
+                dictLit.add_child(std::move(*entry));
+
+                consume_blanks();
+            }
         }
 
-        std::optional<AST> entry = parse_dictEntry();
+        std::optional<AST> r_curly_bracket = parse_rCurlyBracket();
 
-        if (!entry)
+        if (!r_curly_bracket)
         {
-            throw std::runtime_error(
-                "expected entry on left-hand side of dict comprehension"
-            );
+            return {};
         }
 
-        std::optional<AST> bar = parse_bar();
+        dictLit.add_child(std::move(*r_curly_bracket));
 
-        if (!bar)
-        {
-            throw std::runtime_error("expected | for dict comprehension");
-        }
+        return dictLit;
+    }
 
+    /*!
+     * The rest of a dict comprehension, after its left bracket, the entry on
+     * its left-hand side and the `|`.
+     */
+    std::optional<AST> Parser::parse_dictComp(AST l_curly_bracket,
+                                              AST entry,
+                                              AST bar)
+    {
         AST dictComp({ TokenType::dictComp, "" });
-        dictComp.add_child(std::move(*l_curly_bracket));
-        dictComp.add_child(std::move(*entry));
-        dictComp.add_child(std::move(*bar));
+        dictComp.add_child(std::move(l_curly_bracket));
+        dictComp.add_child(std::move(entry));
+        dictComp.add_child(std::move(bar));
 
         std::optional<AST> first_generator = parse_generator();
         std::optional<AST> first_condition = {};
@@ -1458,7 +2717,8 @@ namespace brouwer
 
         if (!r_curly_bracket)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::dictComp,
                 "expected } to terminate dict comprehension"
             );
         }
@@ -1468,24 +2728,20 @@ namespace brouwer
         return dictComp;
     }
 
-    std::optional<AST> Parser::parse_setLit()
+    /*!
+     * The rest of a set literal, after its left bracket and first element.
+     * Fails without reporting it if the set isn't closed.
+     */
+    std::optional<AST> Parser::parse_setLit(AST l_curly_bracket,
+                                            std::optional<AST> first_expr)
     {
-        consume_blanks();
-
-        std::optional<AST> l_curly_bracket = parse_lCurlyBracket();
-
-        if (!l_curly_bracket)
-        {
-            return {};
-        }
-
-        std::optional<AST> first_expr = parse_expr();
-
         AST setLit({ TokenType::setLit, "" });
-        setLit.add_child(std::move(*l_curly_bracket));
+        setLit.add_child(std::move(l_curly_bracket));
 
         if (first_expr)
         {
+            setLit.add_child(std::move(*first_expr));
+
             consume_blanks();
 
             while (std::optional<AST> comma = parse_comma())
@@ -1508,9 +2764,7 @@ namespace brouwer
 
         if (!r_curly_bracket)
         {
-            throw std::runtime_error(
-                "left curly bracket in set literal requires }"
-            );
+            return {};
         }
 
         setLit.add_child(std::move(*r_curly_bracket));
@@ -1518,37 +2772,18 @@ namespace brouwer
         return setLit;
     }
 
-    std::optional<AST> Parser::parse_setComp()
+    /*!
+     * The rest of a set comprehension, after its left bracket, the
+     * expression on its left-hand side and the `|`.
+     */
+    std::optional<AST> Parser::parse_setComp(AST l_curly_bracket,
+                                             AST expr,
+                                             AST bar)
     {
-        consume_blanks();
-
-        std::optional<AST> l_curly_bracket = parse_lCurlyBracket();
-
-        if (!l_curly_bracket)
-        {
-            return {};
-        }
-
-        std::optional<AST> expr = parse_expr();
-
-        if (!expr)
-        {
-            throw std::runtime_error(
-                "expected expression on left-hand side of set comprehension"
-            );
-        }
-
-        std::optional<AST> bar = parse_bar();
-
-        if (!bar)
-        {
-            throw std::runtime_error("expected | for set comprehension");
-        }
-
         AST setComp({ TokenType::setComp, "" });
-        setComp.add_child(std::move(*l_curly_bracket));
-        setComp.add_child(std::move(*expr));
-        setComp.add_child(std::move(*bar));
+        setComp.add_child(std::move(l_curly_bracket));
+        setComp.add_child(std::move(expr));
+        setComp.add_child(std::move(bar));
 
         std::optional<AST> first_generator = parse_generator();
         std::optional<AST> first_condition = {};
@@ -1594,7 +2829,8 @@ namespace brouwer
 
         if (!r_curly_bracket)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::setComp,
                 "expected } to terminate set comprehension"
             );
         }
@@ -1611,6 +2847,7 @@ namespace brouwer
         if (std::optional<AST> member_ident = parse_memberIdent())
         {
             AST qual_ident({ TokenType::qualIdent, "" });
+            qual_ident.reserve(1);
             qual_ident.add_child(std::move(*member_ident));
 
             return qual_ident;
@@ -1619,6 +2856,7 @@ namespace brouwer
         if (std::optional<AST> scoped_ident = parse_scopedIdent())
         {
             AST qual_ident({ TokenType::qualIdent, "" });
+            qual_ident.reserve(1);
             qual_ident.add_child(std::move(*scoped_ident));
 
             return qual_ident;
@@ -1627,6 +2865,7 @@ namespace brouwer
         if (std::optional<AST> ident = parse_ident())
         {
             AST qual_ident({ TokenType::qualIdent, "" });
+            qual_ident.reserve(1);
             qual_ident.add_child(std::move(*ident));
 
             return qual_ident;
@@ -1667,17 +2906,17 @@ namespace brouwer
             return {};
         }
 
-        std::string id = "";
+        const size_t begin = this->pos;
 
         if (this->ch == '_')
         {
-            id.push_back('_');
+            const Cursor start = mark();
+
             advance();
 
             if (this->ch != '_' && !isalnum(this->ch))
             {
-                this->charhistory.push_front(this->ch);
-                this->ch = '_';
+                rewind(start);
 
                 return {};
             }
@@ -1685,19 +2924,21 @@ namespace brouwer
 
         while (isalnum(this->ch) || this->ch == '_')
         {
-            id.push_back(this->ch);
-
             if (advance())
             {
                 break;
             }
         }
 
-        return AST({ TokenType::ident, id });
+        const std::string_view id = lexeme_since(begin);
+
+        return AST({ TokenType::ident, id, this->symbol_table.intern(id) });
     }
 
     std::optional<AST> Parser::parse_memberIdent()
     {
+        const Cursor start = mark();
+
         std::optional<AST> first_ident = parse_ident();
 
         if (!first_ident)
@@ -1709,16 +2950,7 @@ namespace brouwer
 
         if (!dot)
         {
-            const std::string& first_ident_lex = first_ident->val().lexeme;
-
-            this->charhistory.push_front(this->ch);
-
-            for (auto i = first_ident_lex.length() - 1; i > 0; --i)
-            {
-                this->charhistory.push_front(first_ident_lex[i]);
-            }
-
-            this->ch = first_ident_lex[0];
+            rewind(start);
 
             return {};
         }
@@ -1727,7 +2959,10 @@ namespace brouwer
 
         if (!second_ident)
         {
-            throw std::runtime_error("expected identifier after dot operator");
+            return fail(
+                TokenType::memberIdent,
+                "expected identifier after dot operator"
+            );
         }
 
         AST memberIdent({ TokenType::memberIdent, "" });
@@ -1740,6 +2975,8 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_scopedIdent()
     {
+        const Cursor start = mark();
+
         std::optional<AST> first_ident = parse_ident();
 
         if (!first_ident)
@@ -1751,16 +2988,7 @@ namespace brouwer
 
         if (!double_colon)
         {
-            const std::string& first_ident_lex = first_ident->val().lexeme;
-
-            this->charhistory.push_front(this->ch);
-
-            for (auto i = first_ident_lex.length() - 1; i > 0; --i)
-            {
-                this->charhistory.push_front(first_ident_lex[i]);
-            }
-
-            this->ch = first_ident_lex[0];
+            rewind(start);
 
             return {};
         }
@@ -1769,7 +2997,10 @@ namespace brouwer
 
         if (!second_ident)
         {
-            throw std::runtime_error("expected identifier after dot operator");
+            return fail(
+                TokenType::scopedIdent,
+                "expected identifier after dot operator"
+            );
         }
 
         AST scopedIdent({ TokenType::scopedIdent, "" });
@@ -1782,6 +3013,13 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_typeIdent()
     {
+        const Nesting level(*this);
+
+        if (level.exceeded())
+        {
+            return too_deep(TokenType::typeIdent);
+        }
+
         consume_blanks();
 
         if (std::optional<AST> namespaced_ident = parse_namespacedIdent())
@@ -1807,7 +3045,8 @@ namespace brouwer
 
                 if (!first_comma)
                 {
-                    throw std::runtime_error(
+                    return fail(
+                        TokenType::typeIdent,
                         "expected comma after first type tuple element"
                     );
                 }
@@ -1816,7 +3055,8 @@ namespace brouwer
 
                 if (!second_ident)
                 {
-                    throw std::runtime_error(
+                    return fail(
+                        TokenType::typeIdent,
                         "expected 0 or at least 2 elements in type tuple"
                     );
                 }
@@ -1847,7 +3087,8 @@ namespace brouwer
 
             if (!r_paren)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::typeIdent,
                     "expected right paren to terminate type tuple"
                 );
             }
@@ -1863,14 +3104,20 @@ namespace brouwer
 
             if (!ident)
             {
-                throw std::runtime_error("expected type identifier after [");
+                return fail(
+                    TokenType::typeIdent,
+                    "expected type identifier after ["
+                );
             }
 
             std::optional<AST> r_sq_bracket = parse_rSqBracket();
 
             if (!r_sq_bracket)
             {
-                throw std::runtime_error("expected closing ] of list type");
+                return fail(
+                    TokenType::typeIdent,
+                    "expected closing ] of list type"
+                );
             }
 
             AST typeIdent({ TokenType::typeIdent, "" });
@@ -1887,7 +3134,10 @@ namespace brouwer
 
             if (!ident)
             {
-                throw std::runtime_error("expected type identifier after {");
+                return fail(
+                    TokenType::typeIdent,
+                    "expected type identifier after {"
+                );
             }
 
             consume_blanks();
@@ -1904,7 +3154,8 @@ namespace brouwer
 
                 if (!second_ident)
                 {
-                    throw std::runtime_error(
+                    return fail(
+                        TokenType::typeIdent,
                         "expected type identifier after ,"
                     );
                 }
@@ -1917,7 +3168,8 @@ namespace brouwer
 
             if (!r_curly_bracket)
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::typeIdent,
                     "expected closing } of dict/set type"
                 );
             }
@@ -1934,68 +3186,162 @@ namespace brouwer
     {
         consume_blanks();
 
-        std::string op = "";
+        const Cursor start = mark();
 
-        while (std::optional<char> op_char = expect_char_of(op_chars))
+        while (!at_end() && chars::operator_symbols.contains(this->ch))
         {
-            op.push_back(*op_char);
+            advance();
         }
 
+        const std::string_view op = lexeme_since(start.pos);
+
         if (op.empty())
         {
             return {};
         }
 
-        if (reserved_ops.find(op) != reserved_ops.end())
+        // Reserved operators are punctuation of the enclosing rule (`=`, `|`,
+        // `->`, `--`, ...), so leave them for it to consume.
+        if (is_reserved_op(op))
+        {
+            rewind(start);
+
+            return {};
+        }
+
+        return AST({ TokenType::op, op, this->symbol_table.intern(op) });
+    }
+
+    static LiteralValue integer_value(int64_t integer) noexcept
+    {
+        LiteralValue value;
+        value.integer = integer;
+
+        return value;
+    }
+
+    static LiteralValue real_value(double real) noexcept
+    {
+        LiteralValue value;
+        value.real = real;
+
+        return value;
+    }
+
+    /*!
+     * `digits` as an `int64_t`, negated if `negative`, or `nullopt` if that
+     * doesn't fit.
+     */
+    static std::optional<int64_t> integer_literal(std::string_view digits,
+                                                  bool negative) noexcept
+    {
+        constexpr uint64_t max = static_cast<uint64_t>(INT64_MAX);
+        uint64_t magnitude = 0;
+        const auto [end, ec] = std::from_chars(
+            digits.data(),
+            digits.data() + digits.size(),
+            magnitude
+        );
+
+        if (ec != std::errc() || end != digits.data() + digits.size())
+        {
+            return std::nullopt;
+        }
+
+        if (!negative)
+        {
+            return magnitude <= max
+                ? std::optional<int64_t>(static_cast<int64_t>(magnitude))
+                : std::nullopt;
+        }
+
+        if (magnitude == max + 1)
+        {
+            return INT64_MIN;
+        }
+
+        return magnitude <= max
+            ? std::optional<int64_t>(-static_cast<int64_t>(magnitude))
+            : std::nullopt;
+    }
+
+    /*!
+     * `digits.digits` as the nearest `double`. Without an exponent, only
+     * hundreds of digits can overflow (or underflow) one, and `strtod` is
+     * left to round those.
+     */
+    static double real_literal(std::string_view digits)
+    {
+        double real = 0.0;
+        const auto [end, ec] = std::from_chars(
+            digits.data(),
+            digits.data() + digits.size(),
+            real
+        );
+
+        if (ec == std::errc::result_out_of_range)
         {
-            throw std::runtime_error("the operator " + op + " is reserved");
+            return std::strtod(std::string(digits).c_str(), nullptr);
         }
 
-        return AST({ TokenType::op, op });
+        return real;
     }
 
     std::optional<AST> Parser::parse_numLit()
     {
         consume_blanks();
 
+        const Cursor start = mark();
         std::optional<AST> minus = {};
 
         if (expect_op("-"))
         {
-            minus = { { TokenType::minus, "-" } };
+            minus = { { TokenType::minus, lexeme_since(start.pos) } };
 
             consume_blanks();
         }
 
-        if (expect_keyword("NaN"))
+        const size_t keyword_start = this->pos;
+
+        if (expect_keyword(TokenType::nanKeyword))
         {
             AST numLit({ TokenType::numLit, "" });
-            AST real_lit({ TokenType::realLit, "" });
+            AST real_lit(Token(
+                TokenType::realLit,
+                real_value(std::numeric_limits<double>::quiet_NaN())
+            ));
 
             if (minus)
             {
                 real_lit.add_child(std::move(*minus));
             }
 
-            real_lit.add_child({ { TokenType::nanKeyword, "NaN" } });
+            real_lit.emplace_child(
+                Token(TokenType::nanKeyword, lexeme_since(keyword_start))
+            );
             numLit.add_child(std::move(real_lit));
 
             return numLit;
         }
 
-        if (expect_keyword("Infinity"))
+        if (expect_keyword(TokenType::infinityKeyword))
         {
+            const double inf = std::numeric_limits<double>::infinity();
+
             AST numLit({ TokenType::numLit, "" });
-            AST real_lit({ TokenType::realLit, "" });
+            AST real_lit(Token(
+                TokenType::realLit,
+                real_value(minus ? -inf : inf)
+            ));
 
             if (minus)
             {
                 real_lit.add_child(std::move(*minus));
             }
 
-            real_lit.add_child({
-                { TokenType::infinityKeyword, "Infinity" }
-            });
+            real_lit.emplace_child(
+                Token(TokenType::infinityKeyword, lexeme_since(keyword_start))
+            );
             numLit.add_child(std::move(real_lit));
 
             return numLit;
@@ -2003,21 +3349,15 @@ namespace brouwer
 
         if (!isdigit(this->ch))
         {
-            if (minus)
-            {
-                this->charhistory.push_front(' ');
-                this->charhistory.push_front('-');
-            }
+            rewind(start);
 
             return {};
         }
 
-        std::string s = "";
+        const size_t digits_start = this->pos;
 
         while (isdigit(this->ch))
         {
-            s.push_back(this->ch);
-
             if (advance())
             {
                 break;
@@ -2026,49 +3366,66 @@ namespace brouwer
 
         if (this->ch != '.')
         {
+            const std::string_view digits = lexeme_since(digits_start);
+            const std::optional<int64_t> value =
+                integer_literal(digits, minus.has_value());
+
+            if (!value)
+            {
+                return fail(
+                    TokenType::numLit,
+                    "integer literal out of range: " +
+                        std::string(minus ? "-" : "") + std::string(digits)
+                );
+            }
+
             AST numLit({ TokenType::numLit, "" });
-            AST int_lit({ TokenType::intLit, "" });
+            AST int_lit(Token(TokenType::intLit, integer_value(*value)));
 
             if (minus)
             {
                 int_lit.add_child(std::move(*minus));
             }
 
-            int_lit.add_child({ { TokenType::absInt, s } });
+            int_lit.emplace_child(Token(TokenType::absInt, digits));
             numLit.add_child(std::move(int_lit));
 
             return numLit;
         }
 
-        s.push_back(this->ch);
         advance();
 
         if (!isdigit(this->ch))
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::numLit,
                 "expected at least one digit after decimal point"
             );
         }
 
         while (isdigit(this->ch))
         {
-            s.push_back(this->ch);
-
             if (advance())
             {
                 break;
             }
         }
 
+        const std::string_view digits = lexeme_since(digits_start);
+        const double magnitude = real_literal(digits);
+
         AST numLit({ TokenType::numLit, "" });
-        AST real_lit({ TokenType::realLit, "" });
+        AST real_lit(Token(
+            TokenType::realLit,
+            real_value(minus ? -magnitude : magnitude)
+        ));
 
         if (minus)
         {
             real_lit.add_child(std::move(*minus));
         }
 
-        real_lit.add_child({ { TokenType::absReal, s } });
+        real_lit.emplace_child(Token(TokenType::absReal, digits));
         numLit.add_child(std::move(real_lit));
 
         return numLit;
@@ -2089,7 +3446,7 @@ namespace brouwer
 
         if (!the_char)
         {
-            throw std::runtime_error("unexpected ' or EOF");
+            return fail(TokenType::chrLit, "unexpected ' or EOF");
         }
 
         std::optional<AST> end_singleQuote = parse_singleQuote();
@@ -2099,7 +3456,7 @@ namespace brouwer
             std::string err_msg = "expected ', got: ";
             err_msg += this->ch;
 
-            throw std::runtime_error(err_msg);
+            return fail(TokenType::chrLit, err_msg);
         }
 
         AST chrLit({ TokenType::chrLit, "" });
@@ -2127,13 +3484,33 @@ namespace brouwer
 
         while (this->ch != '"')
         {
+            // Plain characters come in runs, which are found a block at a
+            // time; still one strChr per character, though.
+            const size_t run_end =
+                scan::find_string_special(this->buf, this->pos);
+
+            if (run_end > this->pos)
+            {
+                for (size_t i = this->pos; i < run_end; ++i)
+                {
+                    strLit.emplace_child(
+                        Token(TokenType::strChr, this->buf.substr(i, 1))
+                    );
+                }
+
+                skip_to(run_end);
+
+                continue;
+            }
+
             if (std::optional<AST> a_char = parse_strChr())
             {
                 strLit.add_child(std::move(*a_char));
             }
             else
             {
-                throw std::runtime_error(
+                return fail(
+                    TokenType::strLit,
                     "invalid escape sequence or unexpected EOF"
                 );
             }
@@ -2146,7 +3523,7 @@ namespace brouwer
             std::string err_msg = "expected \", got: ";
             err_msg += this->ch;
 
-            throw std::runtime_error(err_msg);
+            return fail(TokenType::strLit, err_msg);
         }
 
         strLit.add_child(std::move(*end_doubleQuote));
@@ -2169,14 +3546,14 @@ namespace brouwer
 
         if (!ident)
         {
-            throw std::runtime_error("expected identifier after `");
+            return fail(TokenType::infixed, "expected identifier after `");
         }
 
         std::optional<AST> second_backtick = parse_backtick();
 
         if (!second_backtick)
         {
-            throw std::runtime_error("expected closing `");
+            return fail(TokenType::infixed, "expected closing `");
         }
 
         AST infixed({ TokenType::infixed, "" });
@@ -2187,10 +3564,42 @@ namespace brouwer
         return infixed;
     }
 
+    /*!
+     * Parses a pattern, noting where it ended if it starts with a bracket;
+     * see `could_assign`.
+     */
     std::optional<AST> Parser::parse_pattern()
     {
         consume_blanks();
 
+        if (this->ch != '(' && this->ch != '[' && this->ch != '{')
+        {
+            return parse_pattern_uncached();
+        }
+
+        const size_t start = this->pos;
+        std::optional<AST> pattern = parse_pattern_uncached();
+
+        this->pattern_ends[start] = this->pos;
+
+        return pattern;
+    }
+
+    std::optional<AST> Parser::parse_pattern_uncached()
+    {
+        const Nesting level(*this);
+
+        if (level.exceeded())
+        {
+            return too_deep(TokenType::pattern);
+        }
+
+        consume_blanks();
+
+        // Patterns are only ever tried speculatively (an assignment, a
+        // generator or a case branch may turn out not to start here), so a
+        // malformed pattern backtracks rather than being reported.
+        const Cursor start = mark();
         AST pattern({ TokenType::pattern, "" });
 
         if (std::optional<AST> ident = parse_ident())
@@ -2240,18 +3649,18 @@ namespace brouwer
 
                 if (!first_comma)
                 {
-                    throw std::runtime_error(
-                        "expected comma after first element of pattern tuple"
-                    );
+                    rewind(start);
+
+                    return {};
                 }
 
                 std::optional<AST> second_pattern = parse_pattern();
 
                 if (!second_pattern)
                 {
-                    throw std::runtime_error(
-                        "expected 0 or at least 2 elements in pattern tuple"
-                    );
+                    rewind(start);
+
+                    return {};
                 }
 
                 pattern.add_child(std::move(*first_pattern));
@@ -2280,7 +3689,9 @@ namespace brouwer
 
             if (!rParen)
             {
-                throw std::runtime_error("left paren in pattern requires )");
+                rewind(start);
+
+                return {};
             }
 
             pattern.add_child(std::move(*rParen));
@@ -2320,9 +3731,9 @@ namespace brouwer
 
             if (!rSqBracket)
             {
-                throw std::runtime_error(
-                    "left square bracket in pattern requires ]"
-                );
+                rewind(start);
+
+                return {};
             }
 
             pattern.add_child(std::move(*rSqBracket));
@@ -2369,10 +3780,9 @@ namespace brouwer
 
                     if (!first_val)
                     {
-                        throw std::runtime_error(
-                            "expected value pattern after "
-                            "first = of dict pattern"
-                        );
+                        rewind(start);
+
+                        return {};
                     }
 
                     pattern.add_child(std::move(*first_key));
@@ -2395,19 +3805,18 @@ namespace brouwer
 
                         if (!equals)
                         {
-                            throw std::runtime_error(
-                                "expected = after key of dict pattern"
-                            );
+                            rewind(start);
+
+                            return {};
                         }
 
                         std::optional<AST> val = parse_pattern();
 
                         if (!val)
                         {
-                            throw std::runtime_error(
-                                "expected value pattern after "
-                                "= of dict pattern"
-                            );
+                            rewind(start);
+
+                            return {};
                         }
 
                         pattern.add_child(std::move(*comma));
@@ -2424,9 +3833,9 @@ namespace brouwer
 
             if (!rCurlyBracket)
             {
-                throw std::runtime_error(
-                    "left curly bracket in pattern requires }"
-                );
+                rewind(start);
+
+                return {};
             }
 
             pattern.add_child(std::move(*rCurlyBracket));
@@ -2439,11 +3848,11 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_chrChr()
     {
-        static const std::unordered_set<char> ctrl_chars = {'\'', '\\'};
+        const size_t start = this->pos;
 
-        if (std::optional<char> char_opt = expect_char_not_of(ctrl_chars))
+        if (expect_char_not_of(chars::chr_specials))
         {
-            return AST({ TokenType::chrChr, {*char_opt} });
+            return AST({ TokenType::chrChr, lexeme_since(start) });
         }
 
         if (!expect_char('\\'))
@@ -2451,9 +3860,9 @@ namespace brouwer
             return {};
         }
 
-        if (std::optional<char> esc_char_opt = expect_char_of(esc_chars))
+        if (expect_char_of(chars::escapes))
         {
-            return AST({ TokenType::chrChr, {'\\', *esc_char_opt} });
+            return AST({ TokenType::chrChr, lexeme_since(start) });
         }
 
         return {};
@@ -2461,11 +3870,11 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_strChr()
     {
-        static const std::unordered_set<char> ctrl_chars = {'"', '\\'};
+        const size_t start = this->pos;
 
-        if (std::optional<char> char_opt = expect_char_not_of(ctrl_chars))
+        if (expect_char_not_of(chars::str_specials))
         {
-            return AST({ TokenType::strChr, {*char_opt} });
+            return AST({ TokenType::strChr, lexeme_since(start) });
         }
 
         if (!expect_char('\\'))
@@ -2473,9 +3882,9 @@ namespace brouwer
             return {};
         }
 
-        if (std::optional<char> esc_char_opt = expect_char_of(esc_chars))
+        if (expect_char_of(chars::escapes))
         {
-            return AST({ TokenType::strChr, {'\\', *esc_char_opt} });
+            return AST({ TokenType::strChr, lexeme_since(start) });
         }
 
         return {};
@@ -2485,6 +3894,8 @@ namespace brouwer
     {
         consume_blanks();
 
+        const Cursor start = mark();
+
         if (this->ch == '(')
         {
             std::optional<AST> l_paren = parse_lParen();
@@ -2498,31 +3909,43 @@ namespace brouwer
 
             std::optional<AST> pattern = parse_pattern();
 
-            if (!pattern)
+            consume_blanks();
+            std::optional<AST> colon = {};
+
+            if (pattern)
             {
-                return {};
+                colon = parse_colon();
             }
 
-            consume_blanks();
-            std::optional<AST> colon = parse_colon();
-
             if (!colon)
             {
-                return {};
+                rewind(start);
+
+                std::optional<AST> untyped = parse_pattern();
+
+                if (!untyped)
+                {
+                    return {};
+                }
+
+                AST param({ TokenType::param, "" });
+                param.add_child(std::move(*untyped));
+
+                return param;
             }
 
             std::optional<AST> type_ident = parse_typeIdent();
 
             if (!type_ident)
             {
-                throw std::runtime_error("expected type");
+                return fail(TokenType::param, "expected type");
             }
 
             std::optional<AST> r_paren = parse_rParen();
 
             if (!r_paren)
             {
-                throw std::runtime_error("expected ) after type");
+                return fail(TokenType::param, "expected ) after type");
             }
 
             AST param({ TokenType::param, "" });
@@ -2550,6 +3973,8 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_generator()
     {
+        const Cursor start = mark();
+
         std::optional<AST> pattern = parse_pattern();
 
         if (!pattern)
@@ -2557,22 +3982,13 @@ namespace brouwer
             return {};
         }
 
+        consume_blanks();
+
         std::optional<AST> l_arrow = parse_lArrow();
 
         if (!l_arrow)
         {
-            this->charhistory.push_front(this->ch);
-            this->charhistory.push_front(' ');
-
-            std::string consumed_pattern = str_repr(*pattern);
-
-            while (consumed_pattern.length() > 1)
-            {
-                this->charhistory.push_front(consumed_pattern.back());
-                consumed_pattern.pop_back();
-            }
-
-            this->ch = consumed_pattern.back();
+            rewind(start);
 
             return {};
         }
@@ -2581,7 +3997,7 @@ namespace brouwer
 
         if (!expr)
         {
-            throw std::runtime_error("expected expression after <-");
+            return fail(TokenType::generator, "expected expression after <-");
         }
 
         AST generator({ TokenType::generator, "" });
@@ -2596,6 +4012,8 @@ namespace brouwer
     {
         consume_blanks();
 
+        const Cursor start = mark();
+
         std::optional<AST> key = parse_expr();
 
         if (!key)
@@ -2609,6 +4027,8 @@ namespace brouwer
 
         if (!equals)
         {
+            rewind(start);
+
             return {};
         }
 
@@ -2616,7 +4036,8 @@ namespace brouwer
 
         if (!val)
         {
-            throw std::runtime_error(
+            return fail(
+                TokenType::dictEntry,
                 "expected expression to be assigned to dict key"
             );
         }
@@ -2631,192 +4052,230 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_equals()
     {
-        if (!expect_char('='))
+        const size_t start = this->pos;
+
+        if (!expect_op("="))
         {
             return {};
         }
 
-        return AST({ TokenType::equals, "=" });
+        return AST({ TokenType::equals, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_singleQuote()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('\''))
         {
             return {};
         }
 
-        return AST({ TokenType::singleQuote, "'" });
+        return AST({ TokenType::singleQuote, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_doubleQuote()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('"'))
         {
             return {};
         }
 
-        return AST({ TokenType::doubleQuote, "\"" });
+        return AST({ TokenType::doubleQuote, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_fnKeyword()
     {
-        if (!expect_keyword("fn"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::fnKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::fnKeyword, "fn" });
+        return AST({ TokenType::fnKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_caseKeyword()
     {
-        if (!expect_keyword("case"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::caseKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::caseKeyword, "case" });
+        return AST({ TokenType::caseKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_ifKeyword()
     {
-        if (!expect_keyword("if"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::ifKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::ifKeyword, "if" });
+        return AST({ TokenType::ifKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_elseKeyword()
     {
-        if (!expect_keyword("else"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::elseKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::elseKeyword, "else" });
+        return AST({ TokenType::elseKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_tryKeyword()
     {
-        if (!expect_keyword("try"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::tryKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::tryKeyword, "try" });
+        return AST({ TokenType::tryKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_catchKeyword()
     {
-        if (!expect_keyword("catch"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::catchKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::catchKeyword, "catch" });
+        return AST({ TokenType::catchKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_whileKeyword()
     {
-        if (!expect_keyword("while"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::whileKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::whileKeyword, "while" });
+        return AST({ TokenType::whileKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_forKeyword()
     {
-        if (!expect_keyword("for"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::forKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::forKeyword, "for" });
+        return AST({ TokenType::forKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_inKeyword()
     {
-        if (!expect_keyword("in"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::inKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::inKeyword, "in" });
+        return AST({ TokenType::inKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_varKeyword()
     {
-        if (!expect_keyword("var"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::varKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::varKeyword, "var" });
+        return AST({ TokenType::varKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_moduleKeyword()
     {
-        if (!expect_keyword("module"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::moduleKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::moduleKeyword, "module" });
+        return AST({ TokenType::moduleKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_exposingKeyword()
     {
-        if (!expect_keyword("exposing"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::exposingKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::exposingKeyword, "exposing" });
+        return AST({ TokenType::exposingKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_hidingKeyword()
     {
-        if (!expect_keyword("hiding"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::hidingKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::hidingKeyword, "hiding" });
+        return AST({ TokenType::hidingKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_importKeyword()
     {
-        if (!expect_keyword("import"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::importKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::importKeyword, "import" });
+        return AST({ TokenType::importKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_asKeyword()
     {
-        if (!expect_keyword("as"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::asKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::asKeyword, "as" });
+        return AST({ TokenType::asKeyword, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_returnKeyword()
     {
-        if (!expect_keyword("return"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::returnKeyword))
         {
             return {};
         }
 
-        return AST({ TokenType::returnKeyword, "return" });
+        return AST({ TokenType::returnKeyword, lexeme_since(start) });
     }
 
     bool Parser::consume_lineCommentOp()
@@ -2831,194 +4290,314 @@ namespace brouwer
 
     std::optional<AST> Parser::parse_dot()
     {
+        const size_t start = this->pos;
+
         if (!expect_op("."))
         {
             return {};
         }
 
-        return AST({ TokenType::dot, "." });
+        return AST({ TokenType::dot, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_comma()
     {
+        const size_t start = this->pos;
+
         if (!expect_char(','))
         {
             return {};
         }
 
-        return AST({ TokenType::comma, "," });
+        return AST({ TokenType::comma, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_colon()
     {
+        const size_t start = this->pos;
+
         if (!expect_op(":"))
         {
             return {};
         }
 
-        return AST({ TokenType::colon, ":" });
+        return AST({ TokenType::colon, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_doubleColon()
     {
+        const size_t start = this->pos;
+
         if (!expect_op("::"))
         {
             return {};
         }
 
-        return AST({ TokenType::doubleColon, "::" });
+        return AST({ TokenType::doubleColon, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_underscore()
     {
-        if (!expect_keyword("_"))
+        const size_t start = this->pos;
+
+        if (!expect_keyword(TokenType::underscore))
         {
             return {};
         }
 
-        return AST({ TokenType::underscore, "_" });
+        return AST({ TokenType::underscore, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_lArrow()
     {
+        const size_t start = this->pos;
+
         if (!expect_op("<-"))
         {
             return {};
         }
 
-        return AST({ TokenType::lArrow, "<-" });
+        return AST({ TokenType::lArrow, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_rArrow()
     {
+        const size_t start = this->pos;
+
         if (!expect_op("->"))
         {
             return {};
         }
 
-        return AST({ TokenType::rArrow, "->" });
+        return AST({ TokenType::rArrow, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_fatRArrow()
     {
+        const size_t start = this->pos;
+
         if (!expect_op("=>"))
         {
             return {};
         }
 
-        return AST({ TokenType::fatRArrow, "=>" });
+        return AST({ TokenType::fatRArrow, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_lParen()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('('))
         {
             return {};
         }
 
-        return AST({ TokenType::lParen, "(" });
+        return AST({ TokenType::lParen, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_rParen()
     {
+        const size_t start = this->pos;
+
         if (!expect_char(')'))
         {
             return {};
         }
 
-        return AST({ TokenType::rParen, ")" });
+        return AST({ TokenType::rParen, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_lSqBracket()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('['))
         {
             return {};
         }
 
-        return AST({ TokenType::lSqBracket, "[" });
+        return AST({ TokenType::lSqBracket, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_rSqBracket()
     {
+        const size_t start = this->pos;
+
         if (!expect_char(']'))
         {
             return {};
         }
 
-        return AST({ TokenType::rSqBracket, "]" });
+        return AST({ TokenType::rSqBracket, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_lCurlyBracket()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('{'))
         {
             return {};
         }
 
-        return AST({ TokenType::lCurlyBracket, "{" });
+        return AST({ TokenType::lCurlyBracket, lexeme_since(start) });
     }
 
     std::optional<AST> Parser::parse_rCurlyBracket()
     {
+        const size_t start = this->pos;
+
         if (!expect_char('}'))
         {
             return {};
         }
 
-        return AST({ TokenType::rCurlyBracket, "}" });
+        return AST({ TokenType::rCurlyBracket, lexeme_since(start) });
+    }
+
+    std::optional<AST> Parser::parse_backslash()
+    {
+        const size_t start = this->pos;
+
+        if (!expect_char('\\'))
+        {
+            return {};
+        }
+
+        return AST({ TokenType::backslash, lexeme_since(start) });
+    }
+
+    std::optional<AST> Parser::parse_bar()
+    {
+        const size_t start = this->pos;
+
+        if (!expect_char('|'))
+        {
+            return {};
+        }
+
+        return AST({ TokenType::bar, lexeme_since(start) });
+    }
+
+    std::optional<AST> Parser::parse_backtick()
+    {
+        const size_t start = this->pos;
+
+        if (!expect_char('`'))
+        {
+            return {};
+        }
+
+        return AST({ TokenType::backtick, lexeme_since(start) });
+    }
+
+    Parser::Cursor Parser::mark() const noexcept
+    {
+        return { this->pos, this->lineno, this->line_start, this->currentindent };
     }
 
-    std::optional<AST> Parser::parse_backslash()
+    void Parser::rewind(const Cursor& cursor) noexcept
     {
-        if (!expect_char('\\'))
+        if (this->failed)
         {
-            return {};
+            return;
+        }
+
+#ifdef BROUWER_PROFILE_RULES
+        if (cursor.pos < this->pos)
+        {
+            const TokenType rule = this->profiled_rule
+                ? this->profiled_rule->profiled()
+                : TokenType::prog;
+
+            this->rule_profiles[static_cast<size_t>(rule)].rewound +=
+                this->pos - cursor.pos;
         }
+#endif
+
+        this->pos = cursor.pos;
+        this->lineno = cursor.line;
+        this->line_start = cursor.line_start;
+        this->currentindent = cursor.indent;
 
-        return AST({ TokenType::backslash, "\\" });
+        this->ch = this->pos < this->buf.size() ? this->buf[this->pos] : '\0';
     }
 
-    std::optional<AST> Parser::parse_bar()
+    bool Parser::at_end() const noexcept
     {
-        if (!expect_char('|'))
-        {
-            return {};
-        }
+        return this->pos >= this->buf.size();
+    }
 
-        return AST({ TokenType::bar, "|" });
+    /*!
+     * Whether nothing but indentation has been consumed on the current line,
+     * i.e. the newline before it was already eaten (by the block that ended
+     * there, say).
+     */
+    bool Parser::at_line_start() const noexcept
+    {
+        return this->pos - this->line_start == this->currentindent.size();
     }
 
-    std::optional<AST> Parser::parse_backtick()
+    size_t Parser::line_number() const noexcept
     {
-        if (!expect_char('`'))
-        {
-            return {};
-        }
+        return this->lineno;
+    }
 
-        return AST({ TokenType::backtick, "`" });
+    size_t Parser::column_number() const noexcept
+    {
+        return this->pos - this->line_start + 1;
     }
 
     /*!
-     * Returns `true` when the EOF is reached and `charhistory` is consumed,
+     * Moves the cursor one byte forward. Past the end of the buffer `ch` reads
+     * as `'\0'`. Returns `true` when the end of the buffer is reached,
      * otherwise returns `false`.
      */
     bool Parser::advance() noexcept
     {
-        if (!this->charhistory.empty())
+        if (this->pos >= this->buf.size())
         {
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
+            return true;
+        }
 
-            return this->charhistory.empty() && this->charstream.eof();
+        if (this->ch == '\n')
+        {
+            this->lineno++;
+            this->line_start = this->pos + 1;
         }
 
-        if (this->charstream >> std::noskipws >> this->ch)
+        this->pos++;
+
+        if (this->pos >= this->buf.size())
         {
-            return false;
+            this->ch = '\0';
+
+            return true;
         }
 
-        return true;
+        this->ch = this->buf[this->pos];
+
+        return false;
+    }
+
+    /*!
+     * Moves the cursor forward to `target`, which must be on the current
+     * line (i.e. no newline may be skipped over).
+     */
+    void Parser::skip_to(size_t target) noexcept
+    {
+        this->pos = target;
+        this->ch = target < this->buf.size() ? this->buf[target] : '\0';
+    }
+
+    /*!
+     * The span of the source from `start` up to the current position, which
+     * is what every token's lexeme is.
+     */
+    std::string_view Parser::lexeme_since(size_t start) const noexcept
+    {
+        return this->buf.substr(start, this->pos - start);
     }
 
     bool Parser::consume_blanks() noexcept
@@ -3028,75 +4607,64 @@ namespace brouwer
             return false;
         }
 
-        while (!this->charhistory.empty())
-        {
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
-
-            if (!isblank(this->ch))
-            {
-                return true;
-            }
-        }
-
-        while (this->charstream >> std::noskipws >> this->ch)
-        {
-            if (!isblank(this->ch))
-            {
-                return true;
-            }
-        }
+        skip_to(scan::skip_blanks(this->buf, this->pos));
 
         return true;
     }
 
+    /*!
+     * Consumes a run of newlines (and the blanks between them), leaving
+     * `currentindent` as the indentation of the line that follows it. The end
+     * of the buffer also terminates a line.
+     */
     bool Parser::expect_newline() noexcept
     {
+        if (at_line_start())
+        {
+            return true;
+        }
+
         consume_blanks();
 
+        if (at_end())
+        {
+            this->currentindent = {};
+
+            return true;
+        }
+
         if (!isnewline(this->ch))
         {
             return false;
         }
 
-        while (!this->charhistory.empty())
-        {
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
+        size_t indent_start = this->pos;
 
+        while (!at_end())
+        {
             if (isnewline(this->ch))
             {
-                this->currentindent.clear();
+                advance();
+                indent_start = this->pos;
             }
             else if (isblank(this->ch))
             {
-                this->currentindent.push_back(this->ch);
+                skip_to(scan::skip_blanks(this->buf, this->pos));
             }
             else
             {
-                return true;
+                break;
             }
         }
 
-        while (this->charstream >> std::noskipws >> this->ch)
+        if (at_end())
         {
-            if (isnewline(this->ch))
-            {
-                this->currentindent.clear();
-            }
-            else if (isblank(this->ch))
-            {
-                this->currentindent.push_back(this->ch);
-            }
-            else
-            {
-                return true;
-            }
+            this->currentindent = {};
         }
-
-        if (this->charstream.eof() && isnewline(this->ch))
+        else
         {
-            this->currentindent.clear();
+            this->currentindent =
+                this->buf.substr(indent_start, this->pos - indent_start);
         }
 
         return true;
@@ -3104,7 +4672,7 @@ namespace brouwer
 
     bool Parser::expect_char(char c) noexcept
     {
-        if (this->ch != c)
+        if (this->ch != c || at_end())
         {
             return false;
         }
@@ -3116,7 +4684,7 @@ namespace brouwer
 
     std::optional<char> Parser::expect_char_not(char c) noexcept
     {
-        if (this->ch == c)
+        if (this->ch == c || at_end())
         {
             return {};
         }
@@ -3127,11 +4695,9 @@ namespace brouwer
         return tmp;
     }
 
-    std::optional<char> Parser::expect_char_of(
-        const std::unordered_set<char>& cs
-    ) noexcept
+    std::optional<char> Parser::expect_char_of(const CharClass& cs) noexcept
     {
-        if (cs.find(this->ch) == cs.end())
+        if (at_end() || !cs.contains(this->ch))
         {
             return {};
         }
@@ -3143,10 +4709,10 @@ namespace brouwer
     }
 
     std::optional<char> Parser::expect_char_not_of(
-        const std::unordered_set<char>& cs
+        const CharClass& cs
     ) noexcept
     {
-        if (cs.find(this->ch) != cs.end())
+        if (at_end() || cs.contains(this->ch))
         {
             return {};
         }
@@ -3157,362 +4723,128 @@ namespace brouwer
         return tmp;
     }
 
-    bool Parser::expect_string(const std::string& s) noexcept
+    bool Parser::expect_string(std::string_view s) noexcept
     {
-        if (s.empty())
-        {
-            return true;
-        }
-
-        size_t i = 0;
-
-        if (this->ch != s[i])
+        if (this->buf.compare(this->pos, s.length(), s) != 0)
         {
             return false;
         }
 
-        i++;
-        std::vector<char> historicstack;
-
-        while (i < s.length() && !this->charhistory.empty())
-        {
-            if (this->charhistory.front() != s[i])
-            {
-                while (historicstack.size() > 1)
-                {
-                    this->charhistory.push_front(historicstack.back());
-                    historicstack.pop_back();
-                }
-
-                if (!historicstack.empty())
-                {
-                    this->ch = historicstack.back();
-                }
-
-                return false;
-            }
-
-            historicstack.push_back(this->ch);
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
-
-            i++;
-        }
-
-        if (i == s.length())
+        for (size_t i = 0; i < s.length(); ++i)
         {
             advance();
-
-            return true;
-        }
-
-        this->charhistory.push_back(this->ch);
-        size_t history_pushbacks = 1;
-
-        while (i < s.length() && this->charstream >> std::noskipws >> this->ch)
-        {
-            if (this->ch != s[i])
-            {
-                return false;
-            }
-
-            this->charhistory.push_back(this->ch);
-            history_pushbacks++;
-
-            i++;
-        }
-
-        this->charstream >> std::noskipws >> this->ch;
-
-        for (size_t j = 0; j < history_pushbacks; ++j)
-        {
-            this->charhistory.pop_back();
         }
 
-        return i == s.length();
+        return true;
     }
 
-    bool Parser::expect_keyword(const std::string& kwd)
+    /*!
+     * Consumes the word under the cursor if it is the keyword `kwd`.
+     */
+    bool Parser::expect_keyword(TokenType kwd) noexcept
     {
-        if (kwd.empty())
-        {
-            throw std::logic_error("empty keyword");
-        }
-
-        size_t i = 0;
-
-        if (this->ch != kwd[i])
+        if (classify_lookahead() != kwd)
         {
             return false;
         }
 
-        i++;
-        std::vector<char> historicstack;
-
-        while (i < kwd.length() && !this->charhistory.empty())
-        {
-            if (this->charhistory.front() != kwd[i])
-            {
-                while (historicstack.size() > 1)
-                {
-                    this->charhistory.push_front(historicstack.back());
-                    historicstack.pop_back();
-                }
-
-                if (!historicstack.empty())
-                {
-                    this->ch = historicstack.back();
-                }
-
-                return false;
-            }
-
-            historicstack.push_back(this->ch);
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
-
-            i++;
-        }
-
-        if (i == kwd.length())
+        for (size_t i = 0; i < this->word_length; ++i)
         {
-            bool not_keyword;
-
-            if (this->charhistory.empty())
-            {
-                const char temp_ch = this->ch;
-
-                this->charstream >> std::noskipws >> this->ch;
-                not_keyword = isalnum(this->ch) || this->ch == '_';
-
-                this->charhistory.push_back(this->ch);
-                this->ch = temp_ch;
-            }
-            else
-            {
-                const char front_char = this->charhistory.front();
-                not_keyword = isalnum(front_char) || front_char == '_';
-            }
-
-            if (not_keyword)
-            {
-                while (!historicstack.empty())
-                {
-                    this->charhistory.push_front(this->ch);
-
-                    this->ch = historicstack.back();
-                    historicstack.pop_back();
-                }
-
-                return false;
-            }
-
             advance();
-
-            return true;
         }
 
-        this->charhistory.push_back(this->ch);
-        size_t history_pushbacks = 1;
-
-        while (
-            i < kwd.length() &&
-            this->charstream >> std::noskipws >> this->ch
-        ) {
-            if (this->ch != kwd[i])
-            {
-                while (historicstack.size() > 1)
-                {
-                    this->charhistory.push_front(historicstack.back());
-                    historicstack.pop_back();
-                }
-
-                if (!historicstack.empty())
-                {
-                    this->ch = historicstack.back();
-                }
-
-                return false;
-            }
-
-            this->charhistory.push_back(this->ch);
-            history_pushbacks++;
+        return true;
+    }
 
-            i++;
+    /*!
+     * Classifies the identifier-shaped word starting at the cursor (see
+     * `classify_word`). Each offset is scanned only once however many rules
+     * ask about it, since the last answer is kept.
+     */
+    TokenType Parser::classify_lookahead() noexcept
+    {
+        if (this->word_pos == this->pos)
+        {
+            return this->word_type;
         }
 
-        this->charstream >> std::noskipws >> this->ch;
+        size_t end = this->pos;
 
-        if (isalnum(this->ch) || this->ch == '_')
-        {
-            while (historicstack.size() > 1)
-            {
-                this->charhistory.push_front(historicstack.back());
-                historicstack.pop_back();
-            }
+        const auto byte = [this](size_t i) {
+            return static_cast<unsigned char>(this->buf[i]);
+        };
 
-            if (!historicstack.empty())
+        if (end < this->buf.size() && first::identifier(byte(end)))
+        {
+            do
             {
-                this->ch = historicstack.back();
+                ++end;
             }
+            while (
+                end < this->buf.size() &&
+                (isalnum(byte(end)) || byte(end) == '_')
+            );
         }
 
-        for (size_t j = 0; j < history_pushbacks; ++j)
-        {
-            this->charhistory.pop_back();
-        }
+        this->word_pos = this->pos;
+        this->word_length = end - this->pos;
+        this->word_type =
+            classify_word(this->buf.substr(this->pos, this->word_length));
 
-        return i == kwd.length();
+        return this->word_type;
     }
 
-    bool Parser::expect_op(const std::string& op)
+    bool Parser::expect_op(std::string_view op)
     {
         if (op.empty())
         {
             throw std::logic_error("empty operator");
         }
 
-        size_t i = 0;
-
-        if (this->ch != op[i])
+        if (this->buf.compare(this->pos, op.length(), op) != 0)
         {
             return false;
         }
 
-        i++;
-        std::vector<char> historicstack;
-
-        while (i < op.length() && !this->charhistory.empty())
-        {
-            if (this->charhistory.front() != op[i])
-            {
-                while (historicstack.size() > 1)
-                {
-                    this->charhistory.push_front(historicstack.back());
-                    historicstack.pop_back();
-                }
-
-                if (!historicstack.empty())
-                {
-                    this->ch = historicstack.back();
-                }
-
-                return false;
-            }
-
-            historicstack.push_back(this->ch);
-            this->ch = this->charhistory.front();
-            this->charhistory.pop_front();
-
-            i++;
-        }
-
-        if (i == op.length())
-        {
-            bool not_op;
-
-            if (this->charhistory.empty())
-            {
-                const char temp_ch = this->ch;
-
-                this->charstream >> std::noskipws >> this->ch;
-                not_op = op_chars.find(this->ch) != op_chars.end();
-
-                this->charhistory.push_back(this->ch);
-                this->ch = temp_ch;
-            }
-            else
-            {
-                const char front_char = this->charhistory.front();
-                not_op = op_chars.find(front_char) != op_chars.end();
-            }
-
-            if (not_op)
-            {
-                while (!historicstack.empty())
-                {
-                    this->charhistory.push_front(this->ch);
-
-                    this->ch = historicstack.back();
-                    historicstack.pop_back();
-                }
-
-                return false;
-            }
-
-            advance();
-
-            return true;
-        }
-
-        this->charhistory.push_back(this->ch);
-        size_t history_pushbacks = 1;
+        const size_t after = this->pos + op.length();
 
-        while (
-            i < op.length() &&
-            this->charstream >> std::noskipws >> this->ch
+        if (
+            after < this->buf.size() &&
+            chars::operator_symbols.contains(this->buf[after])
         ) {
-            if (this->ch != op[i])
-            {
-                while (historicstack.size() > 1)
-                {
-                    this->charhistory.push_front(historicstack.back());
-                    historicstack.pop_back();
-                }
-
-                this->ch = historicstack.back();
-
-                return false;
-            }
-
-            this->charhistory.push_back(this->ch);
-            history_pushbacks++;
-
-            i++;
-        }
-
-        this->charstream >> std::noskipws >> this->ch;
-
-        if (op_chars.find(this->ch) != op_chars.end())
-        {
-            while (historicstack.size() > 1)
-            {
-                this->charhistory.push_front(historicstack.back());
-                historicstack.pop_back();
-            }
-
-            if (!historicstack.empty())
-            {
-                this->ch = historicstack.back();
-            }
+            return false;
         }
 
-        for (size_t j = 0; j < history_pushbacks; ++j)
+        for (size_t i = 0; i < op.length(); ++i)
         {
-            this->charhistory.pop_back();
+            advance();
         }
 
-        return i == op.length();
+        return true;
     }
 
-    std::string Parser::get_block(AST& main_ast, TokenType body_item_type)
+    std::string_view Parser::get_block(AST& main_ast,
+                                       TokenType body_item_type)
     {
-        const std::string start_indent = this->currentindent;
+        const TokenType rule = main_ast.val().type;
+        const std::string_view start_indent = this->currentindent;
 
         if (!expect_newline())
         {
-            throw std::runtime_error("expected newline after header");
+            fail(rule, "expected newline after header");
+
+            return start_indent;
         }
 
-        const std::string block_indent = this->currentindent;
+        const std::string_view block_indent = this->currentindent;
 
         if (
             start_indent.length() >= block_indent.length() ||
             !isprefixof(start_indent, block_indent)
         ) {
-            throw std::runtime_error(
-                "improper indentation after header"
-            );
+            fail(rule, "improper indentation after header");
+
+            return start_indent;
         }
 
         std::optional<AST> first_item;
@@ -3531,20 +4863,23 @@ namespace brouwer
 
         if (!first_item)
         {
-            throw std::runtime_error("expected at least one item in block");
+            fail(rule, "expected at least one item in block");
+
+            return start_indent;
         }
 
         main_ast.add_child(std::move(*first_item));
 
         if (!expect_newline())
         {
-            throw std::runtime_error(
-                "expected newline after first item of block"
-            );
+            fail(rule, "expected newline after first item of block");
+
+            return start_indent;
         }
 
         while (this->currentindent == block_indent)
         {
+            const size_t item_start = this->pos;
             std::optional<AST> item;
 
             switch (body_item_type)
@@ -3559,16 +4894,20 @@ namespace brouwer
                     throw std::logic_error("unhandled body item type");
             }
 
-            if (!item)
+            if (!item || this->pos == item_start)
             {
-                throw std::runtime_error("expected item in block");
+                fail(rule, "expected item in block");
+
+                return start_indent;
             }
 
             main_ast.add_child(std::move(*item));
 
             if (!expect_newline())
             {
-                throw std::runtime_error("expected newline after block item");
+                fail(rule, "expected newline after block item");
+
+                return start_indent;
             }
         }
 
@@ -3580,8 +4919,7 @@ namespace brouwer
         return c == '\n' || c == '\r';
     }
 
-    bool Parser::isprefixof(const std::string& a,
-                            const std::string& b) noexcept
+    bool Parser::isprefixof(std::string_view a, std::string_view b) noexcept
     {
         if (a.size() <= b.size())
         {
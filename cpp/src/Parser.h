@@ -1,51 +1,553 @@
 #pragma once
 
-#include <deque>
-#include <fstream>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
-#include <unordered_set>
-
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CharClass.h"
+#include "FlatAst.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
 #include "Tree.h"
 #include "Token.h"
 
 namespace brouwer
 {
+    struct ParserOptions
+    {
+        /*!
+         * Memoize the outcome of `subexpr` alternatives by input offset:
+         * every failure, and the trees of literals, names and operators,
+         * are replayed if tried there again. Parsing takes linear time
+         * without it (the alternatives that share a bracket parse it once
+         * between them), so the memo only pays off on input that
+         * backtracks far more than the bench's corpus, which it slows by
+         * 5 to 60%.
+         */
+        bool packrat = false;
+
+        /*!
+         * How deeply subexpressions, patterns and types may nest (each level
+         * of parentheses, brackets, lambda bodies and blocks counts) before
+         * the input is rejected, which bounds the stack the parser needs:
+         * about 1.3 KiB per level. Zero means no limit.
+         */
+        size_t max_depth = 1000;
+
+        /*!
+         * Have `parse_flat` store each distinct subtree once (see
+         * `FlatAst::from_tree`).
+         */
+        bool share_subtrees = false;
+    };
+
+    /*!
+     * How many levels of nesting the calling thread's stack was sized for
+     * by `on_parser_stack`: zero unless it started the thread.
+     */
+    inline thread_local size_t parser_stack_levels = 0;
+
+    /*!
+     * Whether the calling thread's stack fits parsing with `opts`: always
+     * for the default `max_depth` or less, which any thread's (a pool
+     * worker's included) does, and otherwise only on a stack of
+     * `on_parser_stack`'s big enough for it.
+     */
+    inline bool parser_stack_fits(const ParserOptions& opts) noexcept
+    {
+        const size_t limit = opts.max_depth;
+
+        return limit == 0                        ||
+               limit <= ParserOptions().max_depth ||
+               limit <= parser_stack_levels;
+    }
+
+    /*!
+     * Calls `fn`, which parses with `opts`, on a stack of its own that fits
+     * `opts.max_depth` unless `parser_stack_fits` the calling thread's.
+     * `Parser`'s entry points already go through here, so callers need it
+     * only for further deep work on the tree, such as compiling it.
+     */
+    template <typename F>
+    std::invoke_result_t<F> on_parser_stack(const ParserOptions& opts, F&& fn)
+    {
+        // Generous: the parser itself needs about a third of this.
+        constexpr size_t stack_per_level = 4096;
+        const size_t limit = opts.max_depth;
+
+        if (parser_stack_fits(opts))
+        {
+            return fn();
+        }
+
+        return on_stack(
+            std::min(limit, SIZE_MAX / stack_per_level) * stack_per_level,
+            [&]() {
+                parser_stack_levels = limit;
+
+                return fn();
+            }
+        );
+    }
+
+    struct MemoStats
+    {
+        size_t hits = 0;
+
+        size_t misses = 0;
+    };
+
+    /*!
+     * What the parser spent on one rule, in a build configured with
+     * `BROUWER_PROFILE_RULES`.
+     */
+    struct RuleProfile
+    {
+        size_t attempts = 0;
+
+        size_t successes = 0;
+
+        size_t failures = 0;
+
+        /*!
+         * Bytes of input given back by backtracking, while this was the
+         * innermost profiled rule.
+         */
+        size_t rewound = 0;
+
+        /*!
+         * Time from entering the rule to leaving it. Nested rules count
+         * towards this too, so a rule that recurses counts some of its time
+         * more than once; `self_ns` leaves out the time spent in other
+         * profiled rules, and so adds up.
+         */
+        uint64_t total_ns = 0;
+
+        uint64_t self_ns = 0;
+    };
+
+    using RuleProfiles = std::array<RuleProfile, token_type_count>;
+
+    /*!
+     * One contiguous change to a text, in bytes: `[start, old_end)` of the
+     * old text became `[start, new_end)` of the new one.
+     */
+    struct TextEdit
+    {
+        size_t start;
+
+        size_t old_end;
+
+        size_t new_end;
+
+        /*!
+         * The smallest edit that turns `before` into `after`, found from
+         * their common prefix and suffix.
+         */
+        static TextEdit between(std::string_view before,
+                                std::string_view after) noexcept;
+    };
+
+    struct ReparseStats
+    {
+        /*!
+         * Top-level items (lines, with their blocks) moved over from the
+         * previous tree.
+         */
+        size_t reused = 0;
+
+        size_t reparsed = 0;
+
+        bool full = false;
+    };
+
+    /*!
+     * A malformed input, as `Parser::parse_recovering` reports it.
+     */
+    struct Diagnostic
+    {
+        /*!
+         * What was being parsed.
+         */
+        TokenType rule;
+
+        size_t offset;
+
+        size_t line;
+
+        size_t column;
+
+        std::string message;
+    };
+
+    struct ParseResult
+    {
+        /*!
+         * Every top-level item that parsed; those with errors are left out.
+         */
+        Tree<Token> ast;
+
+        std::vector<Diagnostic> diagnostics;
+    };
+
     class Parser
     {
         public:
             using AST = Tree<Token>;
 
-            Parser(const std::string& filename);
+            Parser(const std::string& filename, ParserOptions opts = {});
+
+            Parser(Source src, ParserOptions opts = {});
 
+            /*!
+             * The returned tree's lexemes view this parser's source buffer,
+             * so they must not outlive it: keep the parser, or a reference
+             * to `shared_source()`, alive for as long as the tree is used.
+             */
             std::optional<AST> parse();
 
+            /*!
+             * Parses the whole source as `parse()` does, but never throws for
+             * malformed input. Each error is recorded instead, without
+             * unwinding, and parsing resumes at the next top-level line after
+             * it, so that one pass finds every broken line.
+             */
+            ParseResult parse_recovering();
+
+            /*!
+             * Parses the whole source as `parse()` does, but rather than
+             * building the `prog` tree, hands each of its items (the module
+             * declaration, each import, and each line with its block) to
+             * `consume` as soon as it is complete, so that only the item
+             * being parsed is ever held. If a later item fails to parse, the
+             * error is thrown after the items before it were consumed.
+             * Returns how many items there were.
+             */
+            size_t parse_each(const std::function<void(AST)>& consume);
+
+            /*!
+             * Parses the whole source as `parse()` does, to the same tree,
+             * but splits the lines after the header into chunks at
+             * unindented lines and parses those on `pool`, stitching their
+             * items together in order. A split that turns out to fall
+             * inside an item (a string spanning lines, say) is caught, and
+             * that chunk is parsed again here, so the split points only
+             * affect how much runs in parallel. Texts of less than a few
+             * hundred KiB are parsed in one piece.
+             *
+             * `reparse` can't be handed the tree: it parses everything
+             * again.
+             */
+            std::optional<AST> parse_parallel(ThreadPool& pool);
+
+            /*!
+             * Brings `previous`, the tree that the last `parse()` or
+             * `reparse()` returned, up to date with `updated`: this parser's
+             * text with `edit` applied. Only the top-level items that the
+             * edit can reach are parsed again, starting from the item before
+             * the edited one, and as soon as parsing lines up with the start
+             * of an old item past the edit again, the rest are moved over.
+             * Edits to the module header, or after a parse that failed, fall
+             * back to parsing everything. From then on, this parser's source
+             * is `updated`.
+             *
+             * Reused items go on viewing the text they were parsed from, so
+             * the returned tree is only valid while this parser is alive (a
+             * few earlier texts at most are kept for it).
+             */
+            std::optional<AST> reparse(AST previous,
+                                       Source updated,
+                                       const TextEdit& edit);
+
+            const ReparseStats& reparse_stats() const noexcept;
+
+            std::optional<FlatAst> parse_flat();
+
+            const MemoStats& memo_stats() const noexcept;
+
+            /*!
+             * Per-rule counts and times for every parse this parser has run,
+             * indexed by `TokenType`: the alternatives of `subexpr`, and
+             * `line`, `expr` and `subexpr` themselves. Backtracking outside
+             * of all of them is put down to `prog`. All zero unless
+             * `profiling()`.
+             */
+            const RuleProfiles& rule_profile() const noexcept;
+
+            /*!
+             * Whether this build was configured with `BROUWER_PROFILE_RULES`;
+             * without it, none of the bookkeeping is compiled in.
+             */
+            static bool profiling() noexcept;
+
+            const std::shared_ptr<const Source>& shared_source() const noexcept;
+
+            const SymbolTable& symbols() const noexcept;
+
             static std::string str_repr(const AST& ast) noexcept;
 
-            static void log_depthfirst(const AST& ast, size_t cur_depth);
+            static void log_depthfirst(const AST& ast,
+                                       size_t cur_depth,
+                                       std::ostream& out = std::cout);
+
+            static std::string str_repr(const FlatAst& ast,
+                                        NodeId id) noexcept;
+
+            static void log_depthfirst(const FlatAst& ast,
+                                       NodeId id,
+                                       size_t cur_depth,
+                                       std::ostream& out = std::cout);
 
             static bool isnewline(char c) noexcept;
 
-            static bool isprefixof(const std::string& a,
-                                   const std::string& b) noexcept;
+            static bool isprefixof(std::string_view a,
+                                   std::string_view b) noexcept;
 
         private:
-            std::ifstream charstream;
+            /*!
+             * Everything needed to resume scanning from an earlier point:
+             * saving and restoring one of these is how every rule backtracks.
+             */
+            struct Cursor
+            {
+                size_t pos;
+
+                size_t line;
+
+                size_t line_start;
+
+                std::string_view indent;
+            };
+
+            using Rule = std::optional<AST> (Parser::*)();
+
+            struct SubexprAlternative
+            {
+                TokenType rule;
+
+                Rule parse;
+            };
+
+            struct MemoEntry
+            {
+                std::optional<AST> result;
+
+                Cursor end;
+            };
+
+            /*!
+             * What a worker of `parse_parallel` made of the lines from
+             * `start` up to a split point: parsed with a symbol table of its
+             * own, which `parse_parallel` maps onto this parser's.
+             */
+            struct Chunk
+            {
+                Cursor start;
+
+                Cursor end;
+
+                std::vector<AST> items;
+
+                /*!
+                 * False if a line stopped the parse short, as `parse()`
+                 * stops; the items after it are never looked at.
+                 */
+                bool complete = true;
+
+                /*!
+                 * What the parse threw, if anything.
+                 */
+                std::exception_ptr error;
+
+                SymbolTable symbols;
+
+                MemoStats stats;
+
+                RuleProfiles profile = {};
+            };
+
+            ParserOptions options;
+
+            std::shared_ptr<const Source> source;
+
+            std::string_view buf;
 
-            std::deque<char> charhistory;
+            size_t pos;
+
+            size_t lineno;
+
+            size_t line_start;
 
             char ch;
 
-            std::string currentindent;
+            std::string_view currentindent;
+
+            std::unordered_map<uint64_t, MemoEntry> memo;
+
+            /*!
+             * Where each pattern that started with a bracket in the current
+             * item ended, by where it started (the same offset, if it
+             * failed).
+             */
+            std::unordered_map<size_t, size_t> pattern_ends;
+
+            MemoStats stats;
+
+            size_t word_pos = SIZE_MAX;
+
+            size_t word_length = 0;
+
+            TokenType word_type = TokenType::ident;
+
+            SymbolTable symbol_table;
+
+            /*!
+             * One text that lexemes of the last tree view: the current source,
+             * or an earlier one that items reused by `reparse` still point
+             * into.
+             */
+            struct Generation
+            {
+                std::shared_ptr<const Source> text;
+
+                size_t items;
+            };
+
+            /*!
+             * A top-level line of the last tree: where it starts in the
+             * current text, for `reparse` to restart from, and which
+             * generation its lexemes view, starting at `origin` there.
+             */
+            struct Item
+            {
+                Cursor start;
+
+                uint32_t generation;
+
+                size_t origin;
+            };
+
+            std::vector<Item> items;
+
+            bool items_valid = false;
+
+            bool tracking = false;
+
+            bool recovering = false;
+
+            /*!
+             * Whether an error was recorded that has yet to be recovered
+             * from, while recovering.
+             */
+            bool failed = false;
+
+            std::vector<Diagnostic> diagnostics;
+
+            std::vector<Generation> generations;
+
+            /*!
+             * The generation that the module header's lexemes view, which is
+             * always that of the last full parse.
+             */
+            uint32_t header_generation = 0;
+
+            ReparseStats reparse_counts;
+
+            /*!
+             * How many nesting rules are on the stack.
+             */
+            size_t depth = 0;
+
+            /*!
+             * Counts one level of nesting for as long as it lives.
+             */
+            class Nesting
+            {
+                public:
+                    explicit Nesting(Parser& p) noexcept : parser(p)
+                    {
+                        ++this->parser.depth;
+                    }
+
+                    Nesting(const Nesting& that) = delete;
+
+                    Nesting& operator=(const Nesting& that) = delete;
+
+                    ~Nesting()
+                    {
+                        --this->parser.depth;
+                    }
+
+                    bool exceeded() const noexcept
+                    {
+                        const size_t limit = this->parser.options.max_depth;
+
+                        return limit != 0 && this->parser.depth > limit;
+                    }
+
+                private:
+                    Parser& parser;
+            };
+
+            /*!
+             * Profiles one run of a rule for as long as it lives; the run
+             * counts as a failure unless `succeeded()` is called.
+             */
+            class Profiled;
 
-            static const std::unordered_set<char> esc_chars;
+            /*!
+             * The innermost rule being profiled, if any.
+             */
+            Profiled* profiled_rule = nullptr;
 
-            static const std::unordered_set<char> op_chars;
+            RuleProfiles rule_profiles = {};
 
-            static const std::unordered_set<std::string> reserved_ops;
+            static const SubexprAlternative subexpr_alternatives[19];
 
-            std::optional<AST> parse_prog();
+            static const std::array<uint32_t, 256> subexpr_dispatch;
+
+            static const std::array<uint32_t, token_type_count>
+                subexpr_word_filter;
+
+            Parser(std::shared_ptr<const Source> src, ParserOptions opts);
+
+            void begin(bool track, bool recover_errors = false);
+
+            std::nullopt_t fail(TokenType rule, std::string message);
+
+            void recover(size_t from) noexcept;
+
+            std::nullopt_t too_deep(TokenType rule);
+
+            void parse_prog(const std::function<void(AST)>& emit);
+
+            void parse_header(const std::function<void(AST)>& emit);
+
+            bool parse_items(const std::function<void(AST)>& emit,
+                             size_t stop);
+
+            static std::vector<Cursor> split_points(std::string_view text,
+                                                    const Cursor& from,
+                                                    size_t chunks);
+
+            static Chunk parse_chunk(std::shared_ptr<const Source> text,
+                                     const ParserOptions& opts,
+                                     const Cursor& start,
+                                     size_t stop);
+
+            void adopt(Chunk& chunk, const std::function<void(AST)>& emit);
 
             std::optional<AST> parse_modDecl();
 
@@ -53,12 +555,26 @@ namespace brouwer
 
             std::optional<AST> parse_line(bool consume_newline);
 
+            bool parse_item(const std::function<void(AST)>& emit);
+
+            void restart() noexcept;
+
+            Item moved(const Item& item,
+                       size_t shift,
+                       size_t lines) const noexcept;
+
+            void retire_generations(AST& prog);
+
             bool consume_lineComment(bool consume_newline);
 
             std::optional<AST> parse_expr();
 
             std::optional<AST> parse_subexpr();
 
+            std::optional<AST> memoized(TokenType rule, Rule parse_rule);
+
+            std::optional<AST> profiled(TokenType rule, Rule parse_rule);
+
             std::optional<AST> parse_chrLit();
 
             std::optional<AST> parse_strLit();
@@ -67,7 +583,7 @@ namespace brouwer
 
             std::optional<AST> parse_fnDecl();
 
-            std::optional<AST> parse_parened();
+            std::optional<AST> parse_parenthesized();
 
             std::optional<AST> parse_return();
 
@@ -85,19 +601,33 @@ namespace brouwer
 
             std::optional<AST> parse_lambda();
 
-            std::optional<AST> parse_tupleLit();
+            std::optional<AST> parse_tupleLit(AST l_paren,
+                                              std::optional<AST> first_expr);
+
+            std::optional<AST> parse_bracketed();
+
+            std::optional<AST> parse_listLit(AST l_sq_bracket,
+                                             std::optional<AST> first_expr);
 
-            std::optional<AST> parse_listLit();
+            std::optional<AST> parse_listComp(AST l_sq_bracket,
+                                              AST expr,
+                                              AST bar);
 
-            std::optional<AST> parse_listComp();
+            std::optional<AST> parse_braced();
 
-            std::optional<AST> parse_dictLit();
+            std::optional<AST> parse_dictLit(AST l_curly_bracket,
+                                             std::optional<AST> first_entry);
 
-            std::optional<AST> parse_dictComp();
+            std::optional<AST> parse_dictComp(AST l_curly_bracket,
+                                              AST entry,
+                                              AST bar);
 
-            std::optional<AST> parse_setLit();
+            std::optional<AST> parse_setLit(AST l_curly_bracket,
+                                            std::optional<AST> first_expr);
 
-            std::optional<AST> parse_setComp();
+            std::optional<AST> parse_setComp(AST l_curly_bracket,
+                                             AST expr,
+                                             AST bar);
 
             std::optional<AST> parse_qualIdent();
 
@@ -117,10 +647,14 @@ namespace brouwer
 
             std::optional<AST> parse_var();
 
+            bool could_assign(size_t at) const noexcept;
+
             std::optional<AST> parse_assign();
 
             std::optional<AST> parse_pattern();
 
+            std::optional<AST> parse_pattern_uncached();
+
             std::optional<AST> parse_chrChr();
 
             std::optional<AST> parse_strChr();
@@ -205,30 +739,47 @@ namespace brouwer
 
             std::optional<AST> parse_backtick();
 
+            Cursor mark() const noexcept;
+
+            void rewind(const Cursor& cursor) noexcept;
+
+            bool at_end() const noexcept;
+
+            bool at_line_start() const noexcept;
+
+            size_t line_number() const noexcept;
+
+            size_t column_number() const noexcept;
+
             bool advance() noexcept;
 
+            void skip_to(size_t target) noexcept;
+
+            std::string_view lexeme_since(size_t start) const noexcept;
+
             bool consume_blanks() noexcept;
 
             bool expect_newline() noexcept;
 
-            bool expect_string(const std::string& s) noexcept;
+            bool expect_string(std::string_view s) noexcept;
 
-            bool expect_keyword(const std::string& kwd);
+            bool expect_keyword(TokenType kwd) noexcept;
 
-            bool expect_op(const std::string& op);
+            TokenType classify_lookahead() noexcept;
 
-            std::string get_block(AST& main_ast, TokenType body_item_type);
+            bool expect_op(std::string_view op);
+
+            std::string_view get_block(AST& main_ast,
+                                       TokenType body_item_type);
 
             bool expect_char(char c) noexcept;
 
             std::optional<char> expect_char_not(char c) noexcept;
 
-            std::optional<char> expect_char_of(
-                const std::unordered_set<char>& cs
-            ) noexcept;
+            std::optional<char> expect_char_of(const CharClass& cs) noexcept;
 
             std::optional<char> expect_char_not_of(
-                const std::unordered_set<char>& cs
+                const CharClass& cs
             ) noexcept;
     };
 }
@@ -0,0 +1,176 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "Scan.h"
+
+namespace brouwer
+{
+    namespace
+    {
+        struct Blanks
+        {
+            static bool stops(char c) noexcept
+            {
+                return c != ' ' && c != '\t';
+            }
+
+#if defined(__AVX2__)
+            static uint32_t stops(__m256i block) noexcept
+            {
+                const __m256i blank = _mm256_or_si256(
+                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))
+                );
+
+                return ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+            }
+#elif defined(__SSE2__)
+            static uint32_t stops(__m128i block) noexcept
+            {
+                const __m128i blank = _mm_or_si128(
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))
+                );
+
+                return ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) &
+                       0xffff;
+            }
+#endif
+        };
+
+        struct LineEnds
+        {
+            static bool stops(char c) noexcept
+            {
+                return c == '\n' || c == '\r';
+            }
+
+#if defined(__AVX2__)
+            static uint32_t stops(__m256i block) noexcept
+            {
+                return static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_or_si256(
+                        _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')),
+                        _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r'))
+                    )
+                ));
+            }
+#elif defined(__SSE2__)
+            static uint32_t stops(__m128i block) noexcept
+            {
+                return static_cast<uint32_t>(_mm_movemask_epi8(
+                    _mm_or_si128(
+                        _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')),
+                        _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))
+                    )
+                ));
+            }
+#endif
+        };
+
+        struct StringSpecials
+        {
+            static bool stops(char c) noexcept
+            {
+                return c == '"' || c == '\\' || LineEnds::stops(c);
+            }
+
+#if defined(__AVX2__)
+            static uint32_t stops(__m256i block) noexcept
+            {
+                const __m256i quote_or_backslash = _mm256_or_si256(
+                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')),
+                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\'))
+                );
+
+                return LineEnds::stops(block) | static_cast<uint32_t>(
+                    _mm256_movemask_epi8(quote_or_backslash)
+                );
+            }
+#elif defined(__SSE2__)
+            static uint32_t stops(__m128i block) noexcept
+            {
+                const __m128i quote_or_backslash = _mm_or_si128(
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))
+                );
+
+                return LineEnds::stops(block) | static_cast<uint32_t>(
+                    _mm_movemask_epi8(quote_or_backslash)
+                );
+            }
+#endif
+        };
+
+        /*!
+         * Finds the first byte at or after `from` that `Run` stops at: whole
+         * blocks go through the vector predicate, and the tail (or the
+         * whole thing, without SIMD) through the scalar one.
+         */
+        template<class Run>
+        size_t find_stop(std::string_view s, size_t from) noexcept
+        {
+            const char* const data = s.data();
+            size_t i = from;
+
+#if defined(__AVX2__)
+            for (; i + 32 <= s.size(); i += 32)
+            {
+                const __m256i block = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(data + i)
+                );
+
+                if (const uint32_t mask = Run::stops(block))
+                {
+                    return i + static_cast<size_t>(__builtin_ctz(mask));
+                }
+            }
+#elif defined(__SSE2__)
+            for (; i + 16 <= s.size(); i += 16)
+            {
+                const __m128i block = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data + i)
+                );
+
+                if (const uint32_t mask = Run::stops(block))
+                {
+                    return i + static_cast<size_t>(__builtin_ctz(mask));
+                }
+            }
+#endif
+
+            for (; i < s.size(); ++i)
+            {
+                if (Run::stops(data[i]))
+                {
+                    return i;
+                }
+            }
+
+            return s.size();
+        }
+    }
+
+    namespace scan
+    {
+        size_t skip_blanks(std::string_view s, size_t from) noexcept
+        {
+            return find_stop<Blanks>(s, from);
+        }
+
+        size_t find_line_end(std::string_view s, size_t from) noexcept
+        {
+            return find_stop<LineEnds>(s, from);
+        }
+
+        size_t find_string_special(std::string_view s, size_t from) noexcept
+        {
+            return find_stop<StringSpecials>(s, from);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace brouwer
+{
+    /*!
+     * Block-at-a-time scanners for the long, uninteresting runs of a source
+     * file. They process 32 bytes at a time with AVX2 or 16 with SSE2,
+     * whichever the build targets, and fall back to a portable byte loop
+     * otherwise. Each returns the offset of the first byte at or after
+     * `from` that ends the run, or `s.size()` if there is none.
+     */
+    namespace scan
+    {
+        // The first byte that is neither ' ' nor '\t'.
+        size_t skip_blanks(std::string_view s, size_t from) noexcept;
+
+        // The first '\n' or '\r'.
+        size_t find_line_end(std::string_view s, size_t from) noexcept;
+
+        // The first '"', '\\', '\n' or '\r'.
+        size_t find_string_special(std::string_view s, size_t from) noexcept;
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace brouwer
+{
+    /*!
+     * Helpers for the on-disk formats, which store integers and columns in
+     * the host's (little-endian) byte order so that they can be used where
+     * they lie. Readers never trust what they are given: every read is
+     * bounds-checked, and fails rather than running past the end.
+     */
+    namespace serial
+    {
+        template <typename T>
+        void put(std::string& out, T value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        void put_column(std::string& out, const std::vector<T>& column)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+
+            out.append(
+                reinterpret_cast<const char*>(column.data()),
+                column.size() * sizeof(T)
+            );
+        }
+
+        inline void align(std::string& out, size_t to)
+        {
+            out.resize((out.size() + to - 1) / to * to, '\0');
+        }
+
+        class Reader
+        {
+            public:
+                explicit Reader(std::string_view data) noexcept
+                    : bytes(data), at(0) {}
+
+                template <typename T>
+                bool get(T& value) noexcept
+                {
+                    static_assert(std::is_trivially_copyable_v<T>);
+
+                    if (this->bytes.size() - this->at < sizeof(T))
+                    {
+                        return false;
+                    }
+
+                    std::memcpy(&value, this->bytes.data() + this->at, sizeof(T));
+                    this->at += sizeof(T);
+
+                    return true;
+                }
+
+                template <typename T>
+                bool get_column(std::vector<T>& column, size_t count)
+                {
+                    static_assert(std::is_trivially_copyable_v<T>);
+
+                    if ((this->bytes.size() - this->at) / sizeof(T) < count)
+                    {
+                        return false;
+                    }
+
+                    column.resize(count);
+                    std::memcpy(
+                        column.data(),
+                        this->bytes.data() + this->at,
+                        count * sizeof(T)
+                    );
+                    this->at += count * sizeof(T);
+
+                    return true;
+                }
+
+                /*!
+                 * Points `array` at the next `count` elements where they lie,
+                 * which must be suitably aligned for `T`.
+                 */
+                template <typename T>
+                bool get_array(const T*& array, size_t count) noexcept
+                {
+                    static_assert(std::is_trivially_copyable_v<T>);
+
+                    const char* const next = this->bytes.data() + this->at;
+
+                    if (
+                        (this->bytes.size() - this->at) / sizeof(T) < count ||
+                        reinterpret_cast<uintptr_t>(next) % alignof(T) != 0
+                    ) {
+                        return false;
+                    }
+
+                    array = reinterpret_cast<const T*>(next);
+                    this->at += count * sizeof(T);
+
+                    return true;
+                }
+
+                bool get_view(std::string_view& view, size_t size) noexcept
+                {
+                    if (this->bytes.size() - this->at < size)
+                    {
+                        return false;
+                    }
+
+                    view = this->bytes.substr(this->at, size);
+                    this->at += size;
+
+                    return true;
+                }
+
+                bool align(size_t to) noexcept
+                {
+                    const size_t aligned = (this->at + to - 1) / to * to;
+
+                    if (aligned > this->bytes.size())
+                    {
+                        return false;
+                    }
+
+                    this->at = aligned;
+
+                    return true;
+                }
+
+                bool done() const noexcept
+                {
+                    return this->at == this->bytes.size();
+                }
+
+            private:
+                std::string_view bytes;
+
+                size_t at;
+        };
+    }
+}
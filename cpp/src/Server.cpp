@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Cache.h"
+#include "Dump.h"
+#include "FlatAst.h"
+#include "Parser.h"
+#include "Server.h"
+#include "Source.h"
+#include "ThreadPool.h"
+
+namespace brouwer
+{
+    Server::Server(ServerOptions opts)
+        : options(std::move(opts)), pool(options.jobs) {}
+
+    void Server::serve(std::istream& in, std::ostream& out)
+    {
+        // Every answer flushes itself, under `output`; reading must not
+        // flush a tied stream behind the workers' backs.
+        std::ostream* const tied = in.tie(nullptr);
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+
+            if (line == "quit")
+            {
+                break;
+            }
+
+            std::optional<Request> request;
+
+            try
+            {
+                request = read_request(line, in);
+            }
+            catch (const std::runtime_error& re)
+            {
+                const std::string id = line.substr(0, line.find(' '));
+
+                respond(out, id, false, re.what());
+
+                continue;
+            }
+
+            {
+                const std::lock_guard<std::mutex> guard(this->lock);
+
+                this->counts.requests++;
+                this->in_flight++;
+            }
+
+            // Buffers are read here, in order, so that only the parsing and
+            // the answer happen on the pool.
+            this->pool.submit([this, &out, r = std::move(*request)]() mutable {
+                answer(std::move(r), out);
+
+                const std::lock_guard<std::mutex> guard(this->lock);
+
+                if (--this->in_flight == 0)
+                {
+                    this->idle.notify_all();
+                }
+            });
+        }
+
+        std::unique_lock<std::mutex> guard(this->lock);
+
+        this->idle.wait(guard, [this]() { return this->in_flight == 0; });
+        in.tie(tied);
+    }
+
+    ServerStats Server::stats() const
+    {
+        const std::lock_guard<std::mutex> guard(this->lock);
+
+        return this->counts;
+    }
+
+    Server::Request Server::read_request(const std::string& line,
+                                         std::istream& in)
+    {
+        std::istringstream words(line);
+        Request request;
+        std::string command;
+
+        words >> request.id >> command;
+
+        if (command == "parse")
+        {
+            request.command = Command::parse;
+        }
+        else if (command == "validate")
+        {
+            request.command = Command::validate;
+        }
+        else if (command == "dump")
+        {
+            std::string format;
+
+            words >> format;
+
+            const std::optional<DumpFormat> named = dump_format_named(format);
+
+            if (!named)
+            {
+                throw std::runtime_error(
+                    "dump expects pretty, sexpr, json or binary"
+                );
+            }
+
+            request.command = Command::dump;
+            request.format = *named;
+        }
+        else if (command == "stats")
+        {
+            request.command = Command::stats;
+
+            return request;
+        }
+        else
+        {
+            throw std::runtime_error("unknown request \"" + command + '"');
+        }
+
+        std::string target;
+
+        words >> target >> std::ws;
+
+        if (target == "file")
+        {
+            std::getline(words, request.path);
+
+            if (request.path.empty())
+            {
+                throw std::runtime_error("file expects a path");
+            }
+        }
+        else if (target == "buffer")
+        {
+            size_t length = 0;
+
+            if (!(words >> length))
+            {
+                throw std::runtime_error("buffer expects a length in bytes");
+            }
+
+            request.buffer.resize(length);
+            in.read(
+                request.buffer.data(),
+                static_cast<std::streamsize>(length)
+            );
+
+            if (static_cast<size_t>(in.gcount()) != length)
+            {
+                throw std::runtime_error("buffer ended early");
+            }
+        }
+        else
+        {
+            throw std::runtime_error("expected file PATH or buffer LENGTH");
+        }
+
+        return request;
+    }
+
+    void Server::answer(Request request, std::ostream& out)
+    {
+        if (request.command == Command::stats)
+        {
+            const ServerStats now = stats();
+
+            respond(
+                out,
+                request.id,
+                true,
+                std::to_string(now.requests) + " requests, " +
+                std::to_string(now.hits) + " hits, " +
+                std::to_string(now.misses) + " misses"
+            );
+
+            return;
+        }
+
+        std::shared_ptr<const Parsed> parsed;
+
+        try
+        {
+            parsed = request.path.empty()
+                ? parsed_buffer(std::move(request.buffer))
+                : parsed_file(request.path);
+        }
+        catch (const std::exception& e)
+        {
+            respond(out, request.id, false, e.what());
+
+            return;
+        }
+
+        if (!parsed->ast)
+        {
+            respond(out, request.id, false, parsed->errors);
+
+            return;
+        }
+
+        switch (request.command)
+        {
+            case Command::parse:
+                respond(
+                    out,
+                    request.id,
+                    true,
+                    std::to_string(parsed->ast->node_count()) + " nodes"
+                );
+                break;
+
+            case Command::dump:
+            {
+                std::ostringstream tree;
+
+                Dumper(tree, request.format).dump(*parsed->ast);
+                respond(out, request.id, true, tree.str());
+                break;
+            }
+
+            default:
+                respond(out, request.id, true, "");
+                break;
+        }
+    }
+
+    /*!
+     * An entry whose file has the same modification time and size is used
+     * without reading the file; otherwise it is read, and if its hash still
+     * matches (it was only touched), the entry is used all the same.
+     */
+    std::shared_ptr<const Server::Parsed>
+    Server::parsed_file(const std::string& path)
+    {
+        namespace fs = std::filesystem;
+
+        std::error_code ec;
+        const fs::file_time_type modified = fs::last_write_time(path, ec);
+        const uintmax_t size = ec ? 0 : fs::file_size(path, ec);
+
+        if (ec)
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        {
+            const std::lock_guard<std::mutex> guard(this->lock);
+            const auto entry = this->cache.find(path);
+
+            if (
+                entry != this->cache.end() &&
+                entry->second.modified == modified &&
+                entry->second.size == size
+            ) {
+                this->counts.hits++;
+                entry->second.used = ++this->tick;
+
+                return entry->second.parsed;
+            }
+        }
+
+        // Read rather than mapped: a cached tree can outlive any number of
+        // writes to its file, and a mapping would see them all.
+        std::ifstream file(path, std::ios::binary);
+        std::string text(
+            (std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>()
+        );
+
+        if (!file && !file.eof())
+        {
+            throw std::runtime_error("Failed to open " + path);
+        }
+
+        const uint64_t hash = cache::content_hash(text);
+
+        {
+            const std::lock_guard<std::mutex> guard(this->lock);
+            const auto entry = this->cache.find(path);
+
+            if (entry != this->cache.end() && entry->second.hash == hash)
+            {
+                this->counts.hits++;
+                entry->second.modified = modified;
+                entry->second.size = size;
+                entry->second.used = ++this->tick;
+
+                return entry->second.parsed;
+            }
+        }
+
+        std::shared_ptr<const Parsed> parsed =
+            parse(Source::from_buffer(std::move(text), path));
+
+        remember(path, { modified, size, hash, parsed, 0 });
+
+        return parsed;
+    }
+
+    std::shared_ptr<const Server::Parsed>
+    Server::parsed_buffer(std::string buffer)
+    {
+        const uint64_t hash = cache::content_hash(buffer);
+        const std::string key = "buffer:" + std::to_string(hash);
+
+        {
+            const std::lock_guard<std::mutex> guard(this->lock);
+            const auto entry = this->cache.find(key);
+
+            if (entry != this->cache.end())
+            {
+                this->counts.hits++;
+                entry->second.used = ++this->tick;
+
+                return entry->second.parsed;
+            }
+        }
+
+        std::shared_ptr<const Parsed> parsed =
+            parse(Source::from_buffer(std::move(buffer)));
+
+        remember(key, { {}, 0, hash, parsed, 0 });
+
+        return parsed;
+    }
+
+    /*!
+     * A fresh `Parser` per text, so that its memo and symbol table (and the
+     * tree it builds before flattening) go when it does; the cache keeps
+     * only the source and the `FlatAst`.
+     */
+    std::shared_ptr<const Server::Parsed> Server::parse(Source source) const
+    {
+        auto parsed = std::make_shared<Parsed>();
+        Parser parser(std::move(source), this->options.parser);
+
+        ParseResult result = parser.parse_recovering();
+
+        for (const Diagnostic& d : result.diagnostics)
+        {
+            parsed->errors += parser.shared_source()->name() + ':' +
+                              std::to_string(d.line) + ':' +
+                              std::to_string(d.column) + ": " +
+                              d.message + '\n';
+        }
+
+        if (result.diagnostics.empty())
+        {
+            parsed->ast = FlatAst::from_tree(
+                result.ast,
+                parser.shared_source(),
+                this->options.parser.share_subtrees
+            );
+        }
+
+        parsed->source = parser.shared_source();
+
+        return parsed;
+    }
+
+    void Server::remember(const std::string& key, Cached entry)
+    {
+        const std::lock_guard<std::mutex> guard(this->lock);
+
+        this->counts.misses++;
+        entry.used = ++this->tick;
+        this->cache.insert_or_assign(key, std::move(entry));
+
+        if (this->cache.size() <= this->options.cache_entries)
+        {
+            return;
+        }
+
+        const auto oldest = std::min_element(
+            this->cache.begin(),
+            this->cache.end(),
+            [](const auto& a, const auto& b) {
+                return a.second.used < b.second.used;
+            }
+        );
+
+        this->cache.erase(oldest);
+    }
+
+    void Server::respond(std::ostream& out,
+                         const std::string& id,
+                         bool ok,
+                         const std::string& payload)
+    {
+        const std::lock_guard<std::mutex> guard(this->output);
+
+        out << id << (ok ? " ok " : " error ") << payload.size() << '\n'
+            << payload << '\n' << std::flush;
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "Dump.h"
+#include "FlatAst.h"
+#include "Parser.h"
+#include "Source.h"
+#include "ThreadPool.h"
+
+namespace brouwer
+{
+    struct ServerOptions
+    {
+        ParserOptions parser;
+
+        /*!
+         * Workers answering requests; zero means one per hardware thread.
+         */
+        size_t jobs = 0;
+
+        /*!
+         * How many parsed texts to keep. Past this, the one used least
+         * recently is dropped; zero turns the cache off.
+         */
+        size_t cache_entries = 256;
+    };
+
+    struct ServerStats
+    {
+        size_t requests = 0;
+
+        size_t hits = 0;
+
+        size_t misses = 0;
+    };
+
+    /*!
+     * Answers a stream of parse requests, one per line, keeping what it
+     * parsed so that asking again about an unchanged file costs a `stat`.
+     * Requests are answered on a pool of workers in whatever order they
+     * finish, each answer tagged with its request's id:
+     *
+     *     ID parse TARGET            -> "N nodes"
+     *     ID validate TARGET         -> nothing
+     *     ID dump FORMAT TARGET      -> the tree, as `--dump FORMAT` prints it
+     *     ID stats                   -> requests, cache hits and misses
+     *     quit
+     *
+     * where TARGET is `file PATH`, or `buffer LENGTH` followed on the next
+     * line by exactly LENGTH bytes of script. Every answer is a line
+     * `ID ok LENGTH` or `ID error LENGTH`, then LENGTH bytes of payload and a
+     * newline. A script that doesn't parse is an error whose payload lists
+     * every parse error in it, one `name:line:column: message` per line.
+     */
+    class Server
+    {
+        public:
+            explicit Server(ServerOptions opts = {});
+
+            Server(const Server& that) = delete;
+
+            Server& operator=(const Server& that) = delete;
+
+            /*!
+             * Answers requests from `in` until it ends or says `quit`, and
+             * returns once every answer has been written to `out`.
+             */
+            void serve(std::istream& in, std::ostream& out);
+
+            ServerStats stats() const;
+
+        private:
+            enum class Command : uint8_t
+            {
+                  parse
+                , validate
+                , dump
+                , stats
+            };
+
+            struct Request
+            {
+                std::string id;
+
+                Command command;
+
+                DumpFormat format = DumpFormat::pretty;
+
+                /*!
+                 * Empty for a buffer.
+                 */
+                std::string path;
+
+                std::string buffer;
+            };
+
+            /*!
+             * A text and what parsing it gave, shared by every answer about
+             * it; never changed once made.
+             */
+            struct Parsed
+            {
+                std::shared_ptr<const Source> source;
+
+                std::optional<FlatAst> ast;
+
+                std::string errors;
+            };
+
+            struct Cached
+            {
+                std::filesystem::file_time_type modified;
+
+                uintmax_t size;
+
+                uint64_t hash;
+
+                std::shared_ptr<const Parsed> parsed;
+
+                uint64_t used;
+            };
+
+            /*!
+             * Reads the request that starts with `line`, and for a buffer
+             * the bytes after it; throws `std::runtime_error` if it is
+             * malformed.
+             */
+            static Request read_request(const std::string& line,
+                                        std::istream& in);
+
+            void answer(Request request, std::ostream& out);
+
+            std::shared_ptr<const Parsed> parsed_file(const std::string& path);
+
+            std::shared_ptr<const Parsed> parsed_buffer(std::string buffer);
+
+            std::shared_ptr<const Parsed> parse(Source source) const;
+
+            void remember(const std::string& key, Cached entry);
+
+            void respond(std::ostream& out,
+                         const std::string& id,
+                         bool ok,
+                         const std::string& payload);
+
+            ServerOptions options;
+
+            mutable std::mutex lock;
+
+            /*!
+             * Keyed by path, or by content hash for buffers.
+             */
+            std::unordered_map<std::string, Cached> cache;
+
+            uint64_t tick = 0;
+
+            ServerStats counts;
+
+            size_t in_flight = 0;
+
+            std::condition_variable idle;
+
+            std::mutex output;
+
+            /*!
+             * Last, so that it finishes its jobs before anything they use
+             * is destroyed.
+             */
+            ThreadPool pool;
+    };
+}
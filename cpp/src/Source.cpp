@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Source.h"
+
+namespace brouwer
+{
+    Source::Source(std::string name) noexcept
+        : source_name(std::move(name)), mapped(nullptr), mapped_size(0) {}
+
+    Source::Source(Source&& that) noexcept
+        : source_name(std::move(that.source_name)),
+          owned(std::move(that.owned)),
+          mapped(that.mapped),
+          mapped_size(that.mapped_size)
+    {
+        that.mapped = nullptr;
+        that.mapped_size = 0;
+    }
+
+    Source& Source::operator=(Source&& that) noexcept
+    {
+        if (this != &that)
+        {
+            this->unmap();
+
+            this->source_name = std::move(that.source_name);
+            this->owned = std::move(that.owned);
+            this->mapped = that.mapped;
+            this->mapped_size = that.mapped_size;
+
+            that.mapped = nullptr;
+            that.mapped_size = 0;
+        }
+
+        return *this;
+    }
+
+    Source::~Source()
+    {
+        this->unmap();
+    }
+
+    Source Source::from_file(const std::string& filename)
+    {
+        const int fd = open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+
+            throw std::runtime_error("Failed to open " + filename);
+        }
+
+        Source src(filename);
+        const size_t size = static_cast<size_t>(st.st_size);
+
+        if (S_ISREG(st.st_mode) && size > 0)
+        {
+            void* const addr =
+                mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, size, MADV_SEQUENTIAL);
+                close(fd);
+
+                src.mapped = static_cast<const char*>(addr);
+                src.mapped_size = size;
+
+                return src;
+            }
+        }
+
+        // Not mappable (a pipe, a FIFO, `<(...)`, or a special file whose
+        // size says nothing), so read until the end, doubling the buffer as
+        // it fills.
+        constexpr size_t chunk = 64 * 1024;
+        size_t got = 0;
+
+        for (;;)
+        {
+            if (got == src.owned.size())
+            {
+                src.owned.resize(std::max({ 2 * got, size, chunk }));
+            }
+
+            const ssize_t n =
+                read(fd, src.owned.data() + got, src.owned.size() - got);
+
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (n < 0)
+            {
+                close(fd);
+
+                throw std::runtime_error("Failed to read " + filename);
+            }
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            got += static_cast<size_t>(n);
+        }
+
+        close(fd);
+        src.owned.resize(got);
+
+        return src;
+    }
+
+    Source Source::from_buffer(std::string buffer, std::string name)
+    {
+        Source src(std::move(name));
+        src.owned = std::move(buffer);
+
+        return src;
+    }
+
+    std::string_view Source::view() const noexcept
+    {
+        if (this->mapped)
+        {
+            return { this->mapped, this->mapped_size };
+        }
+
+        return { this->owned.data(), this->owned.size() };
+    }
+
+    const std::string& Source::name() const noexcept
+    {
+        return this->source_name;
+    }
+
+    void Source::unmap() noexcept
+    {
+        if (this->mapped)
+        {
+            munmap(const_cast<char*>(this->mapped), this->mapped_size);
+
+            this->mapped = nullptr;
+            this->mapped_size = 0;
+        }
+    }
+}
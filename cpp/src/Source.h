@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace brouwer
+{
+    /*!
+     * A contiguous, read-only view of a whole source text. Files are
+     * memory-mapped where possible (falling back to a single bulk read), and
+     * scripts that never touch disk can be handed over as a buffer.
+     */
+    class Source
+    {
+        public:
+            static Source from_file(const std::string& filename);
+
+            static Source from_buffer(std::string buffer,
+                                      std::string name = "<buffer>");
+
+            Source(Source&& that) noexcept;
+
+            Source& operator=(Source&& that) noexcept;
+
+            Source(const Source& that) = delete;
+
+            Source& operator=(const Source& that) = delete;
+
+            ~Source();
+
+            /*!
+             * Moving the source can move a short buffer's bytes, so views
+             * are only good while it stays put (as behind a `shared_ptr`).
+             */
+            std::string_view view() const noexcept;
+
+            const std::string& name() const noexcept;
+
+        private:
+            Source(std::string name) noexcept;
+
+            void unmap() noexcept;
+
+            std::string source_name;
+
+            std::string owned;
+
+            const char* mapped;
+
+            size_t mapped_size;
+    };
+}
@@ -0,0 +1,38 @@
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "SymbolTable.h"
+#include "Token.h"
+
+namespace brouwer
+{
+    SymbolId SymbolTable::intern(std::string_view name)
+    {
+        const auto found = this->ids.find(name);
+
+        if (found != this->ids.end())
+        {
+            return found->second;
+        }
+
+        const SymbolId id = static_cast<SymbolId>(this->names.size());
+
+        // `std::deque` never moves its elements on push_back, so the key
+        // below keeps viewing valid storage.
+        this->names.emplace_back(name);
+        this->ids.emplace(this->names.back(), id);
+
+        return id;
+    }
+
+    std::string_view SymbolTable::name(SymbolId id) const noexcept
+    {
+        return this->names[id];
+    }
+
+    size_t SymbolTable::size() const noexcept
+    {
+        return this->names.size();
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Token.h"
+
+namespace brouwer
+{
+    /*!
+     * Interns names (identifiers and operators) into dense `SymbolId`s, so
+     * that later passes can compare names as integers. The table owns a copy
+     * of every distinct name, so ids stay resolvable after the source buffer
+     * they came from is gone.
+     */
+    class SymbolTable
+    {
+        public:
+            SymbolId intern(std::string_view name);
+
+            std::string_view name(SymbolId id) const noexcept;
+
+            size_t size() const noexcept;
+
+        private:
+            std::deque<std::string> names;
+
+            std::unordered_map<std::string_view, SymbolId> ids;
+    };
+}
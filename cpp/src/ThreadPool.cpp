@@ -0,0 +1,154 @@
+#include <pthread.h>
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "ThreadPool.h"
+
+namespace brouwer
+{
+    ThreadPool::ThreadPool(size_t threads) : stopping(false)
+    {
+        if (threads == 0)
+        {
+            threads = std::thread::hardware_concurrency();
+        }
+
+        if (threads == 0)
+        {
+            threads = 1;
+        }
+
+        this->workers.reserve(threads);
+
+        for (size_t i = 0; i < threads; ++i)
+        {
+            this->workers.emplace_back([this]() { this->work(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+
+        this->ready.notify_all();
+
+        for (std::thread& worker : this->workers)
+        {
+            worker.join();
+        }
+    }
+
+    size_t ThreadPool::size() const noexcept
+    {
+        return this->workers.size();
+    }
+
+    void ThreadPool::push(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->jobs.push(std::move(job));
+        }
+
+        this->ready.notify_one();
+    }
+
+    void ThreadPool::work()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> guard(this->lock);
+
+                this->ready.wait(guard, [this]() {
+                    return this->stopping || !this->jobs.empty();
+                });
+
+                if (this->jobs.empty())
+                {
+                    return;
+                }
+
+                job = std::move(this->jobs.front());
+                this->jobs.pop();
+            }
+
+            job();
+        }
+    }
+
+    void run_on_stack(size_t size,
+                      const std::function<void()>& fn,
+                      void* stack)
+    {
+        struct Call
+        {
+            const std::function<void()>& fn;
+
+            std::exception_ptr error;
+        };
+
+        Call call = { fn, nullptr };
+        pthread_attr_t attr;
+        pthread_t thread;
+        int err = pthread_attr_init(&attr);
+
+        if (err == 0)
+        {
+            err = stack ? pthread_attr_setstack(&attr, stack, size)
+                        : pthread_attr_setstacksize(&attr, size);
+
+            if (err == 0)
+            {
+                err = pthread_create(
+                    &thread,
+                    &attr,
+                    [](void* arg) -> void* {
+                        Call& c = *static_cast<Call*>(arg);
+
+                        try
+                        {
+                            c.fn();
+                        }
+                        catch (...)
+                        {
+                            c.error = std::current_exception();
+                        }
+
+                        return nullptr;
+                    },
+                    &call
+                );
+            }
+
+            pthread_attr_destroy(&attr);
+        }
+
+        if (err != 0)
+        {
+            throw std::system_error(
+                err,
+                std::generic_category(),
+                "run_on_stack"
+            );
+        }
+
+        pthread_join(thread, nullptr);
+
+        if (call.error)
+        {
+            std::rethrow_exception(call.error);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace brouwer
+{
+    /*!
+     * A fixed set of worker threads taking jobs from one shared queue, first
+     * in first out. Destroying the pool finishes every job already submitted
+     * before joining the workers.
+     */
+    class ThreadPool
+    {
+        public:
+            /*!
+             * With `threads == 0`, one worker per hardware thread.
+             */
+            explicit ThreadPool(size_t threads = 0);
+
+            ThreadPool(const ThreadPool& that) = delete;
+
+            ThreadPool& operator=(const ThreadPool& that) = delete;
+
+            ~ThreadPool();
+
+            size_t size() const noexcept;
+
+            /*!
+             * Queues `job`, returning a future for its result (or for
+             * whatever it threw).
+             */
+            template <typename F>
+            std::future<std::invoke_result_t<F>> submit(F&& job)
+            {
+                using R = std::invoke_result_t<F>;
+
+                const auto task = std::make_shared<std::packaged_task<R()>>(
+                    std::forward<F>(job)
+                );
+                std::future<R> result = task->get_future();
+
+                this->push([task]() { (*task)(); });
+
+                return result;
+            }
+
+        private:
+            void push(std::function<void()> job);
+
+            void work();
+
+            std::vector<std::thread> workers;
+
+            std::queue<std::function<void()>> jobs;
+
+            std::mutex lock;
+
+            std::condition_variable ready;
+
+            bool stopping;
+    };
+
+    /*!
+     * Runs `fn` to completion on a thread of its own whose stack is `size`
+     * bytes, and rethrows whatever it threw. The stack is the memory at
+     * `stack` if given (suitably aligned, at least `PTHREAD_STACK_MIN` bytes,
+     * and owned by the caller), otherwise allocated for the call. This is how
+     * to run deeply recursive work, such as parsing untrusted input with a
+     * high `ParserOptions::max_depth`, from a thread with a small stack.
+     */
+    void run_on_stack(size_t size,
+                      const std::function<void()>& fn,
+                      void* stack = nullptr);
+
+    template <typename F>
+    std::invoke_result_t<F> on_stack(size_t size,
+                                     F&& fn,
+                                     void* stack = nullptr)
+    {
+        using R = std::invoke_result_t<F>;
+
+        if constexpr (std::is_void_v<R>)
+        {
+            run_on_stack(size, std::forward<F>(fn), stack);
+        }
+        else
+        {
+            std::optional<R> result;
+
+            run_on_stack(size, [&]() { result.emplace(fn()); }, stack);
+
+            return std::move(*result);
+        }
+    }
+}
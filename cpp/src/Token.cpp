@@ -1,9 +1,12 @@
 #include "Token.h"
 
-#include <string>
+#include <string_view>
 
 namespace brouwer
 {
-    Token::Token(TokenType t, std::string lex) noexcept
-        : type(t), lexeme(lex) {}
+    Token::Token(TokenType t, std::string_view lex, SymbolId sym) noexcept
+        : type(t), symbol(sym), lexeme(lex), value{ 0 } {}
+
+    Token::Token(TokenType t, LiteralValue val) noexcept
+        : type(t), symbol(no_symbol), lexeme(), value(val) {}
 }
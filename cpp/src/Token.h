@@ -1,7 +1,9 @@
 #pragma once
 
-#include <string>
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
 
 namespace brouwer
 {
@@ -96,103 +98,159 @@ namespace brouwer
         , backtick
     };
 
-    const std::unordered_map<TokenType, std::string> token_type_names =
+    /*!
+     * The name of every `TokenType`, indexed by its value.
+     */
+    constexpr std::string_view token_type_names[] =
     {
-          {TokenType::root,            "root"}
-        , {TokenType::prog,            "prog"}
-        , {TokenType::modDecl,         "modDecl"}
-        , {TokenType::import,          "import"}
-        , {TokenType::line,            "line"}
-        , {TokenType::expr,            "expr"}
-        , {TokenType::subexpr,         "subexpr"}
-        , {TokenType::chrLit,          "chrLit"}
-        , {TokenType::strLit,          "strLit"}
-        , {TokenType::fnDecl,          "fnDecl"}
-        , {TokenType::parened,         "parened"}
-        , {TokenType::return_,         "return_"}
-        , {TokenType::case_,           "case_"}
-        , {TokenType::ifElse,          "ifElse"}
-        , {TokenType::try_,            "try_"}
-        , {TokenType::while_,          "while_"}
-        , {TokenType::for_,            "for_"}
-        , {TokenType::fnApp,           "fnApp"}
-        , {TokenType::lambda,          "lambda"}
-        , {TokenType::tupleLit,        "tupleLit"}
-        , {TokenType::listLit,         "listLit"}
-        , {TokenType::listComp,        "listComp"}
-        , {TokenType::dictLit,         "dictLit"}
-        , {TokenType::dictComp,        "dictComp"}
-        , {TokenType::setLit,          "setLit"}
-        , {TokenType::setComp,         "setComp"}
-        , {TokenType::ident,           "ident"}
-        , {TokenType::qualIdent,       "qualIdent"}
-        , {TokenType::namespacedIdent, "namespacedIdent"}
-        , {TokenType::memberIdent,     "memberIdent"}
-        , {TokenType::scopedIdent,     "scopedIdent"}
-        , {TokenType::typeIdent,       "typeIdent"}
-        , {TokenType::numLit,          "numLit"}
-        , {TokenType::op,              "op"}
-        , {TokenType::infixed,         "infixed"}
-        , {TokenType::var,             "var"}
-        , {TokenType::assign,          "assign"}
-        , {TokenType::pattern,         "pattern"}
-        , {TokenType::strChr,          "strChr"}
-        , {TokenType::param,           "param"}
-        , {TokenType::generator,       "generator"}
-        , {TokenType::realLit,         "realLit"}
-        , {TokenType::intLit,          "intLit"}
-        , {TokenType::absInt,          "absInt"}
-        , {TokenType::absReal,         "absReal"}
-        , {TokenType::chrChr,          "chrChr"}
-        , {TokenType::dictEntry,       "dictEntry"}
-        , {TokenType::caseBranch,      "caseBranch"}
-        , {TokenType::equals,          "equals"}
-        , {TokenType::singleQuote,     "singleQuote"}
-        , {TokenType::doubleQuote,     "doubleQuote"}
-        , {TokenType::moduleKeyword,   "moduleKeyword"}
-        , {TokenType::exposingKeyword, "exposingKeyword"}
-        , {TokenType::hidingKeyword,   "hidingKeyword"}
-        , {TokenType::importKeyword,   "importKeyword"}
-        , {TokenType::asKeyword,       "asKeyword"}
-        , {TokenType::fnKeyword,       "fnKeyword"}
-        , {TokenType::caseKeyword,     "caseKeyword"}
-        , {TokenType::ifKeyword,       "ifKeyword"}
-        , {TokenType::elseKeyword,     "elseKeyword"}
-        , {TokenType::tryKeyword,      "tryKeyword"}
-        , {TokenType::catchKeyword,    "catchKeyword"}
-        , {TokenType::whileKeyword,    "whileKeyword"}
-        , {TokenType::forKeyword,      "forKeyword"}
-        , {TokenType::inKeyword,       "inKeyword"}
-        , {TokenType::varKeyword,      "varKeyword"}
-        , {TokenType::nanKeyword,      "nanKeyword"}
-        , {TokenType::infinityKeyword, "infinityKeyword"}
-        , {TokenType::returnKeyword,   "returnKeyword"}
-        , {TokenType::dot,             "dot"}
-        , {TokenType::comma,           "comma"}
-        , {TokenType::colon,           "colon"}
-        , {TokenType::underscore,      "underscore"}
-        , {TokenType::lArrow,          "lArrow"}
-        , {TokenType::rArrow,          "rArrow"}
-        , {TokenType::fatRArrow,       "fatRArrow"}
-        , {TokenType::lParen,          "lParen"}
-        , {TokenType::rParen,          "rParen"}
-        , {TokenType::lSqBracket,      "lSqBracket"}
-        , {TokenType::rSqBracket,      "rSqBracket"}
-        , {TokenType::lCurlyBracket,   "lCurlyBracket"}
-        , {TokenType::rCurlyBracket,   "rCurlyBracket"}
-        , {TokenType::backslash,       "backslash"}
-        , {TokenType::doubleColon,     "doubleColon"}
-        , {TokenType::minus,           "minus"}
-        , {TokenType::bar,             "bar"}
-        , {TokenType::backtick,        "backtick"}
+          "root"
+        , "prog"
+        , "modDecl"
+        , "import"
+        , "line"
+        , "expr"
+        , "subexpr"
+        , "chrLit"
+        , "strLit"
+        , "fnDecl"
+        , "parened"
+        , "return_"
+        , "case_"
+        , "ifElse"
+        , "try_"
+        , "while_"
+        , "for_"
+        , "fnApp"
+        , "lambda"
+        , "tupleLit"
+        , "listLit"
+        , "listComp"
+        , "dictLit"
+        , "dictComp"
+        , "setLit"
+        , "setComp"
+        , "qualIdent"
+        , "namespacedIdent"
+        , "ident"
+        , "memberIdent"
+        , "scopedIdent"
+        , "typeIdent"
+        , "numLit"
+        , "op"
+        , "infixed"
+        , "var"
+        , "assign"
+        , "pattern"
+        , "strChr"
+        , "param"
+        , "generator"
+        , "realLit"
+        , "intLit"
+        , "absInt"
+        , "absReal"
+        , "chrChr"
+        , "dictEntry"
+        , "caseBranch"
+        , "equals"
+        , "singleQuote"
+        , "doubleQuote"
+        , "moduleKeyword"
+        , "exposingKeyword"
+        , "hidingKeyword"
+        , "importKeyword"
+        , "asKeyword"
+        , "fnKeyword"
+        , "caseKeyword"
+        , "ifKeyword"
+        , "elseKeyword"
+        , "tryKeyword"
+        , "catchKeyword"
+        , "whileKeyword"
+        , "forKeyword"
+        , "inKeyword"
+        , "varKeyword"
+        , "nanKeyword"
+        , "infinityKeyword"
+        , "returnKeyword"
+        , "dot"
+        , "comma"
+        , "colon"
+        , "underscore"
+        , "lArrow"
+        , "rArrow"
+        , "fatRArrow"
+        , "lParen"
+        , "rParen"
+        , "lSqBracket"
+        , "rSqBracket"
+        , "lCurlyBracket"
+        , "rCurlyBracket"
+        , "backslash"
+        , "doubleColon"
+        , "minus"
+        , "bar"
+        , "backtick"
     };
 
+    constexpr size_t token_type_count =
+        static_cast<size_t>(TokenType::backtick) + 1;
+
+    static_assert(
+        std::size(token_type_names) == token_type_count,
+        "every token type needs a name"
+    );
+
+    constexpr std::string_view token_type_name(TokenType type) noexcept
+    {
+        return token_type_names[static_cast<size_t>(type)];
+    }
+
+    using SymbolId = uint32_t;
+
+    constexpr SymbolId no_symbol = UINT32_MAX;
+
+    /*!
+     * The value of a numeric literal, converted once as it is parsed.
+     */
+    union LiteralValue
+    {
+        int64_t integer;
+
+        double real;
+    };
+
+    /*!
+     * Whether tokens of `type` carry a `LiteralValue`: `intLit` an integer,
+     * `realLit` a real, either one with its `minus` (if any) applied.
+     */
+    constexpr bool has_value(TokenType type) noexcept
+    {
+        return type == TokenType::intLit || type == TokenType::realLit;
+    }
+
+    /*!
+     * A token's lexeme is a span of the source buffer it was parsed from, so
+     * a token is only valid for as long as that buffer is. Identifiers and
+     * operators also carry the id they were interned under, and numeric
+     * literals their value.
+     */
     struct Token
     {
         TokenType type;
 
-        std::string lexeme;
+        SymbolId symbol;
+
+        std::string_view lexeme;
+
+        /*!
+         * Zero unless `has_value(type)`.
+         */
+        LiteralValue value;
+
+        Token(TokenType t,
+              std::string_view lex,
+              SymbolId sym = no_symbol) noexcept;
 
-        Token(TokenType t, std::string lex) noexcept;
+        Token(TokenType t, LiteralValue val) noexcept;
     };
 }
@@ -1,9 +1,19 @@
 #pragma once
 
+#include <cstddef>
+#include <utility>
 #include <vector>
 
 namespace brouwer
 {
+    /*!
+     * An owning tree. Subtrees are only ever moved into their parent, so the
+     * type is move-only; `clone()` makes the rare deep copy explicit.
+     *
+     * Nothing here recurses once per level: copying, destroying and walking a
+     * tree all keep their own stack, so arbitrarily deep trees (thousands of
+     * nested parentheses in generated code) can't overflow the call stack.
+     */
     template<class T>
     class Tree
     {
@@ -13,13 +23,90 @@ namespace brouwer
             std::vector<Tree<T>> children;
 
         public:
-            Tree(T val) noexcept : value(val) {}
+            Tree(T val) noexcept : value(std::move(val)) {}
 
-            Tree(const Tree<T>& that) = default;
+            /*!
+             * Tears the tree down a level at a time, with this node's own
+             * child vector as the stack of subtrees still to free: each one's
+             * children are moved onto it before the (by then childless) node
+             * is destroyed.
+             */
+            ~Tree()
+            {
+                while (!this->children.empty())
+                {
+                    Tree<T> node = std::move(this->children.back());
+                    this->children.pop_back();
+
+                    for (Tree<T>& child : node.children)
+                    {
+                        this->children.push_back(std::move(child));
+                    }
+
+                    node.children.clear();
+                }
+            }
+
+            Tree(Tree<T>&& that) noexcept = default;
+
+            Tree<T>& operator=(Tree<T>&& that) noexcept = default;
+
+            Tree(const Tree<T>& that) = delete;
+
+            Tree<T>& operator=(const Tree<T>& that) = delete;
+
+            Tree<T> clone() const
+            {
+                Tree<T> copy(this->value);
+                std::vector<std::pair<const Tree<T>*, Tree<T>*>> stack = {
+                    { this, &copy }
+                };
+
+                while (!stack.empty())
+                {
+                    const auto [from, to] = stack.back();
+                    stack.pop_back();
+
+                    // Every copied child is in place before any is pushed, so
+                    // the pointers into `to->children` stay valid.
+                    to->children.reserve(from->children.size());
+
+                    for (const Tree<T>& child : from->children)
+                    {
+                        to->children.emplace_back(child.value);
+                    }
+
+                    for (size_t i = 0; i < from->children.size(); ++i)
+                    {
+                        stack.emplace_back(
+                            &from->children[i],
+                            &to->children[i]
+                        );
+                    }
+                }
+
+                return copy;
+            }
 
             void add_child(Tree<T>&& child) noexcept
             {
-                this->children.push_back(child);
+                this->children.push_back(std::move(child));
+            }
+
+            template<class... Args>
+            Tree<T>& emplace_child(Args&&... args)
+            {
+                return this->children.emplace_back(std::forward<Args>(args)...);
+            }
+
+            void set_children(std::vector<Tree<T>> kids) noexcept
+            {
+                this->children = std::move(kids);
+            }
+
+            void reserve(size_t n)
+            {
+                this->children.reserve(n);
             }
 
             const T& val() const noexcept
@@ -27,6 +114,11 @@ namespace brouwer
                 return this->value;
             }
 
+            T& val() noexcept
+            {
+                return this->value;
+            }
+
             size_t child_count() const noexcept
             {
                 return this->children.size();
@@ -41,5 +133,118 @@ namespace brouwer
             {
                 return this->children[i];
             }
+
+            Tree<T>& get_child(size_t i) noexcept
+            {
+                return this->children[i];
+            }
+
+            /*!
+             * Moves every child out, leaving this a leaf.
+             */
+            std::vector<Tree<T>> take_children() noexcept
+            {
+                std::vector<Tree<T>> taken;
+                taken.swap(this->children);
+
+                return taken;
+            }
+
+            /*!
+             * Visits the tree depth-first. `pre(node, depth)` runs on the way
+             * down and returns whether to visit the node's children;
+             * `post(node, depth)` runs on the way back up, once all of them
+             * are done. The root is at depth 0.
+             */
+            template<class Pre, class Post>
+            void walk(Pre&& pre, Post&& post) const
+            {
+                walk_from(*this, pre, post);
+            }
+
+            /*!
+             * As above, over a tree that `pre` and `post` may modify in
+             * place. `pre` may replace the children of the node it is given
+             * (they are visited after it returns); neither may touch those of
+             * its ancestors.
+             */
+            template<class Pre, class Post>
+            void walk(Pre&& pre, Post&& post)
+            {
+                walk_from(*this, pre, post);
+            }
+
+            /*!
+             * Calls `visit(node, depth)` on every node, parents before
+             * children.
+             */
+            template<class Visit>
+            void preorder(Visit&& visit) const
+            {
+                this->walk(
+                    [&visit](const Tree<T>& node, size_t depth) {
+                        visit(node, depth);
+
+                        return true;
+                    },
+                    [](const Tree<T>&, size_t) {}
+                );
+            }
+
+            /*!
+             * Calls `visit(node, depth)` on every node, children before
+             * parents.
+             */
+            template<class Visit>
+            void postorder(Visit&& visit) const
+            {
+                this->walk(
+                    [](const Tree<T>&, size_t) { return true; },
+                    visit
+                );
+            }
+
+        private:
+            template<class Node, class Pre, class Post>
+            static void walk_from(Node& root, Pre& pre, Post& post)
+            {
+                // (node, index of the next child to visit)
+                std::vector<std::pair<Node*, size_t>> stack;
+
+                if (pre(root, 0))
+                {
+                    stack.emplace_back(&root, 0);
+                }
+                else
+                {
+                    post(root, 0);
+                }
+
+                while (!stack.empty())
+                {
+                    auto& [node, next] = stack.back();
+
+                    if (next == node->children.size())
+                    {
+                        Node& done = *node;
+                        stack.pop_back();
+                        post(done, stack.size());
+
+                        continue;
+                    }
+
+                    Node& child = node->children[next++];
+                    const size_t depth = stack.size();
+
+                    if (pre(child, depth))
+                    {
+                        stack.emplace_back(&child, 0);
+                    }
+                    else
+                    {
+                        post(child, depth);
+                    }
+                }
+            }
     };
 }
@@ -0,0 +1,611 @@
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Arith.h"
+#include "Bytecode.h"
+#include "Vm.h"
+
+#if defined(__GNUC__) && !defined(BROUWER_SWITCH_DISPATCH)
+#define BROUWER_THREADED_DISPATCH
+#endif
+
+namespace brouwer
+{
+    static constexpr size_t max_call_depth = 1 << 16;
+
+    /*!
+     * Superinstructions, which stand for the hottest instruction sequences
+     * in looping code. Each one is installed over the first byte of its
+     * sequence and leaves the rest as it was, so it runs the whole sequence
+     * and jumps into the middle of it still land on valid code.
+     */
+    enum class Super : uint8_t
+    {
+          icmp_ifeq = opcode_count // icmp; ifeq
+        , icmp_ifne
+        , icmp_iflt
+        , icmp_ifge
+        , icmp_ifgt
+        , icmp_ifle
+        , inc_local                // load_n; iconst_1; iadd; store_n
+        , load_0_load              // load_0; load_m
+        , load_1_load
+        , load_2_load
+        , load_3_load
+        , load_0_load_iadd         // load_0; load_m; iadd
+        , load_1_load_iadd
+        , load_2_load_iadd
+        , load_3_load_iadd
+        , load_0_inc               // load_0; iconst_1; iadd
+        , load_1_inc
+        , load_2_inc
+        , load_3_inc
+        , load_0_dec               // load_0; iconst_1; isub
+        , load_1_dec
+        , load_2_dec
+        , load_3_dec
+    };
+
+    static constexpr size_t super_count =
+        static_cast<size_t>(Super::load_3_dec) + 1 - opcode_count;
+
+    static constexpr uint8_t byte(Opcode op) noexcept
+    {
+        return static_cast<uint8_t>(op);
+    }
+
+    static constexpr uint8_t byte(Super op, uint8_t n = 0) noexcept
+    {
+        return static_cast<uint8_t>(static_cast<uint8_t>(op) + n);
+    }
+
+    /*!
+     * The superinstruction for the sequence starting at `code[at]`, if
+     * there is one, and the number of bytes that it covers.
+     */
+    static std::pair<uint8_t, size_t> fuse(const std::vector<uint8_t>& code,
+                                           size_t at) noexcept
+    {
+        const auto op = [&](size_t k) -> uint8_t {
+            return at + k < code.size() ? code[at + k] : byte(Opcode::nop);
+        };
+
+        const auto in = [](uint8_t b, Opcode first, Opcode last) {
+            return b >= byte(first) && b <= byte(last);
+        };
+
+        const uint8_t first = op(0);
+
+        if (in(first, Opcode::load_0, Opcode::load_3))
+        {
+            const uint8_t n = first - byte(Opcode::load_0);
+
+            if (
+                op(1) == byte(Opcode::iconst_1) &&
+                op(2) == byte(Opcode::iadd)     &&
+                op(3) == byte(Opcode::store_0) + n
+            ) {
+                return { byte(Super::inc_local), 4 };
+            }
+
+            if (
+                in(op(1), Opcode::load_0, Opcode::load_3) &&
+                op(2) == byte(Opcode::iadd)
+            ) {
+                return { byte(Super::load_0_load_iadd, n), 3 };
+            }
+
+            if (op(1) == byte(Opcode::iconst_1) && op(2) == byte(Opcode::iadd))
+            {
+                return { byte(Super::load_0_inc, n), 3 };
+            }
+
+            if (op(1) == byte(Opcode::iconst_1) && op(2) == byte(Opcode::isub))
+            {
+                return { byte(Super::load_0_dec, n), 3 };
+            }
+
+            if (in(op(1), Opcode::load_0, Opcode::load_3))
+            {
+                return { byte(Super::load_0_load, n), 2 };
+            }
+        }
+
+        if (first == byte(Opcode::icmp) && in(op(1), Opcode::ifeq, Opcode::ifle))
+        {
+            return { byte(Super::icmp_ifeq, op(1) - byte(Opcode::ifeq)), 4 };
+        }
+
+        return { first, 1 + operand_size(static_cast<Opcode>(first)) };
+    }
+
+    /*!
+     * Installs superinstructions over `code`. The bytes that a fused
+     * sequence covers are left alone, since its superinstruction reads
+     * them.
+     */
+    static void quicken(std::vector<uint8_t>& code) noexcept
+    {
+        for (size_t at = 0; at < code.size();)
+        {
+            const auto [op, length] = fuse(code, at);
+            code[at] = op;
+            at += length;
+        }
+    }
+
+    Vm::Vm(const Program& prog, std::ostream& output, VmOptions opts)
+        : program(prog), out(output), stack(opts.stack_size), executed(0)
+    {
+        this->frames.reserve(64);
+        this->code.reserve(prog.chunks.size());
+
+        for (const Chunk& chunk : prog.chunks)
+        {
+            this->code.push_back(chunk.code);
+
+            if (opts.superinstructions)
+            {
+                quicken(this->code.back());
+            }
+        }
+    }
+
+    uint64_t Vm::instruction_count() const noexcept
+    {
+        return this->executed;
+    }
+
+#if defined(BROUWER_THREADED_DISPATCH)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+    Value Vm::run()
+    {
+        if (this->program.chunks.empty())
+        {
+            throw std::logic_error("program without a top-level chunk");
+        }
+
+        Value* const stack_begin = this->stack.data();
+        Value* const stack_end = stack_begin + this->stack.size();
+
+        const Chunk* chunk = &this->program.chunks[0];
+        const uint8_t* ip = this->code[0].data();
+        Value* locals = stack_begin;
+        Value* sp = locals + chunk->local_count;
+        uint64_t count = 0;
+
+        if (sp + chunk->max_stack > stack_end)
+        {
+            throw std::runtime_error("stack overflow");
+        }
+
+        this->frames.clear();
+
+        for (Value* local = locals; local < sp; ++local)
+        {
+            local->i = 0;
+        }
+
+        const auto read_u16 = [](const uint8_t* at) noexcept {
+            return static_cast<uint16_t>(at[0] | (at[1] << 8));
+        };
+
+        const auto read_i16 = [&](const uint8_t* at) noexcept {
+            return static_cast<int16_t>(read_u16(at));
+        };
+
+#if defined(BROUWER_THREADED_DISPATCH)
+        // Indexed by opcode, so this has to follow `Opcode` and then
+        // `Super` exactly.
+        static const void* const labels[] =
+        {
+              &&op_nop
+            , &&op_iconst_n1
+            , &&op_iconst_0
+            , &&op_iconst_1
+            , &&op_iconst_2
+            , &&op_iconst_3
+            , &&op_fconst_n1
+            , &&op_fconst_0
+            , &&op_fconst_1
+            , &&op_fconst_2
+            , &&op_fconst_3
+            , &&op_load_0
+            , &&op_load_1
+            , &&op_load_2
+            , &&op_load_3
+            , &&op_load
+            , &&op_store_0
+            , &&op_store_1
+            , &&op_store_2
+            , &&op_store_3
+            , &&op_store
+            , &&op_pop
+            , &&op_dup
+            , &&op_swap
+            , &&op_iadd
+            , &&op_fadd
+            , &&op_isub
+            , &&op_fsub
+            , &&op_imul
+            , &&op_fmul
+            , &&op_idiv
+            , &&op_fdiv
+            , &&op_imod
+            , &&op_fmod
+            , &&op_ineg
+            , &&op_fneg
+            , &&op_i2f
+            , &&op_f2i
+            , &&op_icmp
+            , &&op_fcmpl
+            , &&op_fcmpg
+            , &&op_ldc
+            , &&op_goto_
+            , &&op_ifeq
+            , &&op_ifne
+            , &&op_iflt
+            , &&op_ifge
+            , &&op_ifgt
+            , &&op_ifle
+            , &&op_call
+            , &&op_ret
+            , &&op_iprint
+            , &&op_fprint
+            , &&super_icmp_ifeq
+            , &&super_icmp_ifne
+            , &&super_icmp_iflt
+            , &&super_icmp_ifge
+            , &&super_icmp_ifgt
+            , &&super_icmp_ifle
+            , &&super_inc_local
+            , &&super_load_0_load
+            , &&super_load_1_load
+            , &&super_load_2_load
+            , &&super_load_3_load
+            , &&super_load_0_load_iadd
+            , &&super_load_1_load_iadd
+            , &&super_load_2_load_iadd
+            , &&super_load_3_load_iadd
+            , &&super_load_0_inc
+            , &&super_load_1_inc
+            , &&super_load_2_inc
+            , &&super_load_3_inc
+            , &&super_load_0_dec
+            , &&super_load_1_dec
+            , &&super_load_2_dec
+            , &&super_load_3_dec
+        };
+
+        static_assert(
+            std::size(labels) == opcode_count + super_count,
+            "every opcode needs a handler"
+        );
+
+#define OP(name) op_##name:
+#define SUPER(name) super_##name:
+#define NEXT() do { ++count; goto *labels[*ip++]; } while (false)
+
+        goto *labels[*ip++];
+#else
+#define OP(name) case byte(Opcode::name):
+#define SUPER(name) case byte(Super::name):
+#define NEXT() continue
+
+        for (;; ++count)
+        {
+            switch (*ip++)
+            {
+#endif
+
+        OP(nop)
+        {
+            NEXT();
+        }
+
+        OP(iconst_n1) { (sp++)->i = -1; NEXT(); }
+        OP(iconst_0)  { (sp++)->i = 0;  NEXT(); }
+        OP(iconst_1)  { (sp++)->i = 1;  NEXT(); }
+        OP(iconst_2)  { (sp++)->i = 2;  NEXT(); }
+        OP(iconst_3)  { (sp++)->i = 3;  NEXT(); }
+
+        OP(fconst_n1) { (sp++)->f = -1.0; NEXT(); }
+        OP(fconst_0)  { (sp++)->f = 0.0;  NEXT(); }
+        OP(fconst_1)  { (sp++)->f = 1.0;  NEXT(); }
+        OP(fconst_2)  { (sp++)->f = 2.0;  NEXT(); }
+        OP(fconst_3)  { (sp++)->f = 3.0;  NEXT(); }
+
+        OP(load_0) { *sp++ = locals[0]; NEXT(); }
+        OP(load_1) { *sp++ = locals[1]; NEXT(); }
+        OP(load_2) { *sp++ = locals[2]; NEXT(); }
+        OP(load_3) { *sp++ = locals[3]; NEXT(); }
+
+        OP(load)
+        {
+            *sp++ = locals[*ip++];
+            NEXT();
+        }
+
+        OP(store_0) { locals[0] = *--sp; NEXT(); }
+        OP(store_1) { locals[1] = *--sp; NEXT(); }
+        OP(store_2) { locals[2] = *--sp; NEXT(); }
+        OP(store_3) { locals[3] = *--sp; NEXT(); }
+
+        OP(store)
+        {
+            locals[*ip++] = *--sp;
+            NEXT();
+        }
+
+        OP(pop)
+        {
+            --sp;
+            NEXT();
+        }
+
+        OP(dup)
+        {
+            *sp = sp[-1];
+            ++sp;
+            NEXT();
+        }
+
+        OP(swap)
+        {
+            const Value tmp = sp[-1];
+            sp[-1] = sp[-2];
+            sp[-2] = tmp;
+            NEXT();
+        }
+
+        OP(iadd) { --sp; sp[-1].i = arith::add(sp[-1].i, sp->i); NEXT(); }
+        OP(fadd) { --sp; sp[-1].f += sp->f; NEXT(); }
+        OP(isub) { --sp; sp[-1].i = arith::sub(sp[-1].i, sp->i); NEXT(); }
+        OP(fsub) { --sp; sp[-1].f -= sp->f; NEXT(); }
+        OP(imul) { --sp; sp[-1].i = arith::mul(sp[-1].i, sp->i); NEXT(); }
+        OP(fmul) { --sp; sp[-1].f *= sp->f; NEXT(); }
+
+        OP(idiv)
+        {
+            --sp;
+
+            if (sp->i == 0)
+            {
+                throw std::runtime_error("division by zero");
+            }
+
+            sp[-1].i = arith::div(sp[-1].i, sp->i);
+            NEXT();
+        }
+
+        OP(fdiv) { --sp; sp[-1].f /= sp->f; NEXT(); }
+
+        OP(imod)
+        {
+            --sp;
+
+            if (sp->i == 0)
+            {
+                throw std::runtime_error("division by zero");
+            }
+
+            sp[-1].i = arith::mod(sp[-1].i, sp->i);
+            NEXT();
+        }
+
+        OP(fmod) { --sp; sp[-1].f = std::fmod(sp[-1].f, sp->f); NEXT(); }
+
+        OP(ineg) { sp[-1].i = arith::sub(0, sp[-1].i); NEXT(); }
+        OP(fneg) { sp[-1].f = -sp[-1].f; NEXT(); }
+
+        OP(i2f) { sp[-1].f = static_cast<double>(sp[-1].i); NEXT(); }
+        OP(f2i) { sp[-1].i = arith::to_int(sp[-1].f); NEXT(); }
+
+        OP(icmp)
+        {
+            --sp;
+            sp[-1].i = arith::cmp(sp[-1].i, sp->i);
+            NEXT();
+        }
+
+        OP(fcmpl)
+        {
+            --sp;
+            sp[-1].i = arith::cmp(sp[-1].f, sp->f, -1);
+            NEXT();
+        }
+
+        OP(fcmpg)
+        {
+            --sp;
+            sp[-1].i = arith::cmp(sp[-1].f, sp->f, 1);
+            NEXT();
+        }
+
+        OP(ldc)
+        {
+            *sp++ = chunk->constants[read_u16(ip)].value;
+            ip += 2;
+            NEXT();
+        }
+
+        OP(goto_)
+        {
+            ip += 2 + read_i16(ip);
+            NEXT();
+        }
+
+#define BRANCH_IF(cond)                                                     \
+        {                                                                   \
+            const int64_t v = (--sp)->i;                                    \
+            ip += (cond) ? 2 + read_i16(ip) : 2;                            \
+            NEXT();                                                         \
+        }
+
+        OP(ifeq) BRANCH_IF(v == 0)
+        OP(ifne) BRANCH_IF(v != 0)
+        OP(iflt) BRANCH_IF(v < 0)
+        OP(ifge) BRANCH_IF(v >= 0)
+        OP(ifgt) BRANCH_IF(v > 0)
+        OP(ifle) BRANCH_IF(v <= 0)
+
+#undef BRANCH_IF
+
+        OP(call)
+        {
+            const uint16_t index = read_u16(ip);
+            const Chunk* const callee = &this->program.chunks[index];
+            Value* const callee_locals = sp - callee->arity;
+            Value* const callee_sp = callee_locals + callee->local_count;
+
+            if (
+                callee_sp + callee->max_stack > stack_end ||
+                this->frames.size() >= max_call_depth
+            ) {
+                this->executed = count;
+
+                throw std::runtime_error("stack overflow");
+            }
+
+            this->frames.push_back({ chunk, ip + 2, locals });
+
+            for (Value* local = sp; local < callee_sp; ++local)
+            {
+                local->i = 0;
+            }
+
+            chunk = callee;
+            ip = this->code[index].data();
+            locals = callee_locals;
+            sp = callee_sp;
+            NEXT();
+        }
+
+        OP(ret)
+        {
+            const Value result = sp[-1];
+
+            if (this->frames.empty())
+            {
+                this->executed = count + 1;
+
+                return result;
+            }
+
+            // The callee's frame starts where its arguments were pushed,
+            // which is where the result goes.
+            sp = locals;
+            *sp++ = result;
+
+            const Frame& caller = this->frames.back();
+            chunk = caller.chunk;
+            ip = caller.ip;
+            locals = caller.locals;
+            this->frames.pop_back();
+            NEXT();
+        }
+
+        OP(iprint)
+        {
+            this->out << (--sp)->i << '\n';
+            NEXT();
+        }
+
+        OP(fprint)
+        {
+            this->out << (--sp)->f << '\n';
+            NEXT();
+        }
+
+        // Each superinstruction starts out with `ip` on the second byte of
+        // its sequence.
+
+#define ICMP_BRANCH_IF(cond)                                                \
+        {                                                                   \
+            sp -= 2;                                                        \
+            const int64_t v = arith::cmp(sp[0].i, sp[1].i);                 \
+            ip += (cond) ? 3 + read_i16(ip + 1) : 3;                        \
+            NEXT();                                                         \
+        }
+
+        SUPER(icmp_ifeq) ICMP_BRANCH_IF(v == 0)
+        SUPER(icmp_ifne) ICMP_BRANCH_IF(v != 0)
+        SUPER(icmp_iflt) ICMP_BRANCH_IF(v < 0)
+        SUPER(icmp_ifge) ICMP_BRANCH_IF(v >= 0)
+        SUPER(icmp_ifgt) ICMP_BRANCH_IF(v > 0)
+        SUPER(icmp_ifle) ICMP_BRANCH_IF(v <= 0)
+
+#undef ICMP_BRANCH_IF
+
+        SUPER(inc_local)
+        {
+            // The slot is the one that the trailing `store_n` names.
+            Value& local = locals[ip[2] - byte(Opcode::store_0)];
+            local.i = arith::add(local.i, 1);
+            ip += 3;
+            NEXT();
+        }
+
+#define LOAD_N_SUPERS(n)                                                    \
+        SUPER(load_##n##_load)                                              \
+        {                                                                   \
+            sp[0] = locals[n];                                              \
+            sp[1] = locals[ip[0] - byte(Opcode::load_0)];                   \
+            sp += 2;                                                        \
+            ip += 1;                                                        \
+            NEXT();                                                         \
+        }                                                                   \
+                                                                            \
+        SUPER(load_##n##_load_iadd)                                         \
+        {                                                                   \
+            (sp++)->i = arith::add(                                         \
+                locals[n].i,                                                \
+                locals[ip[0] - byte(Opcode::load_0)].i                      \
+            );                                                              \
+            ip += 2;                                                        \
+            NEXT();                                                         \
+        }                                                                   \
+                                                                            \
+        SUPER(load_##n##_inc)                                               \
+        {                                                                   \
+            (sp++)->i = arith::add(locals[n].i, 1);                         \
+            ip += 2;                                                        \
+            NEXT();                                                         \
+        }                                                                   \
+                                                                            \
+        SUPER(load_##n##_dec)                                               \
+        {                                                                   \
+            (sp++)->i = arith::sub(locals[n].i, 1);                         \
+            ip += 2;                                                        \
+            NEXT();                                                         \
+        }
+
+        LOAD_N_SUPERS(0)
+        LOAD_N_SUPERS(1)
+        LOAD_N_SUPERS(2)
+        LOAD_N_SUPERS(3)
+
+#undef LOAD_N_SUPERS
+
+#if !defined(BROUWER_THREADED_DISPATCH)
+            }
+        }
+#endif
+
+#undef NEXT
+#undef SUPER
+#undef OP
+    }
+
+#if defined(BROUWER_THREADED_DISPATCH)
+#pragma GCC diagnostic pop
+#endif
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "Bytecode.h"
+
+namespace brouwer
+{
+    struct VmOptions
+    {
+        /*!
+         * Slots in the value stack, which holds every frame's locals and
+         * operands back to back.
+         */
+        size_t stack_size = 1 << 20;
+
+        /*!
+         * Fuse hot instruction sequences into superinstructions before
+         * running (see Vm.cpp).
+         */
+        bool superinstructions = true;
+    };
+
+    /*!
+     * Interprets a compiled `Program`. Dispatch is direct-threaded (computed
+     * `goto`) on compilers that support it, unless `BROUWER_SWITCH_DISPATCH`
+     * is defined, and a plain `switch` otherwise. Runtime errors (division
+     * by zero, stack overflow) are thrown as `std::runtime_error`.
+     */
+    class Vm
+    {
+        public:
+            explicit Vm(const Program& prog,
+                        std::ostream& output = std::cout,
+                        VmOptions opts = {});
+
+            /*!
+             * Runs the top-level chunk to completion, returning its value.
+             */
+            Value run();
+
+            /*!
+             * The number of instructions executed by the last `run()`, with
+             * each superinstruction counting as one.
+             */
+            uint64_t instruction_count() const noexcept;
+
+        private:
+            struct Frame
+            {
+                const Chunk* chunk;
+
+                const uint8_t* ip;
+
+                Value* locals;
+            };
+
+            const Program& program;
+
+            std::ostream& out;
+
+            /*!
+             * The code of each chunk, with superinstructions installed.
+             */
+            std::vector<std::vector<uint8_t>> code;
+
+            std::vector<Value> stack;
+
+            std::vector<Frame> frames;
+
+            uint64_t executed;
+    };
+}
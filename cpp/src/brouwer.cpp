@@ -1,66 +1,867 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 
+#include "Bytecode.h"
+#include "Cache.h"
+#include "Compiler.h"
+#include "Dump.h"
+#include "FlatAst.h"
+#include "ModuleLoader.h"
 #include "Tree.h"
+#include "ThreadPool.h"
 #include "Token.h"
 #include "Parser.h"
+#include "Server.h"
+#include "Vm.h"
 
-int main(int argc, char** argv)
+namespace
 {
     using namespace brouwer;
     using AST = Tree<Token>;
 
-    if (argc < 2)
+    struct DriverOptions
     {
-        std::cout << "Please provide the source file." << std::endl;
+        ParserOptions parser;
 
-        return 1;
+        CompilerOptions compiler;
+
+        VmOptions vm;
+
+        bool run = false;
+
+        bool flat = false;
+
+        bool bytecode = false;
+
+        bool vm_stats = false;
+
+        bool use_cache = false;
+
+        bool imports = false;
+
+        bool watch = false;
+
+        bool stream = false;
+
+        bool all_errors = false;
+
+        bool profile = false;
+
+        bool serve = false;
+
+        /*!
+         * Where to parse a single file's chunks (`--split`), if anywhere.
+         */
+        ThreadPool* split = nullptr;
+
+        DumpFormat dump = DumpFormat::pretty;
+
+        std::vector<std::string> search_path;
+    };
+
+    /*!
+     * Prints every rule that `parser` ran, the most expensive (by time spent
+     * in the rule itself) first.
+     */
+    void report_profile(const Parser& parser, std::ostream& err)
+    {
+        const RuleProfiles& profile = parser.rule_profile();
+        std::vector<size_t> ran;
+
+        for (size_t i = 0; i < profile.size(); ++i)
+        {
+            if (profile[i].attempts > 0 || profile[i].rewound > 0)
+            {
+                ran.push_back(i);
+            }
+        }
+
+        std::sort(ran.begin(), ran.end(), [&profile](size_t a, size_t b) {
+            return profile[a].self_ns > profile[b].self_ns;
+        });
+
+        err << std::left << std::setw(16) << "rule" << std::right
+            << std::setw(12) << "attempts"
+            << std::setw(12) << "successes"
+            << std::setw(12) << "failures"
+            << std::setw(12) << "rewound"
+            << std::setw(12) << "total ms"
+            << std::setw(12) << "self ms" << '\n';
+
+        for (const size_t i : ran)
+        {
+            const RuleProfile& rule = profile[i];
+
+            err << std::left << std::setw(16)
+                << token_type_name(static_cast<TokenType>(i)) << std::right
+                << std::setw(12) << rule.attempts
+                << std::setw(12) << rule.successes
+                << std::setw(12) << rule.failures
+                << std::setw(12) << rule.rewound
+                << std::fixed << std::setprecision(3)
+                << std::setw(12) << rule.total_ns / 1e6
+                << std::setw(12) << rule.self_ns / 1e6 << '\n';
+        }
+
+        err.flush();
+    }
+
+    /*!
+     * Parses (and compiles, runs, ...) one file, writing what it would print
+     * to `out` and `err`, and returns its exit status. Nothing here is shared
+     * with other calls, so files can be processed on any number of threads
+     * at once: the parser's tables are all `constexpr`, and the rest of its
+     * state (symbol table, memo, ...) belongs to the `Parser`.
+     */
+    int process(const std::string& filename,
+                const DriverOptions& opts,
+                std::ostream& out,
+                std::ostream& err)
+    {
+        std::optional<Parser> parser;
+        std::optional<AST> ast;
+        std::optional<FlatAst> flat_ast;
+        std::optional<Program> program;
+
+        try
+        {
+            parser.emplace(filename, opts.parser);
+
+            if (opts.stream)
+            {
+                Dumper dumper(out, opts.dump);
+
+                // Prints the same pretty dump as below, one item at a time;
+                // the other formats get a document per item instead.
+                if (opts.dump == DumpFormat::pretty)
+                {
+                    dumper.dump(AST({ TokenType::root, "" }), 0);
+                    dumper.dump(AST({ TokenType::prog, "" }), 1);
+                }
+
+                parser->parse_each([&](AST item) { dumper.dump(item, 2); });
+
+                if (opts.dump == DumpFormat::pretty)
+                {
+                    dumper.flush();
+                    out << std::endl;
+                }
+
+                if (opts.profile)
+                {
+                    report_profile(*parser, err);
+                }
+
+                return 0;
+            }
+
+            const bool compile = opts.bytecode || opts.run;
+            const std::string cache_path = cache::path_for(filename);
+            std::optional<CacheEntry> cached;
+
+            if (opts.use_cache)
+            {
+                cached = cache::load(
+                    cache_path,
+                    parser->shared_source(),
+                    opts.compiler.opt_level
+                );
+            }
+
+            if (cached)
+            {
+                flat_ast = std::move(cached->ast);
+
+                if (compile)
+                {
+                    program = std::move(cached->program);
+                }
+
+                if (!opts.flat && !(compile && program))
+                {
+                    ast = flat_ast->to_tree();
+                }
+            }
+            else if (opts.all_errors)
+            {
+                ParseResult result = parser->parse_recovering();
+
+                if (!result.diagnostics.empty())
+                {
+                    for (const Diagnostic& d : result.diagnostics)
+                    {
+                        out << filename << ':' << d.line << ':' << d.column
+                            << ": " << d.message.c_str() << '\n';
+                    }
+
+                    out.flush();
+
+                    return 1;
+                }
+
+                if (opts.flat)
+                {
+                    flat_ast = FlatAst::from_tree(
+                        result.ast,
+                        parser->shared_source(),
+                        opts.parser.share_subtrees
+                    );
+                }
+                else
+                {
+                    ast = std::move(result.ast);
+                }
+            }
+            else if (opts.split)
+            {
+                ast = parser->parse_parallel(*opts.split);
+
+                if (opts.flat)
+                {
+                    flat_ast = FlatAst::from_tree(
+                        *ast,
+                        parser->shared_source(),
+                        opts.parser.share_subtrees
+                    );
+                }
+            }
+            else if (opts.flat)
+            {
+                flat_ast = parser->parse_flat();
+            }
+            else
+            {
+                ast = parser->parse();
+            }
+
+            const bool compiled_now = compile && !program && ast;
+
+            if (compiled_now)
+            {
+                program = Compiler(opts.compiler).compile(*ast);
+            }
+
+            if (opts.use_cache && (!cached || compiled_now))
+            {
+                if (!flat_ast && ast)
+                {
+                    flat_ast = FlatAst::from_tree(
+                        *ast,
+                        parser->shared_source(),
+                        opts.parser.share_subtrees
+                    );
+                }
+
+                if (flat_ast)
+                {
+                    cache::store(
+                        cache_path,
+                        *parser->shared_source(),
+                        *flat_ast,
+                        program ? &*program : nullptr,
+                        opts.compiler.opt_level
+                    );
+                }
+            }
+
+            if (opts.run && program)
+            {
+                Vm vm(*program, out, opts.vm);
+                const auto start = std::chrono::steady_clock::now();
+                vm.run();
+                const std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+
+                out.flush();
+
+                if (opts.vm_stats)
+                {
+                    const uint64_t ops = vm.instruction_count();
+
+                    err << "vm: " << ops << " instructions in "
+                        << elapsed.count() << " s";
+
+                    if (elapsed.count() > 0)
+                    {
+                        err << " (" << ops / elapsed.count() << " ops/s)";
+                    }
+
+                    err << std::endl;
+                }
+
+                return 0;
+            }
+        }
+        catch (const std::runtime_error& re)
+        {
+            out << "Uh-oh:\n    " << re.what() << std::endl;
+
+            if (opts.profile && parser)
+            {
+                report_profile(*parser, err);
+            }
+
+            return 1;
+        }
+        catch (const std::logic_error& le)
+        {
+            out << "Internal error:\n    " << le.what() << std::endl;
+
+            return 1;
+        }
+        catch (const std::exception& e)
+        {
+            out << "Unknown error:\n    " << e.what() << std::endl;
+
+            return 2;
+        }
+        catch (...)
+        {
+            out << "Parser panic! Something is terribly wrong!" << std::endl;
+
+            return 3;
+        }
+
+        if (!ast && !flat_ast)
+        {
+            out << "ast == nullopt" << std::endl;
+
+            return 1;
+        }
+
+        if (program)
+        {
+            disassemble(*program, out);
+            out << std::endl;
+        }
+        else
+        {
+            Dumper dumper(out, opts.dump);
+
+            if (opts.flat)
+            {
+                dumper.dump(*flat_ast);
+            }
+            else
+            {
+                dumper.dump(*ast);
+            }
+
+            if (opts.dump == DumpFormat::pretty)
+            {
+                dumper.flush();
+                out << std::endl;
+            }
+        }
+
+        if (opts.parser.packrat)
+        {
+            const MemoStats& stats = parser->memo_stats();
+            const size_t lookups = stats.hits + stats.misses;
+
+            err << "packrat: " << stats.hits << " hits, "
+                << stats.misses << " misses";
+
+            if (lookups > 0)
+            {
+                err << " (" << 100 * stats.hits / lookups << "% hit rate)";
+            }
+
+            err << std::endl;
+        }
+
+        if (opts.parser.share_subtrees && flat_ast)
+        {
+            const size_t tree_nodes = flat_ast->tree_size();
+
+            err << "shared: " << tree_nodes << " nodes stored as "
+                << flat_ast->node_count() << " (";
+
+            if (flat_ast->node_count() > 0)
+            {
+                err << static_cast<double>(tree_nodes) /
+                       static_cast<double>(flat_ast->node_count()) << "x, ";
+            }
+
+            err << flat_ast->memory_usage() << " bytes)" << std::endl;
+        }
+
+        if (opts.profile)
+        {
+            report_profile(*parser, err);
+        }
+
+        return 0;
+    }
+
+    /*!
+     * Runs `process` on a stack that fits a `--max-depth` above the default.
+     * The parser would size its own, but compiling the tree it returns
+     * recurses as deeply.
+     */
+    int process_nested(const std::string& filename,
+                       const DriverOptions& opts,
+                       std::ostream& out,
+                       std::ostream& err)
+    {
+        try
+        {
+            return on_parser_stack(opts.parser, [&]() {
+                return process(filename, opts, out, err);
+            });
+        }
+        catch (const std::system_error& se)
+        {
+            out << "Uh-oh:\n    " << se.what() << std::endl;
+
+            return 1;
+        }
+    }
+
+    /*!
+     * Expands directories into the `.bwr` files below them, in sorted order
+     * so that output is the same from run to run.
+     */
+    std::vector<std::string> collect(const std::vector<std::string>& inputs)
+    {
+        namespace fs = std::filesystem;
+
+        std::vector<std::string> files;
+
+        for (const std::string& input : inputs)
+        {
+            if (!fs::is_directory(input))
+            {
+                files.push_back(input);
+
+                continue;
+            }
+
+            std::vector<std::string> found;
+
+            for (const fs::directory_entry& entry :
+                 fs::recursive_directory_iterator(input))
+            {
+                if (
+                    entry.is_regular_file() &&
+                    entry.path().extension() == ".bwr"
+                ) {
+                    found.push_back(entry.path().string());
+                }
+            }
+
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+
+        return files;
+    }
+
+    /*!
+     * Re-validates `filename` whenever it changes, reparsing only what each
+     * save touched. Runs until interrupted.
+     */
+    int watch(const std::string& filename, const DriverOptions& opts)
+    {
+        namespace fs = std::filesystem;
+
+        Parser parser(Source::from_buffer("", filename), opts.parser);
+        AST tree({ TokenType::root, "" });
+        fs::file_time_type seen;
+
+        for (;;)
+        {
+            std::error_code ec;
+            const fs::file_time_type modified = fs::last_write_time(filename, ec);
+
+            if (ec || modified == seen)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+                continue;
+            }
+
+            seen = modified;
+
+            try
+            {
+                Source updated = Source::from_file(filename);
+                const std::shared_ptr<const Source> before =
+                    parser.shared_source();
+                const TextEdit edit =
+                    TextEdit::between(before->view(), updated.view());
+                const auto start = std::chrono::steady_clock::now();
+                std::optional<AST> reparsed =
+                    parser.reparse(std::move(tree), std::move(updated), edit);
+                const std::chrono::duration<double, std::milli> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                const ReparseStats& stats = parser.reparse_stats();
+
+                tree = reparsed ? std::move(*reparsed)
+                                : AST({ TokenType::root, "" });
+
+                std::cout << filename << ": ok, ";
+
+                if (stats.full)
+                {
+                    std::cout << "parsed everything";
+                }
+                else
+                {
+                    std::cout << "reparsed " << stats.reparsed << " of "
+                              << stats.reparsed + stats.reused << " items";
+                }
+
+                std::cout << " in " << elapsed.count() << " ms" << std::endl;
+            }
+            catch (const std::runtime_error& re)
+            {
+                tree = AST({ TokenType::root, "" });
+
+                std::cout << filename << ": Uh-oh:\n    " << re.what()
+                          << std::endl;
+            }
+        }
+    }
+
+    /*!
+     * Loads `files` and everything they import, then lists each module once,
+     * after the modules that it imports, along with its imports (or why it
+     * failed to load).
+     */
+    int load_imports(const std::vector<std::string>& files,
+                     const DriverOptions& opts,
+                     ThreadPool& pool)
+    {
+        ModuleLoader loader(pool, { opts.parser, opts.search_path });
+        const ModuleGraph graph = loader.load(files);
+        std::vector<size_t> order;
+        int status = 0;
+
+        try
+        {
+            order = graph.order();
+        }
+        catch (const std::runtime_error& re)
+        {
+            std::cout << "Uh-oh:\n    " << re.what() << std::endl;
+
+            return 1;
+        }
+
+        for (const size_t id : order)
+        {
+            const Module& module = graph.modules[id];
+
+            std::cout << module.path << '\n';
+
+            if (!module.error.empty())
+            {
+                std::cout << "  Uh-oh:\n      " << module.error << '\n';
+                status = 1;
+            }
+
+            for (const size_t dep : module.imports)
+            {
+                std::cout << "  -> " << graph.modules[dep].path << '\n';
+            }
+
+            for (const std::string& name : module.missing)
+            {
+                std::cout << "  -> " << name << " (not found)\n";
+                status = 1;
+            }
+        }
+
+        std::cout << std::flush;
+
+        return status;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DriverOptions opts;
+    size_t jobs = 0;
+    bool split = false;
+    std::vector<std::string> inputs;
+
+    // `brouwer run <file>` executes the program instead of dumping it.
+    opts.run = argc > 1 && std::string(argv[1]) == "run";
+
+    for (int i = opts.run ? 2 : 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+
+        if (arg == "--packrat")
+        {
+            opts.parser.packrat = true;
+        }
+        else if (arg == "--flat")
+        {
+            opts.flat = true;
+        }
+        else if (arg == "--bytecode")
+        {
+            opts.bytecode = true;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+        {
+            opts.compiler.opt_level = static_cast<unsigned>(arg[2] - '0');
+        }
+        else if (arg == "--no-superinstructions")
+        {
+            opts.vm.superinstructions = false;
+        }
+        else if (arg == "--cache")
+        {
+            opts.use_cache = true;
+        }
+        else if (arg == "--stats")
+        {
+            opts.vm_stats = true;
+        }
+        else if (arg == "--all-errors")
+        {
+            opts.all_errors = true;
+        }
+        else if (arg == "--profile")
+        {
+            if (!Parser::profiling())
+            {
+                std::cout << "--profile needs a build configured with "
+                             "-DBROUWER_PROFILE_RULES=ON." << std::endl;
+
+                return 1;
+            }
+
+            opts.profile = true;
+        }
+        else if (arg == "--share")
+        {
+            opts.parser.share_subtrees = true;
+        }
+        else if (arg == "--serve")
+        {
+            opts.serve = true;
+        }
+        else if (arg == "--split")
+        {
+            split = true;
+        }
+        else if (arg == "--stream")
+        {
+            opts.stream = true;
+        }
+        else if (arg == "--watch")
+        {
+            opts.watch = true;
+        }
+        else if (arg == "--imports")
+        {
+            opts.imports = true;
+        }
+        else if (arg == "-I" && i + 1 < argc)
+        {
+            opts.search_path.emplace_back(argv[++i]);
+        }
+        else if (arg == "--dump")
+        {
+            const std::optional<DumpFormat> format =
+                dump_format_named(i + 1 < argc ? argv[++i] : "");
+
+            if (!format)
+            {
+                std::cout << "--dump expects pretty, sexpr, json or binary."
+                          << std::endl;
+
+                return 1;
+            }
+
+            opts.dump = *format;
+        }
+        else if (arg == "--max-depth")
+        {
+            const std::string limit = i + 1 < argc ? argv[++i] : "";
+
+            if (
+                limit.empty() ||
+                limit.find_first_not_of("0123456789") != std::string::npos
+            ) {
+                std::cout << "--max-depth expects a number of levels."
+                          << std::endl;
+
+                return 1;
+            }
+
+            opts.parser.max_depth = std::stoul(limit);
+        }
+        else if (arg.rfind("-j", 0) == 0)
+        {
+            const std::string count =
+                arg.size() > 2 ? arg.substr(2) : i + 1 < argc ? argv[++i] : "";
+
+            if (
+                count.empty() ||
+                count.find_first_not_of("0123456789") != std::string::npos
+            ) {
+                std::cout << "-j expects a number of jobs." << std::endl;
+
+                return 1;
+            }
+
+            jobs = std::stoul(count);
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
     }
 
-    std::string filename(argv[1]);
+    if (opts.serve)
+    {
+        if (!inputs.empty())
+        {
+            std::cout << "--serve reads its requests from stdin." << std::endl;
+
+            return 1;
+        }
+
+        ServerOptions server_opts;
+        server_opts.parser = opts.parser;
+        server_opts.jobs = jobs;
 
-    Parser parser = { filename };
-    std::optional<AST> ast;
+        Server(server_opts).serve(std::cin, std::cout);
+
+        return 0;
+    }
+
+    std::vector<std::string> files;
 
     try
     {
-        ast = parser.parse();
+        files = collect(inputs);
     }
-    catch (const std::runtime_error& re)
+    catch (const std::filesystem::filesystem_error& fe)
     {
-        std::cout << "Uh-oh:\n    " << re.what() << std::endl;
+        std::cout << "Uh-oh:\n    " << fe.what() << std::endl;
 
         return 1;
     }
-    catch (const std::logic_error& le)
+
+    if (files.empty())
     {
-        std::cout << "Internal error:\n    " << le.what() << std::endl;
+        std::cout << "Please provide the source file." << std::endl;
 
         return 1;
     }
-    catch (const std::exception& e)
+
+    if (
+        opts.stream &&
+        (opts.run || opts.bytecode || opts.flat || opts.use_cache)
+    ) {
+        std::cout << "--stream only dumps the tree." << std::endl;
+
+        return 1;
+    }
+
+    if (split)
     {
-        std::cout << "Unknown error:\n    " << e.what() << std::endl;
+        if (
+            files.size() != 1 || opts.stream || opts.all_errors ||
+            opts.watch || opts.imports
+        ) {
+            std::cout << "--split parses exactly one file, whole."
+                      << std::endl;
+
+            return 1;
+        }
 
-        return 2;
+        ThreadPool pool(jobs);
+
+        opts.split = &pool;
+
+        return process(files[0], opts, std::cout, std::cerr);
     }
-    catch (...)
+
+    if (opts.watch)
     {
-        std::cout << "Parser panic! Something is terribly wrong!" << std::endl;
+        if (files.size() != 1)
+        {
+            std::cout << "--watch takes exactly one file." << std::endl;
 
-        return 3;
+            return 1;
+        }
+
+        return watch(files[0], opts);
     }
 
-    if (!ast)
+    if (opts.imports)
     {
-        std::cout << "ast == nullopt" << std::endl;
+        // The import graph fans out well past the files given, so the pool
+        // isn't capped by their number.
+        ThreadPool pool(jobs);
 
-        return 1;
+        return load_imports(files, opts, pool);
     }
 
-    Parser::log_depthfirst(*ast, 0);
-    std::cout << std::endl;
+    if (files.size() == 1)
+    {
+        return process_nested(files[0], opts, std::cout, std::cerr);
+    }
+
+    struct Result
+    {
+        std::ostringstream out;
+
+        std::ostringstream err;
+
+        int status;
+    };
+
+    // Each file gets its own buffers, which are printed whole and in input
+    // order, so output never interleaves however the jobs get scheduled.
+    std::vector<Result> results(files.size());
+    std::vector<std::future<void>> done;
+    ThreadPool pool(std::min(
+        jobs ? jobs : std::thread::hardware_concurrency(),
+        files.size()
+    ));
+    int status = 0;
+
+    done.reserve(files.size());
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        done.push_back(pool.submit([&, i]() {
+            Result& result = results[i];
+            result.status =
+                process_nested(files[i], opts, result.out, result.err);
+        }));
+    }
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        done[i].get();
+
+        std::cout << "==> " << files[i] << " <==\n" << results[i].out.str();
+        std::cout.flush();
+        std::cerr << results[i].err.str();
+
+        status = std::max(status, results[i].status);
+    }
 
-    return 0;
+    return status;
 }
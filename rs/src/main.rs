@@ -3,10 +3,6 @@
 
 #![deny(missing_docs)]
 
-#![feature(collection_placement)]
-#![feature(io)]
-#![feature(placement_in_syntax)]
-
 //! Parser (and bytecode compiler/interpreter) for the brouwer language.
 
 mod parser;
@@ -3,7 +3,7 @@ use std::convert::AsRef;
 use std::error::Error;
 use std::fs::File;
 use std::io;
-use std::io::{Chars, Read};
+use std::io::{BufReader, Bytes, Read};
 use std::path::Path;
 
 use token::{Token, TokenType};
@@ -12,8 +12,51 @@ use tree::Tree;
 
 pub type AST = Tree<Token>;
 
+/// The characters of a UTF-8 file, decoded as they are read, through a
+/// buffer.
+pub struct Chars {
+    bytes: Bytes<BufReader<File>>,
+}
+
+impl Iterator for Chars {
+    type Item = io::Result<char>;
+
+    fn next(&mut self) -> Option<io::Result<char>> {
+        let invalid = || io::Error::new(
+            io::ErrorKind::InvalidData,
+            "stream did not contain valid UTF-8",
+        );
+
+        let first = match self.bytes.next()? {
+            Ok(b)  => b,
+            Err(e) => return Some(Err(e)),
+        };
+
+        let (len, init) = match first {
+            0x00..=0x7f => return Some(Ok(first as char)),
+            0xc0..=0xdf => (1, u32::from(first & 0x1f)),
+            0xe0..=0xef => (2, u32::from(first & 0x0f)),
+            0xf0..=0xf7 => (3, u32::from(first & 0x07)),
+            _           => return Some(Err(invalid())),
+        };
+
+        let mut code = init;
+
+        for _ in 0..len {
+            match self.bytes.next() {
+                Some(Ok(b)) if b & 0xc0 == 0x80 =>
+                    code = code << 6 | u32::from(b & 0x3f),
+                Some(Err(e)) => return Some(Err(e)),
+                _            => return Some(Err(invalid())),
+            }
+        }
+
+        Some(::std::char::from_u32(code).ok_or_else(invalid))
+    }
+}
+
 pub struct Parser {
-    charstream:    Chars<File>,
+    charstream:    Chars,
     eof:           bool,
     charhistory:   VecDeque<char>,
     ch:            char,
@@ -26,7 +69,7 @@ impl Parser {
         let file = File::open(filename)?;
 
         Ok(Parser {
-            charstream:    file.chars(),
+            charstream:    Chars { bytes: BufReader::new(file).bytes() },
             eof:           false,
             charhistory:   VecDeque::with_capacity(20),
             ch:            ' ', // Dummy value.
@@ -17,7 +17,7 @@ impl<T> Tree<T> {
     }
 
     pub fn add_child(&mut self, child: Self) {
-        self.children.place_back() <- child;
+        self.children.push(child);
     }
 
     pub fn children(&self) -> &Vec<Tree<T>> {